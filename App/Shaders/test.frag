@@ -1,12 +1,30 @@
 #version 460
 
+#extension GL_EXT_nonuniform_qualifier : require
+
 layout(location = 0) in vec2 texCoord;
+layout(location = 1) flat in uint materialIndex;
 
 layout(location = 0) out vec4 out_Color;
 
-layout(binding = 3) uniform sampler2D texSampler;
+// Must match MaterialData in model_desc.h
+struct MaterialData
+{
+    vec4 DiffuseColor;
+    uint DiffuseTexture;
+    uint NormalTexture;
+    uint SpecularTexture;
+    uint Padding;
+};
+
+layout (std430, binding = 3) readonly buffer Materials { MaterialData m[]; } in_Materials;
+
+// The bindless texture table that is shared by all the models
+layout(set = 1, binding = 0) uniform sampler2D textures[];
 
 void main() 
 {
-    out_Color = texture(texSampler, texCoord);
-}
\ No newline at end of file
+    MaterialData mat = in_Materials.m[materialIndex];
+
+    out_Color = texture(textures[nonuniformEXT(mat.DiffuseTexture)], texCoord);
+}
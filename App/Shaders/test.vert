@@ -2,30 +2,110 @@
 
 struct VertexData
 {
-    float pos_x, pos_y, pos_z;
-    float u, v;
-    float normal_x, normal_y, normal_z;
-    float tangent_x, tangent_y, tangent_z;
-    float bitangent_x, bitangent_y, bitangent_z;
+    vec3 Pos;
+    vec2 UV;
+    vec3 Normal;
+    vec3 Tangent;
+    vec3 Bitangent;
 };
 
-layout (std430, binding = 0) readonly buffer Vertices { VertexData v[]; } in_Vertices;
+struct DrawData
+{
+    uint BaseVertex;
+    uint BaseIndex;
+    uint TransformIndex;
+    uint MaterialIndex;
+};
+
+// Set by GraphicsPipeline. Indexed draws get the index from the bound index
+// buffer (and vertexOffset is already added to gl_VertexIndex) which lets the
+// post-transform cache reuse the shared vertices. Otherwise the index is
+// fetched here and every triangle shades three vertices.
+layout (constant_id = 0) const bool INDEXED_DRAWS = true;
+
+// Set by GraphicsPipeline. Selects between CoreModel::Vertex (14 floats) and
+// PackedVertex (5 uints) - see vertex_packing.h.
+layout (constant_id = 1) const bool PACKED_VERTICES = false;
+
+// Raw words so that both vertex layouts can be decoded
+layout (std430, binding = 0) readonly buffer Vertices { uint w[]; } in_Vertices;
 
-layout (binding = 1) readonly buffer Indices { int i[]; } in_Indices;
+layout (binding = 1) readonly buffer Indices { uint i[]; } in_Indices;
 
-layout (binding = 2) readonly uniform UniformBuffer { mat4 WVP; } ubo;
+// Per image - one WVP matrix per instance of the model
+layout (std430, binding = 2) readonly buffer Instances { mat4 WVP[]; } in_Instances;
+
+layout (std430, binding = 4) readonly buffer Draws { DrawData d[]; } in_Draws;
+
+// The transformation of each submesh inside the model
+layout (std430, binding = 5) readonly buffer Transforms { mat4 M[]; } in_Transforms;
 
 layout(location = 0) out vec2 texCoord;
+layout(location = 1) flat out uint materialIndex;
+
+vec3 OctahedralDecode(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.x += (v.x >= 0.0) ? -t : t;
+    v.y += (v.y >= 0.0) ? -t : t;
+    return normalize(v);
+}
+
+VertexData FetchVertex(uint Index)
+{
+    VertexData vtx;
+
+    if (PACKED_VERTICES) {
+        uint Base = Index * 5;
+        uint w0 = in_Vertices.w[Base + 0];
+        uint w1 = in_Vertices.w[Base + 1];
+        uint w2 = in_Vertices.w[Base + 2];
+        uint w3 = in_Vertices.w[Base + 3];
+        uint w4 = in_Vertices.w[Base + 4];
+
+        // Still quantized - the dequantization is part of the transformation of the submesh
+        vtx.Pos = vec3(float(w0 & 0xFFFF), float(w0 >> 16), float(w1 & 0xFFFF));
+        vtx.UV = vec2(unpackHalf2x16(w1).y, unpackHalf2x16(w2).x);
+        vtx.Normal = OctahedralDecode(unpackSnorm2x16(w3));
+        vtx.Tangent = OctahedralDecode(unpackSnorm2x16(w4));
+        float BitangentSign = ((w2 >> 16) != 0) ? -1.0 : 1.0;
+        vtx.Bitangent = cross(vtx.Normal, vtx.Tangent) * BitangentSign;
+    }
+    else {
+        uint Base = Index * 14;
+        vtx.Pos = uintBitsToFloat(uvec3(in_Vertices.w[Base + 0], in_Vertices.w[Base + 1], in_Vertices.w[Base + 2]));
+        vtx.UV = uintBitsToFloat(uvec2(in_Vertices.w[Base + 3], in_Vertices.w[Base + 4]));
+        vtx.Normal = uintBitsToFloat(uvec3(in_Vertices.w[Base + 5], in_Vertices.w[Base + 6], in_Vertices.w[Base + 7]));
+        vtx.Tangent = uintBitsToFloat(uvec3(in_Vertices.w[Base + 8], in_Vertices.w[Base + 9], in_Vertices.w[Base + 10]));
+        vtx.Bitangent = uintBitsToFloat(uvec3(in_Vertices.w[Base + 11], in_Vertices.w[Base + 12], in_Vertices.w[Base + 13]));
+    }
+
+    return vtx;
+}
 
 void main() 
 {
-    int Index = in_Indices.i[gl_VertexIndex];
+    // The indirect draws are compacted by the frustum culling so the
+    // submesh index comes from firstInstance and not from gl_DrawID
+    DrawData dd = in_Draws.d[gl_BaseInstance];
+
+    uint InstanceIndex = gl_InstanceIndex - gl_BaseInstance;
 
-    VertexData vtx = in_Vertices.v[Index];
+    uint VertexIndex;
 
-    vec3 pos = vec3(vtx.pos_x, vtx.pos_y, vtx.pos_z);
+    if (INDEXED_DRAWS) {
+        VertexIndex = gl_VertexIndex;
+    }
+    else {
+        VertexIndex = dd.BaseVertex + in_Indices.i[dd.BaseIndex + gl_VertexIndex];
+    }
 
-    gl_Position = ubo.WVP * vec4(pos, 1.0);
+    VertexData vtx = FetchVertex(VertexIndex);
+
+    gl_Position = in_Instances.WVP[InstanceIndex] * (in_Transforms.M[dd.TransformIndex] * vec4(vtx.Pos, 1.0));
     
-    texCoord = vec2(vtx.u, vtx.v);
-}
\ No newline at end of file
+    texCoord = vtx.UV;
+
+    materialIndex = dd.MaterialIndex;
+}
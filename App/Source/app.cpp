@@ -1,13 +1,44 @@
+#include <string.h>
+
 #include "vulkan_app.h"
 
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 600
 #define APP_NAME "Vulkan Window"
+#define HEADLESS_NUM_FRAMES 1000
+#define HEADLESS_OUTPUT_FILE "headless.ppm"
+
+static bool HasArg(int argc, char* argv[], const char* pArg)
+{
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], pArg) == 0) {
+			return true;
+		}
+	}
 
+	return false;
+}
+
+// --headless [NumFrames] renders offscreen without a window
+// --trace captures the CPU zones from the start (including the loading) until the exit
 int main(int argc, char* argv[])
 {
+	if (HasArg(argc, argv, "--trace")) {
+		CpuProfiler::Get().Start();
+	}
+
 	VulkanApp App(WINDOW_WIDTH, WINDOW_HEIGHT);
 
+	if ((argc > 1) && (strcmp(argv[1], "--headless") == 0)) {
+		int NumFrames = ((argc > 2) && (argv[2][0] != '-')) ? atoi(argv[2]) : HEADLESS_NUM_FRAMES;
+
+		App.InitHeadless(APP_NAME);
+
+		App.ExecuteHeadless(NumFrames, HEADLESS_OUTPUT_FILE);
+
+		return 0;
+	}
+
 	App.Init(APP_NAME);
 
 	App.Execute();
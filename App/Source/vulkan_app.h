@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <chrono>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -20,6 +21,25 @@
 #include "vulkan_model.h"
 #include "camera.h"
 #include "camera_handler.h"
+#include "cpu_profiler.h"
+
+// 'N' draws a grid of copies of the model with one instanced draw per submesh
+#define INSTANCE_GRID_SIZE 4
+
+// GPU timestamps around the render pass - 'G' writes the stats to GPU_PROFILE_FILE
+#define MAIN_PASS_SCOPE "Main render pass"
+#define GPU_PROFILE_FILE "gpu_profile.txt"
+
+// 'T' starts and stops a capture of the CPU zones which is written to CPU_TRACE_FILE
+// (open in chrome://tracing or ui.perfetto.dev)
+#define CPU_TRACE_FILE "cpu_trace.json"
+
+// How the command buffer of a frame is created
+enum RecordingMode {
+	RECORDING_MODE_STATIC,		// recorded once per image and replayed - the draw count is read by the GPU
+	RECORDING_MODE_DYNAMIC,		// recorded every frame from the draws of the frame
+	RECORDING_MODE_PARALLEL		// like dynamic but the draws are recorded on multiple threads
+};
 
 
 class VulkanApp : public Engine::GLFWCallbacks
@@ -33,11 +53,18 @@ public:
 
 	~VulkanApp()
 	{
+		m_pQueue->WaitIdle();
+
 		m_vkCore.FreeCommandBuffers((uint32_t)m_cmdBufs.size(), m_cmdBufs.data());
 		m_vkCore.DestroyFramebuffers(m_frameBuffers);
 		vkDestroyShaderModule(m_device, m_vs, NULL);
 		vkDestroyShaderModule(m_device, m_fs, NULL);
 		delete m_pPipeline;
+		delete m_pPipelineNoIB;
+
+		if (m_statsQueryPool) {
+			vkDestroyQueryPool(m_device, m_statsQueryPool, NULL);
+		}
 		vkDestroyRenderPass(m_device, m_renderPass, NULL);
 		m_model.Destroy();
 	}
@@ -47,6 +74,23 @@ public:
 		m_pWindow = Engine::glfw_vulkan_init(m_windowWidth, m_windowHeight, pAppName);
 
 		m_vkCore.Init(pAppName, m_pWindow, true);
+		// The swapchain size can be different from the requested window size
+		m_windowWidth = m_vkCore.GetWidth();
+		m_windowHeight = m_vkCore.GetHeight();
+		InitScene();
+		// The object is ready to receive callbacks
+		Engine::glfw_vulkan_set_callbacks(m_pWindow, this);
+	}
+
+	// No window - see ExecuteHeadless()
+	void InitHeadless(const char* pAppName)
+	{
+		m_vkCore.InitHeadless(pAppName, m_windowWidth, m_windowHeight, true);
+		InitScene();
+	}
+
+	void InitScene()
+	{
 		m_device = m_vkCore.GetDevice();
 		m_numImages = m_vkCore.GetNumImages();
 		m_pQueue = m_vkCore.GetQueue();
@@ -55,24 +99,48 @@ public:
 		CreateShaders();
 		CreateMesh();
 		CreatePipeline();
+		CreateStatsQueryPool();
 		CreateCommandBuffers();
+		m_model.CreateDescriptorSets(*m_pPipeline);
 		RecordCommandBuffers();
 		DefaultCreateCameraPers();
-		// The object is ready to receive callbacks
-		Engine::glfw_vulkan_set_callbacks(m_pWindow, this);
 	}
 
 	void RenderScene()
 	{
-		m_pQueue->WaitIdle();
+		PROFILE_ZONE("RenderScene");
 
+		if (m_swapChainOutOfDate) {
+			RecreateSwapChain();
+		}
+
+		// Blocks only if the GPU is MAX_FRAMES_IN_FLIGHT frames behind
 		uint32_t ImageIndex = m_pQueue->AcquireNextImage();
 
+		if (ImageIndex == INVALID_IMAGE_INDEX) {
+			m_swapChainOutOfDate = true;
+			return;
+		}
+
+		m_vkCore.BeginFrame(ImageIndex);
+
 		UpdateUniformBuffers(ImageIndex);
 
-		m_pQueue->SubmitAsync(m_cmdBufs[ImageIndex]);
+		VkCommandBuffer CmdBuf = m_cmdBufs[ImageIndex];
 
-		m_pQueue->Present(ImageIndex);
+		// The draws of this frame are known only now
+		if (m_recordingMode != RECORDING_MODE_STATIC) {
+			CmdBuf = RecordFrameCommandBuffer(ImageIndex);
+			ReportRecordTime();
+		}
+
+		m_pQueue->SubmitAsync(CmdBuf);
+
+		if (!m_pQueue->Present(ImageIndex)) {
+			m_swapChainOutOfDate = true;
+		}
+
+		m_lastImageIndex = ImageIndex;
 	}
 
 	void Key(GLFWwindow* pWindow, int Key, int Scancode, int Action, int Mods)
@@ -86,6 +154,82 @@ public:
 			glfwTerminate();
 			exit(0);
 
+		case GLFW_KEY_B:
+			if (Action == GLFW_PRESS) {
+				BenchmarkIndexedDraws();
+			}
+			break;
+
+		case GLFW_KEY_I:
+			if (Action == GLFW_PRESS) {
+				SetIndexedDraws(!m_indexedDraws);
+				printf("Indexed draws %s\n", m_indexedDraws ? "on" : "off");
+			}
+			break;
+
+		case GLFW_KEY_C:
+			if (Action == GLFW_PRESS) {
+				m_model.SetFrustumCulling(!m_model.IsFrustumCulling());
+				printf("Frustum culling %s - %d submeshes, %d triangles in the last frame\n",
+					m_model.IsFrustumCulling() ? "on" : "off",
+					m_model.GetNumVisibleSubmeshes(), m_model.GetNumVisibleTriangles());
+			}
+			break;
+
+		case GLFW_KEY_M:
+			if (Action == GLFW_PRESS) {
+				m_model.SetMeshletCulling(!m_model.IsMeshletCulling());
+				printf("Meshlet culling %s - %d draws, %d triangles in the last frame\n",
+					m_model.IsMeshletCulling() ? "on" : "off",
+					m_model.GetNumDraws(), m_model.GetNumVisibleTriangles());
+			}
+			break;
+
+		case GLFW_KEY_N:
+			if (Action == GLFW_PRESS) {
+				m_instanceGrid = !m_instanceGrid;
+				printf("Instance grid %s - %d visible instances, %d draws, %d triangles in the last frame\n",
+					m_instanceGrid ? "on" : "off", m_model.GetNumVisibleInstances(),
+					m_model.GetNumDraws(), m_model.GetNumVisibleTriangles());
+			}
+			break;
+
+		case GLFW_KEY_D:
+			if (Action == GLFW_PRESS) {
+				SetRecordingMode((m_recordingMode == RECORDING_MODE_DYNAMIC) ? RECORDING_MODE_STATIC : RECORDING_MODE_DYNAMIC);
+				printf("Dynamic recording %s\n", (m_recordingMode == RECORDING_MODE_DYNAMIC) ? "on" : "off");
+			}
+			break;
+
+		case GLFW_KEY_P:
+			if (Action == GLFW_PRESS) {
+				SetRecordingMode((m_recordingMode == RECORDING_MODE_PARALLEL) ? RECORDING_MODE_STATIC : RECORDING_MODE_PARALLEL);
+				printf("Parallel recording %s - %d slices\n", (m_recordingMode == RECORDING_MODE_PARALLEL) ? "on" : "off",
+					m_vkCore.GetCommandRecorder().GetNumSlices());
+			}
+			break;
+
+		case GLFW_KEY_G:
+			if (Action == GLFW_PRESS) {
+				PrintGpuProfile();
+				m_vkCore.GetGpuProfiler().DumpToFile(GPU_PROFILE_FILE);
+			}
+			break;
+
+		case GLFW_KEY_T:
+			if (Action == GLFW_PRESS) {
+				ToggleCpuCapture();
+			}
+			break;
+
+		case GLFW_KEY_L:
+			if (Action == GLFW_PRESS) {
+				m_model.SetLODSelection(!m_model.IsLODSelection(), (float)m_windowHeight);
+				printf("LOD selection %s - %d triangles in the last frame\n",
+					m_model.IsLODSelection() ? "on" : "off", m_model.GetNumVisibleTriangles());
+			}
+			break;
+
 		default:
 			Handled = false;
 		}
@@ -108,6 +252,13 @@ public:
 	}
 
 
+	// Not every platform reports an out of date swapchain after a resize
+	void FramebufferResize(GLFWwindow* pWindow, int Width, int Height)
+	{
+		m_swapChainOutOfDate = true;
+	}
+
+
 	void Execute()
 	{
 		float CurTime = (float)glfwGetTime();
@@ -121,12 +272,107 @@ public:
 			glfwPollEvents();
 		}
 
+		StopCpuCapture();
+
 		glfwTerminate();
 	}
 
 
+	// Renders NumFrames frames with a fixed camera as fast as possible, prints the
+	// frame rate and writes the last frame to pOutputFile (binary PPM)
+	void ExecuteHeadless(int NumFrames, const char* pOutputFile)
+	{
+		auto StartTime = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < NumFrames; i++) {
+			RenderScene();
+		}
+
+		m_pQueue->WaitIdle();
+
+		std::chrono::duration<double, std::milli> Duration = std::chrono::steady_clock::now() - StartTime;
+
+		printf("Headless: %d frames in %.1f ms - %.3f ms per frame (%.1f FPS), %d draws in the last frame\n",
+			NumFrames, Duration.count(), Duration.count() / NumFrames, NumFrames * 1000.0 / Duration.count(),
+			m_model.GetNumDraws());
+
+		if (NumFrames > 0) {
+			WriteImage(m_lastImageIndex, pOutputFile);
+		}
+
+		PrintGpuProfile();
+		m_vkCore.GetGpuProfiler().DumpToFile(GPU_PROFILE_FILE);
+
+		StopCpuCapture();
+	}
+
+
 private:
 
+	void ToggleCpuCapture()
+	{
+		if (CpuProfiler::Get().IsEnabled()) {
+			StopCpuCapture();
+		}
+		else {
+			CpuProfiler::Get().Start();
+			printf("CPU capture started\n");
+		}
+	}
+
+	// Writes the capture (if one is running) to CPU_TRACE_FILE
+	void StopCpuCapture()
+	{
+		if (!CpuProfiler::Get().IsEnabled()) {
+			return;
+		}
+
+		CpuProfiler::Get().Stop();
+		CpuProfiler::Get().ExportChromeTrace(CPU_TRACE_FILE);
+	}
+
+	void PrintGpuProfile()
+	{
+		if (!m_vkCore.GetGpuProfiler().IsEnabled()) {
+			printf("GPU timestamps are not supported\n");
+			return;
+		}
+
+		std::vector<Engine::GpuScopeStats> Stats;
+		m_vkCore.GetGpuProfiler().GetStats(Stats);
+
+		for (const Engine::GpuScopeStats& s : Stats) {
+			printf("GPU %s: %.3f ms average, %.3f ms P95, %.3f ms P99 over %d samples\n",
+				s.m_name.c_str(), s.m_average, s.m_p95, s.m_p99, s.m_numSamples);
+		}
+	}
+
+
+	void WriteImage(uint32_t ImageIndex, const char* pFilename)
+	{
+		std::vector<uint8_t> Pixels;
+		m_vkCore.ReadImage(ImageIndex, Pixels);
+
+		FILE* f = fopen(pFilename, "wb");
+
+		if (!f) {
+			printf("Error opening '%s' for writing\n", pFilename);
+			return;
+		}
+
+		fprintf(f, "P6\n%d %d\n255\n", m_windowWidth, m_windowHeight);
+
+		// RGBA to RGB
+		for (size_t i = 0; i < Pixels.size(); i += 4) {
+			fwrite(&Pixels[i], 3, 1, f);
+		}
+
+		fclose(f);
+
+		printf("Frame written to '%s'\n", pFilename);
+	}
+
+
 	void DefaultCreateCameraPers()
 	{
 		float FOV = 45.0f;
@@ -159,6 +405,51 @@ private:
 	}
 
 
+	// The pipelines and the shaders are kept - only the size dependent resources
+	// are rebuilt and the command buffers are recorded with the new size. The
+	// per-image resources are rebuilt only if the number of images changed.
+	void RecreateSwapChain()
+	{
+		if (m_vkCore.RecreateSwapChain(m_renderPass, m_frameBuffers)) {
+			RecreatePerImageResources();
+		}
+
+		m_windowWidth = m_vkCore.GetWidth();
+		m_windowHeight = m_vkCore.GetHeight();
+
+		m_pGameCamera->SetViewportSize((unsigned int)m_windowWidth, (unsigned int)m_windowHeight);
+		m_model.SetLODSelection(m_model.IsLODSelection(), (float)m_windowHeight);
+
+		RecordCommandBuffers();
+
+		m_swapChainOutOfDate = false;
+	}
+
+
+	// The queue is idle. The descriptor sets are allocated for a number of images
+	// and point to the frame allocator which was recreated, so the pipelines are
+	// recreated with them (from the pipeline cache).
+	void RecreatePerImageResources()
+	{
+		m_numImages = m_vkCore.GetNumImages();
+		m_lastImageIndex = 0;
+
+		m_vkCore.FreeCommandBuffers((uint32_t)m_cmdBufs.size(), m_cmdBufs.data());
+		CreateCommandBuffers();
+
+		delete m_pPipeline;
+		delete m_pPipelineNoIB;
+		CreatePipeline();
+		m_model.CreateDescriptorSets(*m_pPipeline);
+
+		if (m_statsQueryPool) {
+			vkDestroyQueryPool(m_device, m_statsQueryPool, NULL);
+			m_statsQueryPool = VK_NULL_HANDLE;
+		}
+
+		CreateStatsQueryPool();
+	}
+
 	void CreateCommandBuffers()
 	{
 		m_cmdBufs.resize(m_numImages);
@@ -170,6 +461,10 @@ private:
 	void CreateMesh()
 	{
 		m_model.Init(&m_vkCore);
+		// 20 bytes per vertex instead of 56 - the pipelines are created to match
+		m_model.SetPackedVertices(true);
+		m_model.SetLODSelection(true, (float)m_windowHeight);
+		m_model.SetMaxInstances(INSTANCE_GRID_SIZE * INSTANCE_GRID_SIZE);
 		m_model.LoadAssimpModel("../Assets/Models/crytek_sponza/sponza.obj");
 	}
 
@@ -186,10 +481,115 @@ private:
 
 	void CreatePipeline()
 	{
-		m_pPipeline = new Engine::GraphicsPipeline(m_device, m_pWindow, m_renderPass, m_vs, m_fs, m_numImages);
+		bool PackedVertices = m_model.IsPackedVertices();
+
+		bool IndexedDraws = true;
+		m_pPipeline = new Engine::GraphicsPipeline(m_device, m_renderPass, m_vs, m_fs, m_numImages,
+			m_vkCore.GetTextureTable().GetLayout(), m_vkCore.GetPipelineCache(), IndexedDraws, PackedVertices);
+
+		// Same shaders but the vertex shader fetches the indices from the SSBO
+		IndexedDraws = false;
+		m_pPipelineNoIB = new Engine::GraphicsPipeline(m_device, m_renderPass, m_vs, m_fs, m_numImages,
+			m_vkCore.GetTextureTable().GetLayout(), m_vkCore.GetPipelineCache(), IndexedDraws, PackedVertices);
+
+		// Compare the creation times above between the first and the following runs
+		printf("Pipelines created with a %s pipeline cache\n", m_vkCore.IsPipelineCacheWarm() ? "warm" : "cold");
 	}
 
-	void RecordCommandBuffers()
+	// One pipeline statistics query per image. Optional - used by BenchmarkIndexedDraws().
+	void CreateStatsQueryPool()
+	{
+		if (!m_vkCore.GetPhysicalDevice().m_features.pipelineStatisticsQuery) {
+			printf("Pipeline statistics queries are not supported\n");
+			return;
+		}
+
+		VkQueryPoolCreateInfo QueryPoolInfo = {
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+			.queryCount = (uint32_t)m_numImages,
+			.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+								  VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+		};
+
+		VkResult res = vkCreateQueryPool(m_device, &QueryPoolInfo, NULL, &m_statsQueryPool);
+		CHECK_VK_RESULT(res, "vkCreateQueryPool\n");
+	}
+
+	// Both the model and the command buffers must switch together
+	void SetIndexedDraws(bool IndexedDraws)
+	{
+		if (IndexedDraws == m_indexedDraws) {
+			return;
+		}
+
+		m_pQueue->WaitIdle();
+
+		m_indexedDraws = IndexedDraws;
+		m_model.SetIndexedDraws(IndexedDraws);
+
+		RecordCommandBuffers();
+	}
+
+	// The frames that are recorded every frame use the primary command buffers of the
+	// recorder so the static command buffers stay valid and the switch is immediate
+	void SetRecordingMode(RecordingMode Mode)
+	{
+		m_recordingMode = Mode;
+
+		m_recordTimeSum = 0.0f;
+		m_recordTimeMax = 0.0f;
+		m_numRecordedFrames = 0;
+		m_recordReportTime = GetTime();
+	}
+
+	// Renders one frame with each path and compares the number of vertex shader
+	// invocations. With the indexed draws the post-transform cache skips the
+	// vertices that were already shaded.
+	void BenchmarkIndexedDraws()
+	{
+		if (!m_statsQueryPool) {
+			printf("Pipeline statistics queries are not supported\n");
+			return;
+		}
+
+		// The secondary command buffers don't inherit the query
+		if (m_recordingMode == RECORDING_MODE_PARALLEL) {
+			printf("The benchmark needs the static command buffers - press P first\n");
+			return;
+		}
+
+		bool OrigIndexedDraws = m_indexedDraws;
+
+		uint64_t Stats[2][2] = {};	// [indexed][primitives, VS invocations]
+
+		for (int Indexed = 0; Indexed < 2; Indexed++) {
+			SetIndexedDraws(Indexed == 1);
+
+			RenderScene();
+
+			m_pQueue->WaitIdle();
+
+			VkResult res = vkGetQueryPoolResults(m_device, m_statsQueryPool, m_lastImageIndex, 1,
+				sizeof(Stats[Indexed]), Stats[Indexed], sizeof(Stats[Indexed]),
+				VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+			CHECK_VK_RESULT(res, "vkGetQueryPoolResults\n");
+		}
+
+		SetIndexedDraws(OrigIndexedDraws);
+
+		for (int Indexed = 0; Indexed < 2; Indexed++) {
+			uint64_t NumTriangles = Stats[Indexed][0];
+			uint64_t NumInvocations = Stats[Indexed][1];
+
+			printf("%s: %llu triangles, %llu VS invocations (%.2f per triangle)\n",
+				Indexed ? "Indexed draws  " : "Vertex pulling ",
+				(unsigned long long)NumTriangles, (unsigned long long)NumInvocations,
+				NumTriangles ? (double)NumInvocations / (double)NumTriangles : 0.0);
+		}
+	}
+
+	void BeginRenderPass(VkCommandBuffer CmdBuf, int ImageIndex, VkSubpassContents Contents)
 	{
 		std::array<VkClearValue, 2> ClearValues{};
 		ClearValues[0].color = { {1.0f, 0.0f, 0.0f, 1.0f} };
@@ -199,6 +599,7 @@ private:
 			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
 			.pNext = NULL,
 			.renderPass = m_renderPass,
+			.framebuffer = m_frameBuffers[ImageIndex],
 			.renderArea = {
 				.offset = {
 					.x = 0,
@@ -213,23 +614,139 @@ private:
 			.pClearValues = ClearValues.data()
 		};
 
-		m_model.CreateDescriptorSets(*m_pPipeline);
+		vkCmdBeginRenderPass(CmdBuf, &RenderPassBeginInfo, Contents);
+	}
+
+	// Records the command buffer of the image from the draws that Update() generated for
+	// this frame. The draw count is known on the CPU so plain indirect draws are used.
+	// In the parallel mode the draws are split between the threads and recorded into
+	// secondary command buffers which don't inherit any state so each one binds everything.
+	VkCommandBuffer RecordFrameCommandBuffer(uint32_t ImageIndex)
+	{
+		Engine::VulkanCommandRecorder& Recorder = m_vkCore.GetCommandRecorder();
+
+		VkCommandBuffer CmdBuf = Recorder.BeginPrimary(ImageIndex);
+
+		Engine::VulkanGpuProfiler& Profiler = m_vkCore.GetGpuProfiler();
+		Profiler.BeginSet(CmdBuf, ImageIndex);
+
+		Engine::GraphicsPipeline* pPipeline = m_indexedDraws ? m_pPipeline : m_pPipelineNoIB;
+
+		bool Parallel = (m_recordingMode == RECORDING_MODE_PARALLEL);
+
+		// The secondary command buffers don't inherit the query
+		bool StatsQuery = m_statsQueryPool && !Parallel;
+
+		if (StatsQuery) {
+			vkCmdResetQueryPool(CmdBuf, m_statsQueryPool, ImageIndex, 1);
+			vkCmdBeginQuery(CmdBuf, m_statsQueryPool, ImageIndex, 0);
+		}
+
+		// Outside of the render pass - the secondary command buffers can't write it
+		Profiler.BeginScope(CmdBuf, ImageIndex, MAIN_PASS_SCOPE);
+
+		if (Parallel) {
+			BeginRenderPass(CmdBuf, ImageIndex, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+			Recorder.Record(CmdBuf, ImageIndex, m_renderPass, m_frameBuffers[ImageIndex], m_model.GetNumDraws(ImageIndex),
+				[&](VkCommandBuffer SecondaryCmdBuf, int FirstDraw, int NumDraws) {
+					pPipeline->Bind(SecondaryCmdBuf);
+					Engine::SetViewportAndScissor(SecondaryCmdBuf, (uint32_t)m_windowWidth, (uint32_t)m_windowHeight);
+					m_model.RecordDraws(SecondaryCmdBuf, *pPipeline, ImageIndex, FirstDraw, NumDraws);
+				});
+		}
+		else {
+			BeginRenderPass(CmdBuf, ImageIndex, VK_SUBPASS_CONTENTS_INLINE);
+
+			pPipeline->Bind(CmdBuf);
+
+			Engine::SetViewportAndScissor(CmdBuf, (uint32_t)m_windowWidth, (uint32_t)m_windowHeight);
+
+			m_model.RecordDraws(CmdBuf, *pPipeline, ImageIndex, 0, m_model.GetNumDraws(ImageIndex));
+		}
+
+		vkCmdEndRenderPass(CmdBuf);
+
+		Profiler.EndScope(CmdBuf, ImageIndex, MAIN_PASS_SCOPE);
+
+		if (StatsQuery) {
+			vkCmdEndQuery(CmdBuf, m_statsQueryPool, ImageIndex);
+		}
+
+		Recorder.EndPrimary(ImageIndex);
+
+		return CmdBuf;
+	}
+
+	// Seconds - GLFW is not initialized in headless mode
+	float GetTime() const
+	{
+		std::chrono::duration<float> Time = std::chrono::steady_clock::now() - m_startTime;
+		return Time.count();
+	}
+
+	// Once a second - the average and the worst frame since the last report
+	void ReportRecordTime()
+	{
+		float RecordTime = m_vkCore.GetCommandRecorder().GetLastRecordTime();
+
+		m_recordTimeSum += RecordTime;
+		m_recordTimeMax = (RecordTime > m_recordTimeMax) ? RecordTime : m_recordTimeMax;
+		m_numRecordedFrames++;
+
+		float Time = GetTime();
+
+		if (Time - m_recordReportTime < 1.0f) {
+			return;
+		}
+
+		printf("Command buffer recording: %.3f ms average, %.3f ms max over %d frames, %d draws\n",
+			m_recordTimeSum / (float)m_numRecordedFrames, m_recordTimeMax, m_numRecordedFrames, m_model.GetNumDraws());
+
+		m_recordTimeSum = 0.0f;
+		m_recordTimeMax = 0.0f;
+		m_numRecordedFrames = 0;
+		m_recordReportTime = Time;
+	}
+
+	void RecordCommandBuffers()
+	{
+		// The descriptor sets of the model are compatible with both pipelines
+		Engine::GraphicsPipeline* pPipeline = m_indexedDraws ? m_pPipeline : m_pPipelineNoIB;
+
+		Engine::VulkanGpuProfiler& Profiler = m_vkCore.GetGpuProfiler();
 
 		for (unsigned int i = 0; i < m_cmdBufs.size(); i++) {
 			VkCommandBuffer& CmdBuf = m_cmdBufs[i];
 
 			Engine::BeginCommandBuffer(CmdBuf, VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
 
-			RenderPassBeginInfo.framebuffer = m_frameBuffers[i];
+			// The queries are reset by every replay of the buffer
+			Profiler.BeginSet(CmdBuf, i);
+
+			if (m_statsQueryPool) {
+				vkCmdResetQueryPool(CmdBuf, m_statsQueryPool, i, 1);
+				vkCmdBeginQuery(CmdBuf, m_statsQueryPool, i, 0);
+			}
 
-			vkCmdBeginRenderPass(CmdBuf, &RenderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			Profiler.BeginScope(CmdBuf, i, MAIN_PASS_SCOPE);
 
-			m_pPipeline->Bind(CmdBuf);
+			BeginRenderPass(CmdBuf, i, VK_SUBPASS_CONTENTS_INLINE);
 
-			m_model.RecordCommandBuffer(CmdBuf, *m_pPipeline, i);
+			pPipeline->Bind(CmdBuf);
+
+			Engine::SetViewportAndScissor(CmdBuf, (uint32_t)m_windowWidth, (uint32_t)m_windowHeight);
+
+			m_model.RecordCommandBuffer(CmdBuf, *pPipeline, i);
 
 			vkCmdEndRenderPass(CmdBuf);
 
+			Profiler.EndScope(CmdBuf, i, MAIN_PASS_SCOPE);
+
+			if (m_statsQueryPool) {
+				vkCmdEndQuery(CmdBuf, m_statsQueryPool, i);
+			}
+
 			VkResult res = vkEndCommandBuffer(CmdBuf);
 			CHECK_VK_RESULT(res, "vkEndCommandBuffer\n");
 		}
@@ -251,10 +768,36 @@ private:
 
 		glm::mat4 VP = m_pGameCamera->GetVPMatrix();
 
+		if (m_instanceGrid) {
+			UpdateInstanceGrid(ImageIndex, VP, Rotate * Rotate0);
+			return;
+		}
+
 		glm::mat4 WVP = VP * Rotate * Rotate0;
 		m_model.Update(ImageIndex, WVP);
 	}
 
+
+	// The copies are placed side by side on the XZ plane
+	void UpdateInstanceGrid(uint32_t ImageIndex, const glm::mat4& VP, const glm::mat4& World)
+	{
+		glm::vec3 MinPos, MaxPos;
+		m_model.GetBoundingBox(MinPos, MaxPos);
+		glm::vec3 Size = MaxPos - MinPos;
+		float Spacing = glm::max(glm::max(Size.x, Size.y), Size.z) * 1.1f;
+
+		m_instances.clear();
+
+		for (int z = 0; z < INSTANCE_GRID_SIZE; z++) {
+			for (int x = 0; x < INSTANCE_GRID_SIZE; x++) {
+				glm::vec3 Offset = glm::vec3((float)x, 0.0f, (float)-z) * Spacing;
+				m_instances.push_back(glm::translate(glm::mat4(1.0f), Offset) * World);
+			}
+		}
+
+		m_model.UpdateInstances(ImageIndex, VP, m_instances);
+	}
+
 	GLFWwindow* m_pWindow = NULL;
 	Engine::VulkanCore m_vkCore;
 	Engine::VulkanQueue* m_pQueue = NULL;
@@ -266,6 +809,19 @@ private:
 	VkShaderModule m_vs = VK_NULL_HANDLE;
 	VkShaderModule m_fs = VK_NULL_HANDLE;
 	Engine::GraphicsPipeline* m_pPipeline = NULL;
+	Engine::GraphicsPipeline* m_pPipelineNoIB = NULL;	// vertex shader fetches the indices - for comparison
+	VkQueryPool m_statsQueryPool = VK_NULL_HANDLE;
+	bool m_indexedDraws = true;
+	uint32_t m_lastImageIndex = 0;
+	bool m_swapChainOutOfDate = false;
+	bool m_instanceGrid = false;
+	RecordingMode m_recordingMode = RECORDING_MODE_STATIC;
+	float m_recordTimeSum = 0.0f;		// ms since m_recordReportTime
+	float m_recordTimeMax = 0.0f;
+	int m_numRecordedFrames = 0;
+	float m_recordReportTime = 0.0f;
+	std::chrono::steady_clock::time_point m_startTime = std::chrono::steady_clock::now();
+	std::vector<glm::mat4> m_instances;		// world matrices of the instance grid
 	Engine::VkModel m_model;
 	Camera* m_pGameCamera = NULL;
 	int m_windowWidth = 0;
@@ -2,6 +2,26 @@
 
 #include <glm/glm.hpp>
 
+#define MAX_MESH_LODS 6
+
+// A level of detail of a submesh. All the levels use the vertices of the submesh.
+struct MeshLOD {
+    unsigned int BaseIndex = 0;
+    unsigned int NumIndices = 0;
+    float Error = 0.0f;     // simplification error in the space of the model (0 for the original mesh)
+};
+
+// A cluster of triangles of LOD 0 of a submesh. The meshlets of a submesh index a
+// copy of its original index range in meshlet order which is stored after all the
+// original ranges, so only the meshlet draws use that order.
+struct Meshlet {
+    glm::vec4 BoundingSphere = glm::vec4(0.0f);   // in the space of the whole model like BasicMeshEntry
+    glm::vec3 ConeAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    float ConeCutoff = 1.0f;                        // 1 - the cone can't reject the meshlet
+    unsigned int BaseIndex = 0;
+    unsigned int NumIndices = 0;
+};
+
 struct BasicMeshEntry {
     unsigned int NumIndices = 0;
     unsigned int NumVertices = 0;
@@ -10,4 +30,17 @@ struct BasicMeshEntry {
     unsigned int ValidFaces = 0;
     int MaterialIndex = -1;
     glm::mat4 Transformation;
-};
\ No newline at end of file
+
+    // Bounds of the submesh after Transformation was applied (i.e. in the space of the whole model)
+    glm::vec3 MinPos = glm::vec3(0.0f);
+    glm::vec3 MaxPos = glm::vec3(0.0f);
+    glm::vec4 BoundingSphere = glm::vec4(0.0f);  // xyz - center, w - radius
+
+    // LODs[0] is the original mesh (BaseIndex/NumIndices). The error increases with the level.
+    MeshLOD LODs[MAX_MESH_LODS];
+    unsigned int NumLODs = 1;
+
+    // Range in CoreModel::m_meshlets
+    unsigned int BaseMeshlet = 0;
+    unsigned int NumMeshlets = 0;
+};
@@ -35,6 +35,9 @@ public:
     void SetTarget(const glm::vec3& target);
     void SetUp(const glm::vec3& up);
 
+    // Updates the aspect ratio of the projection
+    void SetViewportSize(unsigned int width, unsigned int height);
+
     glm::mat4 GetViewMatrix() const;
     glm::mat4 GetVPMatrix() const;
 
@@ -18,6 +18,9 @@
 #include "model_interface.h"
 #include "basic_mesh_entry.h"
 #include "vulkan_texture.h"
+#include "mesh_cache.h"
+#include "texture_loader.h"
+#include "vertex_packing.h"
 
 
 class DemolitionRenderCallbacks
@@ -68,6 +71,10 @@ public:
 
     void SetTextureScale(float Scale) { m_textureScale = Scale; }
 
+    // Fraction of the triangles of the original submesh in every LOD, starting with LOD 1
+    // (LOD 0 is always the original). Must be called before the model is loaded.
+    void SetLODRatios(const std::vector<float>& Ratios) { m_lodRatios = Ratios; }
+
     bool IsAnimated() const;
 
     const Material* GetMaterialForMesh(int MeshIndex) const;
@@ -151,12 +158,21 @@ protected:
 
     virtual void InitGeometryPost() = 0;
 
+    // Converts the vertices to PackedVertex. Dequantize receives the matrix of each submesh
+    // that takes the quantized positions back to the space of the submesh.
+    void PackVertices(const std::vector<Vertex>& Vertices, std::vector<PackedVertex>& PackedVertices,
+                      std::vector<glm::mat4>& Dequantize) const;
+
     std::vector<BasicMeshEntry> m_Meshes;
+    std::vector<Meshlet> m_meshlets;
     std::vector<Material> m_Materials;
 
     // Temporary space for vertex stuff before we load them into the GPU
     std::vector<unsigned int> m_Indices;
 
+    // All the textures owned by the model (the shared missing texture is not included)
+    std::vector<Texture*> m_textures;
+
     CoreRenderingSystem* m_pCoreRenderingSystem = NULL;
 
 private:
@@ -164,11 +180,15 @@ private:
     template<typename VertexType>
     void ReserveSpace(std::vector<VertexType>& Vertices, unsigned int NumVertices, unsigned int NumIndices);
 
+    // The per mesh functions write into the given arrays/bounds instead of the class
+    // attributes so that they can run in parallel on different meshes
     template<typename VertexType>
-    void InitSingleMesh(std::vector<VertexType>& Vertices, unsigned int MeshIndex, const aiMesh* paiMesh);
+    void InitSingleMesh(std::vector<VertexType>& Vertices, std::vector<unsigned int>& Indices, glm::vec3& MinPos, glm::vec3& MaxPos,
+                        unsigned int MeshIndex, const aiMesh* paiMesh);
 
     template<typename VertexType>
-    void InitSingleMeshOpt(std::vector<VertexType>& Vertices, unsigned int MeshIndex, const aiMesh* paiMesh);
+    void InitSingleMeshOpt(std::vector<VertexType>& Vertices, std::vector<unsigned int>& Indices, glm::vec3& MinPos, glm::vec3& MaxPos,
+                           unsigned int MeshIndex, const aiMesh* paiMesh);
 
     virtual void PopulateBuffersSkinned(std::vector<SkinnedVertex>& Vertices) = 0;
 
@@ -198,10 +218,24 @@ private:
     template<typename VertexType>
     void InitAllMeshes(const aiScene* pScene, std::vector<VertexType>& Vertices);
 
+    void InitAllMeshesParallel(const aiScene* pScene, std::vector<Vertex>& Vertices);
+
     template<typename VertexType>
-    void OptimizeMesh(int MeshIndex, std::vector<unsigned int>& Indices, std::vector<VertexType>& Vertices, std::vector<VertexType>& AllVertices);
+    void OptimizeMesh(int MeshIndex, std::vector<unsigned int>& Indices, std::vector<VertexType>& Vertices,
+                      std::vector<unsigned int>& AllIndices, std::vector<VertexType>& AllVertices);
 
     void CalculateMeshTransformations(const aiScene* pScene);
+
+    template<typename VertexType>
+    void CalculateMeshBounds(const std::vector<VertexType>& Vertices);
+
+    template<typename VertexType>
+    void BuildMeshlets(const std::vector<VertexType>& Vertices);
+
+    template<typename VertexType>
+    void GenerateLODs(const std::vector<VertexType>& Vertices);
+
+    uint32_t GetLODConfig() const;
     void TraverseNodeHierarchy(glm::mat4 ParentTransformation, aiNode* pNode);
 
     bool InitMaterials(const aiScene* pScene, const std::string& Filename);
@@ -226,8 +260,20 @@ private:
 
     void InitSingleCamera(int Index, const aiScene* pScene);
 
+    Texture* GetMissingTexture();
+
+    bool LoadFromMeshCache(const std::string& Filename);
+
+    void SaveToMeshCache(const std::string& Filename, const std::vector<Vertex>& Vertices);
+
+    Texture* LoadCachedTexture(const char* pFullPath);
+
+    Texture* RequestTexture(const std::string& FullPath);
+
     const aiScene* m_pScene = NULL;
 
+    TextureLoader m_textureLoader;
+
     glm::mat4 m_GlobalInverseTransform = glm::mat4(1.0f);
 
     Assimp::Importer m_Importer;
@@ -237,10 +283,28 @@ private:
     std::vector<PointLight> m_pointLights;
     std::vector<SpotLight> m_spotLights;
     float m_textureScale = 1.0f;
+    std::vector<float> m_lodRatios = { 0.5f, 0.25f, 0.125f };
 
     glm::vec3 m_minPos = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
     glm::vec3 m_maxPos = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
 
+    /////////////////////////////////////
+    // Mesh cache stuff
+    /////////////////////////////////////
+
+    // Resolved texture paths per material - needed to load them back from the cache
+    struct MaterialTexturePaths {
+        std::string Diffuse;
+        std::string Specular;
+        std::string Normal;
+    };
+
+    std::vector<MaterialTexturePaths> m_texturePaths;
+    std::vector<MeshCacheCamera> m_cacheCameras;
+
+    // Cleared if the model contains something the cache can't store (e.g. embedded textures)
+    bool m_meshCacheable = true;
+
     /////////////////////////////////////
     // Skeletal animation stuff
     /////////////////////////////////////
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <list>
+#include <map>
+#include <vector>
 
 #include "scene_interface.h"
 #include "scene_object.h"
@@ -71,6 +73,11 @@ public:
 
     bool RemoveFromRenderList(SceneObject* pSceneObject);
 
+    // Groups the render list by model for instanced rendering - one world matrix
+    // per object. The vectors are cleared and refilled so that their memory is
+    // reused between frames; models that are no longer in the list keep an empty vector.
+    void GetRenderListByModel(std::map<CoreModel*, std::vector<glm::mat4>>& Instances) const;
+
     bool IsClearFrame() const { return m_clearFrame; }
 
     const glm::vec4& GetClearColor() { return m_clearColor; }
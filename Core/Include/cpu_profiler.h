@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+// Scoped CPU zones for frame and load time profiling. Every thread writes the
+// zones it completes into its own ring buffer so recording a zone takes no lock.
+// A ring is only ever written by its own thread - Start() begins a new generation
+// and every ring resets itself on its first zone of the new generation. The mutex
+// is only taken when a thread records its first zone (to register its ring), by
+// Start() and by the export. A ring keeps the last CPU_PROFILER_RING_SIZE
+// zones of its thread. The captures are exported as Chrome trace JSON which can be
+// opened in chrome://tracing or in Perfetto.
+//
+// PROFILE_ZONE("Name") times the rest of the enclosing block. The name must be a
+// string literal because only the pointer is stored. Define ENABLE_CPU_PROFILER as 0
+// to compile the zones out. When compiled in but not started a zone costs a
+// relaxed atomic load and a branch.
+
+#ifndef ENABLE_CPU_PROFILER
+#define ENABLE_CPU_PROFILER 1
+#endif
+
+#define CPU_PROFILER_RING_SIZE 16384    // zones per thread - must be a power of two
+
+class CpuProfiler
+{
+public:
+    static CpuProfiler& Get();
+
+    // Drops the zones of the previous capture and starts recording
+    void Start();
+
+    void Stop();
+
+    bool IsEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // Call after Stop() - a zone that was open during Stop() can still be written
+    bool ExportChromeTrace(const char* pFilename);
+
+    // rdtsc on x86, steady_clock ticks elsewhere. Converted by the export.
+    static uint64_t GetTimestamp();
+
+    // Incremented by every Start()
+    uint32_t GetGeneration() const { return m_generation.load(std::memory_order_relaxed); }
+
+    // Zones of an older generation (open during Stop() and Start()) are dropped
+    void AddZone(const char* pName, uint64_t Begin, uint64_t End, uint32_t Generation);
+
+private:
+
+    CpuProfiler() {}
+
+    struct Zone {
+        const char* pName;
+        uint64_t Begin;
+        uint64_t End;
+    };
+
+    // Written only by its own thread
+    struct ThreadRing {
+        Zone Zones[CPU_PROFILER_RING_SIZE];
+        std::atomic<uint64_t> NumZones = 0;     // since the start of the capture - the ring wraps around
+        std::atomic<uint32_t> Generation = 0;   // of the zones in the ring
+        int ThreadIndex = 0;
+    };
+
+    ThreadRing* GetThreadRing();
+
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<ThreadRing>> m_rings;
+    std::atomic<bool> m_enabled = false;
+    std::atomic<uint32_t> m_generation = 0;
+    // Both clocks are sampled at Start() and at the export to convert the timestamps
+    uint64_t m_startTimestamp = 0;
+    std::chrono::steady_clock::time_point m_startTime;
+};
+
+
+class CpuProfilerZone
+{
+public:
+    CpuProfilerZone(const char* pName)
+    {
+        if (CpuProfiler::Get().IsEnabled()) {
+            m_pName = pName;
+            m_generation = CpuProfiler::Get().GetGeneration();
+            m_begin = CpuProfiler::GetTimestamp();
+        }
+    }
+
+    ~CpuProfilerZone()
+    {
+        if (m_pName) {
+            CpuProfiler::Get().AddZone(m_pName, m_begin, CpuProfiler::GetTimestamp(), m_generation);
+        }
+    }
+
+private:
+    const char* m_pName = NULL;
+    uint64_t m_begin = 0;
+    uint32_t m_generation = 0;
+};
+
+
+#if ENABLE_CPU_PROFILER
+    #define PROFILE_ZONE_CONCAT2(a, b) a##b
+    #define PROFILE_ZONE_CONCAT(a, b) PROFILE_ZONE_CONCAT2(a, b)
+    #define PROFILE_ZONE(Name) CpuProfilerZone PROFILE_ZONE_CONCAT(ProfileZone, __LINE__)(Name)
+#else
+    #define PROFILE_ZONE(Name)
+#endif
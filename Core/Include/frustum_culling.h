@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "basic_mesh_entry.h"
+
+// Tests the bounding boxes of the submeshes of a model against the view
+// frustum. The boxes are kept in SoA form (one array per component) so that
+// the test runs on 4 boxes at a time with SSE or 8 with AVX (if the compiler
+// targets it). The frustum planes are extracted from the WVP matrix so the
+// boxes stay in the space of the model and are never transformed.
+
+void ExtractFrustumPlanes(const glm::mat4& WVP, glm::vec4 Planes[6]);
+
+// Single box version of FrustumCuller::Cull() - e.g. a whole model against
+// the WVP matrix of one of its instances
+bool IsBoxVisible(const glm::mat4& WVP, const glm::vec3& MinPos, const glm::vec3& MaxPos);
+
+
+class FrustumCuller
+{
+public:
+    FrustumCuller() {}
+
+    // Takes the boxes in BasicMeshEntry::MinPos/MaxPos
+    void SetBoxes(const std::vector<BasicMeshEntry>& Meshes);
+
+    // Writes the indices of the boxes that are at least partially inside
+    // the frustum into pVisible (room for GetNumBoxes() entries). Returns
+    // the number of visible boxes.
+    int Cull(const glm::mat4& WVP, uint32_t* pVisible) const;
+
+    int GetNumBoxes() const { return m_numBoxes; }
+
+private:
+
+    int m_numBoxes = 0;
+
+    // Padded to a multiple of the SIMD width
+    std::vector<float> m_centerX;
+    std::vector<float> m_centerY;
+    std::vector<float> m_centerZ;
+    std::vector<float> m_extentX;
+    std::vector<float> m_extentY;
+    std::vector<float> m_extentZ;
+};
+
+
+// Second stage for the submeshes that passed FrustumCuller. Tests the bounding
+// sphere of a meshlet against the frustum and its normal cone against the
+// camera position (all the triangles face away from the camera).
+class MeshletCuller
+{
+public:
+    MeshletCuller() {}
+
+    // Call once per frame before IsVisible()
+    void SetWVP(const glm::mat4& WVP);
+
+    bool IsVisible(const Meshlet& m) const;
+
+private:
+
+    glm::vec4 m_planes[6];      // normalized so that the distance to the center can be compared with the radius
+    glm::vec3 m_cameraPos = glm::vec3(0.0f);    // in the space of the model
+    bool m_perspective = false; // the cone test needs a camera position
+};
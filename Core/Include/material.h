@@ -37,14 +37,5 @@ public:
     float m_transparencyFactor = 1.0f;
     float m_alphaTest = 0.0f;
 
-    ~Material()
-    {
-        if (pDiffuse) {
-            delete pDiffuse;
-        }
-
-        if (pSpecularExponent) {
-            delete pSpecularExponent;
-        }
-    }
+    // The textures are owned by the model - materials may share them
 };
\ No newline at end of file
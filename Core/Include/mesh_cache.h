@@ -0,0 +1,169 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+
+// Binary cache of a fully imported static model. The file is a fixed header
+// followed by tightly packed sections (each aligned to MESH_CACHE_SECTION_ALIGNMENT)
+// so the whole thing can be used straight out of a read-only memory mapping.
+// The cache is considered fresh only if the magic, version, vertex layout, import
+// options, LOD settings and the size/timestamp of the source asset all match.
+// The same size/timestamp check is made for every file the import read besides
+// the source asset (material libraries and textures - see AddDependency()).
+
+#define MESH_CACHE_MAGIC    0x4843534D  // 'MSCH'
+#define MESH_CACHE_VERSION  6   // 2 - bounds of the submeshes, 3 - LODs, 4 - meshlets, 5 - meshlet index copies, 6 - dependencies
+
+#define MESH_CACHE_SECTION_ALIGNMENT 16
+
+#define MESH_CACHE_INVALID_STRING 0xFFFFFFFF
+
+enum MESH_CACHE_SECTION {
+    MESH_CACHE_SECTION_VERTICES = 0,
+    MESH_CACHE_SECTION_INDICES,
+    MESH_CACHE_SECTION_MESHES,
+    MESH_CACHE_SECTION_MATERIALS,
+    MESH_CACHE_SECTION_CAMERAS,
+    MESH_CACHE_SECTION_DIR_LIGHTS,
+    MESH_CACHE_SECTION_POINT_LIGHTS,
+    MESH_CACHE_SECTION_SPOT_LIGHTS,
+    MESH_CACHE_SECTION_MESHLETS,
+    MESH_CACHE_SECTION_DEPENDENCIES,
+    MESH_CACHE_SECTION_STRINGS,
+    MESH_CACHE_NUM_SECTIONS
+};
+
+
+struct MeshCacheSection {
+    uint64_t Offset = 0;
+    uint64_t Size = 0;
+};
+
+
+struct MeshCacheHeader {
+    uint32_t Magic = MESH_CACHE_MAGIC;
+    uint32_t Version = MESH_CACHE_VERSION;
+    uint32_t VertexStride = 0;
+    uint32_t ImportFlags = 0;
+    uint32_t LODConfig = 0;     // hash of the LOD settings
+    uint32_t Padding = 0;
+    uint64_t SourceSize = 0;
+    int64_t SourceModTime = 0;
+    glm::vec4 MinPos = glm::vec4(0.0f);
+    glm::vec4 MaxPos = glm::vec4(0.0f);
+    MeshCacheSection Sections[MESH_CACHE_NUM_SECTIONS];
+};
+
+
+// Material reference as stored in the cache. Strings are offsets into the
+// string section (MESH_CACHE_INVALID_STRING if not present). Texture paths
+// are stored fully resolved so that no Assimp material is needed on load.
+struct MeshCacheMaterial {
+    glm::vec4 AmbientColor = glm::vec4(0.0f);
+    glm::vec4 DiffuseColor = glm::vec4(0.0f);
+    glm::vec4 SpecularColor = glm::vec4(0.0f);
+    float TransparencyFactor = 1.0f;
+    float AlphaTest = 0.0f;
+    uint32_t Name = MESH_CACHE_INVALID_STRING;
+    uint32_t DiffusePath = MESH_CACHE_INVALID_STRING;
+    uint32_t SpecularPath = MESH_CACHE_INVALID_STRING;
+    uint32_t NormalPath = MESH_CACHE_INVALID_STRING;
+};
+
+
+// A file other than the source asset that the cached data depends on
+struct MeshCacheDependency {
+    uint32_t Path = MESH_CACHE_INVALID_STRING;
+    uint32_t Padding = 0;
+    uint64_t Size = 0;
+    int64_t ModTime = 0;
+};
+
+
+struct MeshCacheCamera {
+    glm::vec3 Pos = glm::vec3(0.0f);
+    PersProjInfo ProjInfo = {};
+};
+
+
+std::string GetMeshCacheFilename(const std::string& SourceFilename);
+
+
+class MeshCacheReader
+{
+public:
+    MeshCacheReader() {}
+
+    ~MeshCacheReader();
+
+    // Maps the cache file of 'SourceFilename' and validates it. Returns false
+    // if there is no cache or it doesn't match the source asset/import options.
+    bool Open(const std::string& SourceFilename, uint32_t VertexStride, uint32_t ImportFlags, uint32_t LODConfig);
+
+    void Close();
+
+    const MeshCacheHeader& GetHeader() const { return *(const MeshCacheHeader*)m_pData; }
+
+    const void* GetSection(MESH_CACHE_SECTION Section, size_t ElementSize, size_t& Count) const;
+
+    template<typename T>
+    const T* GetSection(MESH_CACHE_SECTION Section, size_t& Count) const
+    {
+        return (const T*)GetSection(Section, sizeof(T), Count);
+    }
+
+    const char* GetString(uint32_t Offset) const;
+
+private:
+
+    bool MapFile(const std::string& Filename);
+
+    const uint8_t* m_pData = NULL;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_hFile = NULL;
+    void* m_hMapping = NULL;
+#endif
+};
+
+
+class MeshCacheWriter
+{
+public:
+    MeshCacheWriter() {}
+
+    // The data is referenced, not copied, until Write() is called
+    void SetSection(MESH_CACHE_SECTION Section, const void* pData, size_t Size);
+
+    template<typename T>
+    void SetSection(MESH_CACHE_SECTION Section, const std::vector<T>& Data)
+    {
+        SetSection(Section, Data.data(), Data.size() * sizeof(T));
+    }
+
+    uint32_t AddString(const std::string& s);
+
+    // Records the current size/timestamp of the file. A file that doesn't exist
+    // is ignored (the import didn't use it). Duplicates are ignored.
+    void AddDependency(const std::string& Filename);
+
+    bool Write(const std::string& SourceFilename, uint32_t VertexStride, uint32_t ImportFlags, uint32_t LODConfig,
+               const glm::vec3& MinPos, const glm::vec3& MaxPos);
+
+private:
+
+    struct SectionData {
+        const void* pData = NULL;
+        size_t Size = 0;
+    };
+
+    SectionData m_sections[MESH_CACHE_NUM_SECTIONS];
+    std::vector<char> m_strings;
+    std::vector<MeshCacheDependency> m_dependencies;
+    std::vector<std::string> m_dependencyNames;
+};
@@ -4,6 +4,10 @@
 
 #include <vulkan/vulkan.h>
 
+#include <glm/glm.hpp>
+
+#include "vulkan_texture_table.h"
+
 namespace Engine {
 
 	struct RangeDesc {
@@ -11,23 +15,34 @@ namespace Engine {
 		VkDeviceSize m_range = 0;
 	};
 
-	struct SubmeshRanges {
-		RangeDesc m_vbRange;
-		RangeDesc m_ibRange;
-		RangeDesc m_uniformRange;
+	// Per-submesh data of the indirect path. Indexed in the vertex shader by
+	// gl_BaseInstance (firstInstance of the draw) - must match the DrawData struct in the shaders.
+	// The instance within the draw is gl_InstanceIndex - gl_BaseInstance.
+	struct DrawData {
+		uint32_t BaseVertex = 0;
+		uint32_t BaseIndex = 0;
+		uint32_t TransformIndex = 0;
+		uint32_t MaterialIndex = 0;		// into the MaterialData buffer of the model
 	};
 
-	struct TextureInfo {
-		VkSampler m_sampler;
-		VkImageView m_imageView;
+	// Per-material data of the bindless path - must match MaterialData in the shaders.
+	// The texture indices are slots in the texture table of VulkanCore.
+	struct MaterialData {
+		glm::vec4 DiffuseColor = glm::vec4(0.0f);
+		uint32_t DiffuseTexture = INVALID_TEXTURE_INDEX;
+		uint32_t NormalTexture = INVALID_TEXTURE_INDEX;
+		uint32_t SpecularTexture = INVALID_TEXTURE_INDEX;
+		uint32_t Padding = 0;
 	};
 
 	struct ModelDesc {
 		VkBuffer m_vb;
 		VkBuffer m_ib;
-		std::vector<VkBuffer> m_uniforms;
-		std::vector<TextureInfo> m_materials;
-		std::vector<SubmeshRanges> m_ranges;
+		VkBuffer m_drawData;
+		VkBuffer m_materials;
+		VkBuffer m_transforms;						// the transformations of all the submeshes
+		std::vector<VkBuffer> m_uniforms;			// per image
+		std::vector<RangeDesc> m_uniformRanges;		// per image - the WVP matrices of all the instances
 	};
 
-};
\ No newline at end of file
+};
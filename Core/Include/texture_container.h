@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Reader for precompressed texture containers (DDS and KTX2). The mip levels
+// are kept in the block compressed format of the file so that they can be
+// copied to the GPU as is. Only the BC1/BC3/BC4/BC5/BC7 and RGBA8 formats of
+// single 2D images are supported. KTX2 files must not be supercompressed.
+
+#define MAX_TEXTURE_CONTAINER_MIPS 16
+
+struct TextureContainerMip {
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint64_t Offset = 0;    // into TextureContainer::Data
+    uint64_t Size = 0;
+};
+
+
+struct TextureContainer {
+    VkFormat Format = VK_FORMAT_UNDEFINED;
+    uint32_t NumMips = 0;
+    TextureContainerMip Mips[MAX_TEXTURE_CONTAINER_MIPS];   // 0 is the largest
+    std::vector<uint8_t> Data;
+};
+
+
+// True if the extension of Filename is .dds or .ktx2
+bool IsTextureContainerFile(const std::string& Filename);
+
+// Reads a .dds or a .ktx2 file. Prints the reason and returns false if the file can't be used.
+bool LoadTextureContainer(const std::string& Filename, TextureContainer& Container);
+
+bool IsBlockCompressedFormat(VkFormat Format);
+
+// Bytes in a 4x4 block of a BC format
+uint32_t GetBlockSize(VkFormat Format);
+
+// Format used by DecodeBlockCompressedMip() - R8G8B8A8 with the color space of Format
+VkFormat GetDecodedFormat(VkFormat Format);
+
+// CPU fallback for devices without BC support. Writes Width * Height RGBA8 pixels.
+// BC4/BC5 are written to the red/green channels. Returns false for formats without
+// a decoder (BC7).
+bool DecodeBlockCompressedMip(const TextureContainer& Container, uint32_t Mip, std::vector<uint8_t>& Pixels);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "vulkan_texture.h"
+#include "texture_container.h"
+
+// Decodes image files on the thread pool while the caller continues with other
+// work (e.g. geometry import). The GPU upload is done by a single thread - the
+// one that calls Finish() - because the texture creation goes through the
+// graphics queue. Identical paths are decoded only once. DDS/KTX2 files are
+// only read and parsed in the background - their blocks are uploaded as is.
+
+class TextureLoader
+{
+public:
+    TextureLoader() {}
+
+    ~TextureLoader();
+
+    // Returns the texture that was already requested for Filename or NULL
+    Texture* Find(const std::string& Filename) const;
+
+    // Starts decoding Filename in the background. pTexture receives the image in Finish().
+    void Request(const std::string& Filename, Texture* pTexture);
+
+    // Uploads the images as soon as they are decoded and returns when all the
+    // outstanding requests are done
+    void Finish();
+
+private:
+
+    struct LoadRequest {
+        std::string Filename;
+        Texture* pTexture = NULL;
+        unsigned char* pPixels = NULL;
+        int Width = 0;
+        int Height = 0;
+        bool IsContainer = false;
+        bool ContainerLoaded = false;
+        TextureContainer Container;
+    };
+
+    void Decode(LoadRequest* pRequest);
+
+    void WaitForDecodes();
+
+    std::map<std::string, Texture*> m_textures;
+    std::vector<std::unique_ptr<LoadRequest>> m_requests;
+
+    // Protects everything below which is shared with the decoding jobs
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<LoadRequest*> m_decoded;
+    int m_numPending = 0;
+};
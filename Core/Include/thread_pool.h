@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that execute jobs from a single queue.
+// ParallelFor() splits an index range between the workers and the calling
+// thread which also takes part in the work until the whole range is done.
+// This means that it can safely be called from inside another job.
+
+class ThreadPool
+{
+public:
+    // NumThreads == 0 means one worker per hardware thread (minus the caller)
+    ThreadPool(int NumThreads = 0);
+
+    ~ThreadPool();
+
+    // The shared pool used by the engine
+    static ThreadPool& Get();
+
+    int GetNumThreads() const { return (int)m_threads.size(); }
+
+    // Calls Job(i) for every i in [0, Count) and returns when all of them are done.
+    // The order in which the indices are processed is undefined.
+    void ParallelFor(int Count, const std::function<void(int)>& Job);
+
+    // Queues a job and returns immediately. The caller is responsible for
+    // tracking its completion.
+    void Submit(std::function<void()> Job);
+
+private:
+
+    void WorkerThread();
+
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_quit = false;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+// 20 byte alternative to CoreModel::Vertex (56 bytes). Must match the decode
+// in the vertex shader which reads it as 5 uints.
+//
+// The position is quantized to 16 bits per axis inside the bounding box of
+// the submesh. The shader doesn't dequantize it - the scale and offset are
+// folded into the transformation of the submesh (see GetDequantizeMatrix()).
+// The normal and tangent are octahedral encoded and the bitangent is rebuilt
+// as cross(Normal, Tangent) * sign.
+struct PackedVertex {
+    uint16_t Position[3] = { 0, 0, 0 };     // unorm16 inside the bounds of the submesh
+    uint16_t TexCoords[2] = { 0, 0 };       // half floats
+    uint16_t BitangentSign = 0;             // 1 if Bitangent == -cross(Normal, Tangent)
+    int16_t Normal[2] = { 0, 0 };           // octahedral, snorm16
+    int16_t Tangent[2] = { 0, 0 };          // octahedral, snorm16
+};
+
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must match the vertex shader");
+
+
+glm::vec2 OctahedralEncode(const glm::vec3& v);
+
+glm::vec3 OctahedralDecode(const glm::vec2& e);
+
+// Maps [MinPos, MaxPos] to [0, 65535] on every axis
+class PositionQuantizer
+{
+public:
+    PositionQuantizer(const glm::vec3& MinPos, const glm::vec3& MaxPos);
+
+    void Quantize(const glm::vec3& Pos, uint16_t Quantized[3]) const;
+
+    glm::vec3 Dequantize(const uint16_t Quantized[3]) const;
+
+    // Takes the quantized position (as floats) back to the space of the submesh
+    glm::mat4 GetDequantizeMatrix() const;
+
+private:
+    glm::vec3 m_minPos;
+    glm::vec3 m_scale;  // size of one step on each axis
+};
+
+
+PackedVertex PackVertex(const PositionQuantizer& Quantizer, const glm::vec3& Pos, const glm::vec2& TexCoords,
+                        const glm::vec3& Normal, const glm::vec3& Tangent, const glm::vec3& Bitangent);
+
+
+// Accumulates the difference between the original and the decoded vertices
+class VertexQuantizationError
+{
+public:
+    VertexQuantizationError() {}
+
+    void Add(const PositionQuantizer& Quantizer, const PackedVertex& Packed, const glm::vec3& Pos,
+             const glm::vec2& TexCoords, const glm::vec3& Normal, const glm::vec3& Tangent);
+
+    void Print() const;
+
+private:
+    int m_numVertices = 0;
+    double m_sumPosError = 0.0;
+    float m_maxPosError = 0.0f;
+    float m_maxTexCoordError = 0.0f;
+    float m_maxNormalErrorDeg = 0.0f;
+    float m_maxTangentErrorDeg = 0.0f;
+};
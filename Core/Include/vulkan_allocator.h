@@ -0,0 +1,91 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace Engine {
+
+#define DEFAULT_MEMORY_BLOCK_SIZE (64 * 1024 * 1024)
+
+	class VulkanAllocator;
+
+	// A range inside one of the memory blocks of the allocator
+	struct VulkanAllocation {
+		VkDeviceMemory m_mem = VK_NULL_HANDLE;
+		VkDeviceSize m_offset = 0;
+		VkDeviceSize m_size = 0;
+		void* m_pMapped = NULL;		// NULL unless the memory is host visible
+		VulkanAllocator* m_pAllocator = NULL;
+		int m_blockIndex = -1;
+	};
+
+
+	// Sub-allocates buffers and images out of large VkDeviceMemory blocks so
+	// that the number of vkAllocateMemory calls stays small. Every block belongs
+	// to a single memory type and holds either linear (buffers) or non-linear
+	// (optimal tiling images) resources. This way the two kinds never share a
+	// page and bufferImageGranularity is always respected. Free space is kept
+	// as a sorted list of ranges per block (first fit, merged on free).
+	// Host visible blocks are mapped once when they are created and stay
+	// mapped until they are released.
+	class VulkanAllocator {
+	public:
+		VulkanAllocator() {}
+
+		void Init(VkDevice Device, const VkPhysicalDeviceMemoryProperties& MemProps,
+			VkDeviceSize BlockSize = DEFAULT_MEMORY_BLOCK_SIZE);
+
+		void Destroy();
+
+		VulkanAllocation Allocate(const VkMemoryRequirements& MemReqs, uint32_t MemoryTypeIndex, bool IsLinear);
+
+		void Free(VulkanAllocation& Allocation);
+
+		struct Stats {
+			int NumBlocks = 0;
+			int NumAllocations = 0;
+			VkDeviceSize BytesReserved = 0;	// total size of the blocks
+			VkDeviceSize BytesUsed = 0;		// sum of the live allocations
+			int MaxNumBlocks = 0;
+		};
+
+		Stats GetStats() const;
+
+		void PrintStats() const;
+
+	private:
+
+		struct FreeRange {
+			VkDeviceSize Offset = 0;
+			VkDeviceSize Size = 0;
+		};
+
+		struct MemoryBlock {
+			VkDeviceMemory m_mem = VK_NULL_HANDLE;
+			VkDeviceSize m_size = 0;
+			uint32_t m_memoryTypeIndex = 0;
+			bool m_isLinear = true;
+			bool m_isDedicated = false;	// holds a single allocation larger than the block size
+			void* m_pMapped = NULL;
+			int m_numAllocations = 0;
+			std::vector<FreeRange> m_freeList;	// sorted by offset
+		};
+
+		bool AllocateFromBlock(MemoryBlock& Block, VkDeviceSize Size, VkDeviceSize Alignment, VkDeviceSize& Offset);
+
+		int CreateBlock(VkDeviceSize Size, uint32_t MemoryTypeIndex, bool IsLinear, bool IsDedicated);
+
+		void ReleaseBlock(MemoryBlock& Block);
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		VkPhysicalDeviceMemoryProperties m_memProps = {};
+		VkDeviceSize m_blockSize = 0;
+		std::vector<MemoryBlock> m_blocks;	// released blocks are reused (m_mem == VK_NULL_HANDLE)
+		VkDeviceSize m_bytesUsed = 0;
+		int m_numAllocations = 0;
+		int m_maxNumBlocks = 0;
+		mutable std::mutex m_mutex;
+	};
+}
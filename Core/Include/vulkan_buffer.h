@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "vulkan_allocator.h"
+
+namespace Engine {
+
+	class BufferAndMemory {
+	public:
+		BufferAndMemory() {}
+
+		VkBuffer m_buffer = NULL;
+		VulkanAllocation m_mem;
+
+		void Update(VkDevice Device, const void* pData, size_t Size);
+
+		void Destroy(VkDevice Device);
+	};
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace Engine {
+
+	class VulkanCore;
+
+	// Records the draws of a frame into secondary command buffers on the threads
+	// of ThreadPool. The item range is split into slices and every slice has its
+	// own command pool per swapchain image, so a pool is never used by two threads
+	// at the same time and never touched while the GPU may still read its buffers.
+	// The pools of an image are reset wholesale at the start of its recording -
+	// nothing is allocated or freed per frame.
+	// Every image also has a primary command buffer in its own transient pool for
+	// the frames that are recorded from scratch (see BeginPrimary()).
+	class VulkanCommandRecorder {
+	public:
+		VulkanCommandRecorder() {}
+
+		// NumSlices == 0 means one slice per thread of ThreadPool (including the caller)
+		void Init(VulkanCore* pVulkanCore, int NumImages, int NumSlices = 0);
+
+		void Destroy();
+
+		// Resets the primary pool of the image and begins its command buffer for a single
+		// submission. Call after VulkanQueue::AcquireNextImage() returned ImageIndex.
+		VkCommandBuffer BeginPrimary(int ImageIndex);
+
+		// Ends the primary command buffer and measures the time since BeginPrimary()
+		void EndPrimary(int ImageIndex);
+
+		// CPU time in milliseconds between the last BeginPrimary()/EndPrimary() pair
+		float GetLastRecordTime() const { return m_lastRecordTime; }
+
+		// Records the items [First, First + Count) into CmdBuf. Called concurrently for different slices.
+		typedef std::function<void(VkCommandBuffer CmdBuf, int First, int Count)> RecordFunc;
+
+		// Splits [0, NumItems) between the slices, records them in parallel and executes the
+		// secondary command buffers from PrimaryCmdBuf. PrimaryCmdBuf must be inside RenderPass
+		// which was begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. Call after
+		// VulkanQueue::AcquireNextImage() returned ImageIndex.
+		void Record(VkCommandBuffer PrimaryCmdBuf, int ImageIndex, VkRenderPass RenderPass, VkFramebuffer Framebuffer,
+			int NumItems, const RecordFunc& Func);
+
+		int GetNumSlices() const { return m_numSlices; }
+
+		// Slices that were recorded by the last Record()
+		int GetNumUsedSlices() const { return m_numUsedSlices; }
+
+	private:
+
+		// A pool with a single command buffer
+		struct TransientBuffer {
+			VkCommandPool m_pool = VK_NULL_HANDLE;
+			VkCommandBuffer m_cmdBuf = VK_NULL_HANDLE;
+		};
+
+		void CreateTransientBuffer(uint32_t QueueFamily, VkCommandBufferLevel Level, TransientBuffer& Buffer);
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		int m_numSlices = 0;
+		int m_numUsedSlices = 0;
+		std::vector<std::vector<TransientBuffer>> m_slices;	// [image][slice]
+		std::vector<TransientBuffer> m_primaries;				// [image]
+		std::vector<VkCommandBuffer> m_executeList;
+		std::chrono::steady_clock::time_point m_recordStartTime;
+		float m_lastRecordTime = 0.0f;
+	};
+
+}
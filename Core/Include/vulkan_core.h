@@ -9,24 +9,16 @@
 #include "vulkan_device.h"
 #include "vulkan_queue.h"
 #include "vulkan_texture.h"
+#include "vulkan_buffer.h"
+#include "vulkan_uploader.h"
+#include "vulkan_allocator.h"
+#include "vulkan_frame_allocator.h"
+#include "vulkan_texture_table.h"
+#include "vulkan_command_recorder.h"
+#include "vulkan_gpu_profiler.h"
 
 namespace Engine {
 
-
-	class BufferAndMemory {
-	public:
-		BufferAndMemory() {}
-
-		VkBuffer m_buffer = NULL;
-		VkDeviceMemory m_mem = NULL;
-		VkDeviceSize m_allocationSize = 0;
-
-		void Update(VkDevice Device, const void* pData, size_t Size);
-
-		void Destroy(VkDevice Device);
-	};
-
-
 	class VulkanCore {
 
 	public:
@@ -37,18 +29,52 @@ namespace Engine {
 
 		void Init(const char* pAppName, GLFWwindow* pWindow, bool DepthEnabled);
 
+		// No window, surface or swapchain. The frames are rendered into offscreen color
+		// images of the given size which are left in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+		// by the render pass (see ReadImage()). Any device with a graphics and compute
+		// queue is accepted, including software implementations such as lavapipe.
+		void InitHeadless(const char* pAppName, int Width, int Height, bool DepthEnabled);
+
+		bool IsHeadless() const { return m_headless; }
+
 		VkRenderPass CreateSimpleRenderPass();
 
 		std::vector<VkFramebuffer> CreateFramebuffers(VkRenderPass RenderPass) const;
 
 		void DestroyFramebuffers(std::vector<VkFramebuffer>& Framebuffers);
 
+		// Call when the window is resized or the queue reports an out of date swapchain.
+		// Only the size dependent resources are rebuilt: the swapchain images and views,
+		// the depth images and the framebuffers of RenderPass. The pipelines are not
+		// affected because the viewport and the scissor are dynamic.
+		// The driver may return a different number of images. In that case the per-image
+		// resources of the core (queue sync objects, frame allocator segments, recorder
+		// pools and GPU profiler sets) are rebuilt as well and true is returned - the
+		// caller must then rebuild its own per-image resources (command buffers, descriptor
+		// sets of the frame allocator ranges, etc).
+		bool RecreateSwapChain(VkRenderPass RenderPass, std::vector<VkFramebuffer>& Framebuffers);
+
+		// The size of the swapchain images - it can be different from the window size on high DPI displays
+		int GetWidth() const { return m_windowWidth; }
+
+		int GetHeight() const { return m_windowHeight; }
+
 		VkDevice& GetDevice() { return m_device; }
 
+		// Loaded from the disk at Init() and saved in the destructor. Pass it to every pipeline creation.
+		VkPipelineCache GetPipelineCache() const { return m_pipelineCache; }
+
+		// True if the pipeline cache was loaded from a previous run
+		bool IsPipelineCacheWarm() const { return m_pipelineCacheWarm; }
+
 		int GetNumImages() const { return (int)m_images.size(); }
 
 		const VkImage& GetImage(int Index) const;
 
+		// Headless only - copies the image to tightly packed RGBA8 pixels (Width * Height * 4 bytes).
+		// Waits for the queue to become idle.
+		void ReadImage(int Index, std::vector<uint8_t>& Pixels);
+
 		VulkanQueue* GetQueue() { return &m_queue; }
 
 		uint32_t GetQueueFamily() const { return m_queueFamily; }
@@ -59,37 +85,81 @@ namespace Engine {
 
 		BufferAndMemory CreateVertexBuffer(const void* pVertices, size_t Size);
 
+		// The data is uploaded through the staging ring - TRANSFER_DST is added to the usage
+		BufferAndMemory CreateDeviceLocalBuffer(const void* pData, size_t Size, VkBufferUsageFlags Usage);
+
 		std::vector<BufferAndMemory> CreateUniformBuffers(size_t Size);
 
 		void CreateTexture(const char* filename, VulkanTexture& Tex);
 
 		void CreateTextureFromData(const void* pPixels, int ImageWidth, int ImageHeight, VulkanTexture& Tex);
 
+		// The mips of the container are uploaded as is. Formats that the device can't
+		// sample are decoded to RGBA8 on the CPU.
+		void CreateTextureFromContainer(const TextureContainer& Container, VulkanTexture& Tex);
+
+		BufferAndMemory CreateBuffer(VkDeviceSize Size, VkBufferUsageFlags Usage, VkMemoryPropertyFlags Properties);
+
+		// Uploads are batched - call this before using the buffers/textures created above
+		void FlushUploads();
+
+		const VulkanAllocator& GetAllocator() const { return m_allocator; }
+
+		VulkanFrameAllocator& GetFrameAllocator() { return m_frameAllocator; }
+
+		// Parallel recording of secondary command buffers with per image, per slice pools
+		VulkanCommandRecorder& GetCommandRecorder() { return m_commandRecorder; }
+
+		// Timestamp scopes. Set i < GetNumImages() belongs to the command buffers of swapchain
+		// image i and the sets after them to the upload batches.
+		VulkanGpuProfiler& GetGpuProfiler() { return m_gpuProfiler; }
+
+		// Call after acquiring the next image - resets the per-frame allocations and
+		// collects the GPU timestamps of the previous frame that used the image
+		void BeginFrame(int ImageIndex);
+
+		const PhysicalDevice& GetPhysicalDevice() const { return m_physDevices.Selected(); }
+
+		// All the textures created by VulkanCore are added to this table
+		const VulkanTextureTable& GetTextureTable() const { return m_textureTable; }
+
+		// Textures that are created while the budget is exceeded lose their top mip
+		// levels (down to MIN_BUDGET_TEXTURE_SIZE) until they fit. 0 - no limit.
+		void SetTextureMemoryBudget(VkDeviceSize Budget) { m_textureMemoryBudget = Budget; }
+
+		// Of the textures that are alive
+		VkDeviceSize GetTextureMemory() const { return m_textureMemory; }
+
+		// Called by VulkanTexture::Destroy() - frees the slot in the texture table
+		// and the memory that is counted against the budget
+		void ReleaseTexture(VulkanTexture& Tex);
+
 	private:
 
 		void CreateInstance(const char* pAppName);
 		void CreateDebugCallback();
 		void CreateSurface();
 		void CreateDevice();
-		void CreateSwapChain();
+		void CreatePipelineCache();
+		void SavePipelineCache();
+		void InitDevice();
+		void CreateSwapChain(VkSwapchainKHR OldSwapChain = VK_NULL_HANDLE);
+		void AddTextureMemory(VulkanTexture& Tex);
+		void RecreatePerImageResources();
+		void CreateOffscreenImages();
 		void CreateCommandBufferPool();
 		BufferAndMemory CreateUniformBuffer(size_t Size);
 		void CreateDepthResources();
 
 		uint32_t GetMemoryTypeIndex(uint32_t memTypeBits, VkMemoryPropertyFlags memPropFlags);
 
-		void CopyBufferToBuffer(VkBuffer Dst, VkBuffer Src, VkDeviceSize Size);
-
-		BufferAndMemory CreateBuffer(VkDeviceSize Size, VkBufferUsageFlags Usage, VkMemoryPropertyFlags Properties);
-
 		void CreateTextureImageFromData(VulkanTexture& Tex, const void* pPixels, uint32_t ImageWidth, uint32_t ImageHeight,
 			VkFormat TexFormat);
 		void CreateImage(VulkanTexture& Tex, uint32_t ImageWidth, uint32_t ImageHeight, VkFormat TexFormat,
-			VkImageUsageFlags UsageFlags, VkMemoryPropertyFlagBits PropertyFlags);
+			VkImageUsageFlags UsageFlags, VkMemoryPropertyFlagBits PropertyFlags, uint32_t MipLevels = 1);
 		void UpdateTextureImage(VulkanTexture& Tex, uint32_t ImageWidth, uint32_t ImageHeight, VkFormat TexFormat, const void* pPixels);
-		void CopyBufferToImage(VkImage Dst, VkBuffer Src, uint32_t ImageWidth, uint32_t ImageHeight);
-		void TransitionImageLayout(VkImage& Image, VkFormat Format, VkImageLayout OldLayout, VkImageLayout NewLayout);
-		void SubmitCopyCommand();
+		bool CanGenerateMips(VkFormat Format) const;
+		bool CanSample(VkFormat Format) const;
 		void GetFramebufferSize(int& Width, int& Height) const;
 
 		VkInstance m_instance = VK_NULL_HANDLE;
@@ -99,17 +169,29 @@ namespace Engine {
 		VulkanPhysicalDevices m_physDevices;
 		uint32_t m_queueFamily = 0;
 		VkDevice m_device = VK_NULL_HANDLE;
+		VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+		bool m_pipelineCacheWarm = false;
 		VkSurfaceFormatKHR m_swapChainSurfaceFormat = {};
 		VkSwapchainKHR m_swapChain = VK_NULL_HANDLE;
 		std::vector<VkImage> m_images;
 		std::vector<VkImageView> m_imageViews;
 		std::vector<VulkanTexture> m_depthImages;
+		std::vector<VulkanTexture> m_offscreenImages;	// headless - m_images/m_imageViews point into these
 		VkCommandPool m_cmdBufPool = VK_NULL_HANDLE;
 		VulkanQueue m_queue;
-		VkCommandBuffer m_copyCmdBuf = VK_NULL_HANDLE;
+		VulkanAllocator m_allocator;
+		VulkanTextureTable m_textureTable;
+		VulkanUploader m_uploader;
+		VulkanFrameAllocator m_frameAllocator;
+		VulkanCommandRecorder m_commandRecorder;
+		VulkanGpuProfiler m_gpuProfiler;
+		float m_maxAnisotropy = 1.0f;
+		VkDeviceSize m_textureMemoryBudget = 0;
+		VkDeviceSize m_textureMemory = 0;	// allocated for the textures that are alive
 		int m_windowWidth = 0;
 		int m_windowHeight = 0;
 		bool m_depthEnabled = false;
+		bool m_headless = false;
 	};
 
 }
\ No newline at end of file
@@ -16,6 +16,7 @@ namespace Engine {
 		VkPhysicalDeviceMemoryProperties m_memProps;
 		std::vector<VkPresentModeKHR> m_presentModes;
 		VkPhysicalDeviceFeatures m_features;
+		VkPhysicalDeviceVulkan12Features m_features12;	// zeroed if the device is older than 1.2
 		VkFormat m_depthFormat;
 	};
 
@@ -25,8 +26,11 @@ namespace Engine {
 		VulkanPhysicalDevices() {}
 		~VulkanPhysicalDevices() {}
 
+		// Surface can be VK_NULL_HANDLE (headless) - the surface properties are not queried
 		void Init(const VkInstance& Instance, const VkSurfaceKHR& Surface);
 
+		// The queue family must support all the flags in RequiredQueueType and presentation
+		// if SupportsPresent is true. Hardware devices are preferred over CPU implementations.
 		uint32_t SelectDevice(VkQueueFlags RequiredQueueType, bool SupportsPresent);
 
 		const PhysicalDevice& Selected() const;
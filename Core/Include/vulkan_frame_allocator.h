@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "vulkan_buffer.h"
+
+namespace Engine {
+
+	class VulkanCore;
+
+	struct FrameAllocation {
+		void* m_pMem = NULL;			// CPU address - write the data here
+		VkDeviceSize m_offset = 0;		// offset inside the buffer of the allocator
+	};
+
+	// A persistently mapped host visible buffer that is split into one segment
+	// per frame. The front of each segment holds the ranges that were reserved
+	// with Reserve() - they exist in every frame at the same offset so that
+	// descriptors can point to them. The rest of the segment is a linear
+	// allocator that is reset by BeginFrame(). Nothing is ever freed explicitly
+	// and nothing goes through the driver after Init().
+	class VulkanFrameAllocator {
+	public:
+		VulkanFrameAllocator() {}
+
+		void Init(VulkanCore* pVulkanCore, int NumFrames, VkDeviceSize FrameSize);
+
+		void Destroy();
+
+		// Recreates the buffer with a segment per frame. The reserved ranges keep their
+		// offsets but not their contents and the descriptors that point to the old
+		// buffer must be updated. The GPU must be idle.
+		void SetNumFrames(VulkanCore* pVulkanCore, int NumFrames);
+
+		// Must be called before the first BeginFrame(). Returns the offset of the
+		// range relative to the start of a frame segment.
+		VkDeviceSize Reserve(VkDeviceSize Size);
+
+		void BeginFrame(int FrameIndex);
+
+		// Allocates from the segment of the current frame
+		FrameAllocation Allocate(VkDeviceSize Size);
+
+		// CPU address of a reserved range in a specific frame
+		void* GetReservedPtr(int FrameIndex, VkDeviceSize ReservedOffset) const;
+
+		VkBuffer GetBuffer() const { return m_buffer.m_buffer; }
+
+		VkDeviceSize GetFrameOffset(int FrameIndex) const { return FrameIndex * m_frameSize; }
+
+		// Sub-ranges that are bound as uniform buffers must be aligned to this value
+		VkDeviceSize GetAlignment() const { return m_alignment; }
+
+		VkDeviceSize AlignSize(VkDeviceSize Size) const;
+
+	private:
+
+		void CreateBuffer(VulkanCore* pVulkanCore);
+
+		BufferAndMemory m_buffer;
+		VkDevice m_device = VK_NULL_HANDLE;
+		char* m_pMem = NULL;
+		int m_numFrames = 0;
+		VkDeviceSize m_frameSize = 0;
+		VkDeviceSize m_alignment = 0;
+		VkDeviceSize m_reservedSize = 0;
+		VkDeviceSize m_head = 0;
+		int m_curFrame = -1;
+	};
+}
@@ -18,6 +18,9 @@ namespace Engine {
 		virtual void MouseMove(GLFWwindow* pWindow, double xpos, double ypos) = 0;
 
 		virtual void MouseButton(GLFWwindow* pWindow, int Button, int Action, int Mods) = 0;
+
+		// The size is in pixels (not screen coordinates)
+		virtual void FramebufferResize(GLFWwindow* pWindow, int Width, int Height) {}
 	};
 
 	// Step #1: initialize GLFW and create a window
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace Engine {
+
+	class VulkanCore;
+
+#define MAX_GPU_SCOPES 32
+#define GPU_PROFILER_HISTORY 256		// samples per scope for the averages and the percentiles
+
+	// Times in milliseconds over the last GPU_PROFILER_HISTORY samples
+	struct GpuScopeStats {
+		std::string m_name;
+		int m_numSamples = 0;
+		float m_last = 0.0f;
+		float m_average = 0.0f;
+		float m_min = 0.0f;
+		float m_max = 0.0f;
+		float m_p50 = 0.0f;
+		float m_p95 = 0.0f;
+		float m_p99 = 0.0f;
+	};
+
+	// GPU timing with VK_QUERY_TYPE_TIMESTAMP queries. The query pool is divided
+	// into sets - one per command buffer that can be in flight (a swapchain image
+	// or an upload batch) - and every named scope has a fixed pair of queries in
+	// each set. A command buffer resets its set at the start with BeginSet() so the
+	// same recording can be submitted again and again. The results of a set are
+	// read without waiting by CollectSet() once the fence of its last submission
+	// was waited on, i.e. a few frames later. Scopes that were not written in that
+	// submission are simply unavailable and skipped.
+	class VulkanGpuProfiler {
+	public:
+		VulkanGpuProfiler() {}
+
+		// The profiler stays disabled (all the calls do nothing) if the queue family doesn't support timestamps
+		void Init(VulkanCore* pVulkanCore, int NumSets);
+
+		void Destroy();
+
+		bool IsEnabled() const { return m_queryPool != VK_NULL_HANDLE; }
+
+		// Resets the queries of the set. Call outside of a render pass before the first scope.
+		void BeginSet(VkCommandBuffer CmdBuf, int Set);
+
+		// A scope can be written once per set. The names are registered on first use
+		// and must not change between the recordings.
+		void BeginScope(VkCommandBuffer CmdBuf, int Set, const char* pName);
+
+		void EndScope(VkCommandBuffer CmdBuf, int Set, const char* pName);
+
+		// The last submission of the set must be complete (its fence was waited on)
+		void CollectSet(int Set);
+
+		// One entry per scope that has samples
+		void GetStats(std::vector<GpuScopeStats>& Stats) const;
+
+		// Prints the stats of GetStats() as a table. Returns false if the file can't be written.
+		bool DumpToFile(const char* pFilename) const;
+
+	private:
+
+		struct Scope {
+			std::string m_name;
+			float m_samples[GPU_PROFILER_HISTORY] = {};
+			int m_numSamples = 0;
+			int m_nextSample = 0;
+			double m_sum = 0.0;		// of the samples in the history
+		};
+
+		int GetScopeIndex(const char* pName);
+
+		uint32_t GetQuery(int Set, int ScopeIndex) const { return (uint32_t)(Set * MAX_GPU_SCOPES + ScopeIndex) * 2; }
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		VkQueryPool m_queryPool = VK_NULL_HANDLE;
+		int m_numSets = 0;
+		float m_timestampPeriod = 0.0f;		// nanoseconds per tick
+		uint64_t m_timestampMask = 0;		// of the valid bits
+		std::vector<Scope> m_scopes;
+		std::vector<uint64_t> m_results;	// scratch for CollectSet() - value and availability per query
+	};
+
+
+	// Writes the begin timestamp in the constructor and the end timestamp in the destructor
+	class GpuProfilerScope {
+	public:
+		GpuProfilerScope(VulkanGpuProfiler& Profiler, VkCommandBuffer CmdBuf, int Set, const char* pName) :
+			m_profiler(Profiler), m_cmdBuf(CmdBuf), m_set(Set), m_pName(pName)
+		{
+			m_profiler.BeginScope(m_cmdBuf, m_set, m_pName);
+		}
+
+		~GpuProfilerScope()
+		{
+			m_profiler.EndScope(m_cmdBuf, m_set, m_pName);
+		}
+
+	private:
+		VulkanGpuProfiler& m_profiler;
+		VkCommandBuffer m_cmdBuf;
+		int m_set;
+		const char* m_pName;
+	};
+
+}
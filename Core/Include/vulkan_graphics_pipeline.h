@@ -14,30 +14,42 @@ namespace Engine {
 	public:
 
 		GraphicsPipeline(VkDevice Device,
-			GLFWwindow* pWindow,
 			VkRenderPass RenderPass,
 			VkShaderModule vs,
 			VkShaderModule fs,
-			int NumImages);
+			int NumImages,
+			VkDescriptorSetLayout TextureTableLayout,
+			VkPipelineCache PipelineCache,
+			bool IndexedDraws = true,
+			bool PackedVertices = false);
 
 		~GraphicsPipeline();
 
+		// The viewport and the scissor are dynamic - see SetViewportAndScissor()
 		void Bind(VkCommandBuffer CmdBuf);
 
-		void AllocateDescriptorSets(int NumSubmeshes, std::vector< std::vector<VkDescriptorSet> >& DescriptorSets);
+		// One descriptor set per image - it contains all the submeshes of the model
+		void AllocateDescriptorSets(std::vector<VkDescriptorSet>& DescriptorSets);
 
-		void UpdateDescriptorSets(const ModelDesc& ModelDesc,
-			std::vector<std::vector<VkDescriptorSet>>& DescriptorSets);
+		void UpdateDescriptorSets(const ModelDesc& ModelDesc, std::vector<VkDescriptorSet>& DescriptorSets);
 
 		VkPipelineLayout GetPipelineLayout() const { return m_pipelineLayout; }
 
+		// Indexed draws use the bound index buffer. Otherwise the vertex shader fetches the indices itself.
+		bool IsIndexedDraws() const { return m_indexedDraws; }
+
+		// The vertex buffer contains PackedVertex instead of CoreModel::Vertex
+		bool IsPackedVertices() const { return m_packedVertices; }
+
 	private:
 
-		void InitCommon(GLFWwindow* pWindow, VkRenderPass RenderPass, VkShaderModule vs, VkShaderModule fs);
+		void InitCommon(VkRenderPass RenderPass, VkShaderModule vs, VkShaderModule fs,
+			VkDescriptorSetLayout TextureTableLayout, VkPipelineCache PipelineCache);
 
-		void AllocateDescriptorSetsInternal(int NumSubmeshes, std::vector< std::vector<VkDescriptorSet> >& DescriptorSets);
+		void AllocateDescriptorSetsInternal(std::vector<VkDescriptorSet>& DescriptorSets);
 		void CreateDescriptorPool(int MaxSets);
-		void CreateDescriptorSetLayout(bool IsVB, bool IsIB, bool IsTex, bool IsUniform);
+		void CreateDescriptorSetLayout(bool IsVB, bool IsIB, bool IsMaterials, bool IsUniform, bool IsDrawData,
+			bool IsTransforms);
 
 		VkDevice m_device = VK_NULL_HANDLE;
 		VkPipeline m_pipeline = VK_NULL_HANDLE;
@@ -45,6 +57,8 @@ namespace Engine {
 		VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
 		VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
 		int m_numImages = 0;
+		bool m_indexedDraws = true;
+		bool m_packedVertices = false;
 	};
 
 }
\ No newline at end of file
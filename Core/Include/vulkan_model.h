@@ -4,6 +4,7 @@
 #include "vulkan_graphics_pipeline.h"
 #include "core_model.h"
 #include "model_desc.h"
+#include "frustum_culling.h"
 
 namespace Engine {
 
@@ -23,19 +24,76 @@ namespace Engine {
 
 		void RecordCommandBuffer(VkCommandBuffer CmdBuf, GraphicsPipeline& pPipeline, int ImageIndex);
 
+		// Records the draws [FirstDraw, FirstDraw + NumDraws) that the last Update() of ImageIndex
+		// generated (see GetNumDraws(ImageIndex)). Can be called concurrently for different command buffers,
+		// e.g. from VulkanCommandRecorder. The pipeline must already be bound.
+		void RecordDraws(VkCommandBuffer CmdBuf, GraphicsPipeline& Pipeline, int ImageIndex, int FirstDraw, int NumDraws);
+
 		void Update(int ImageIndex, const glm::mat4& Transformation);
 
+		// Must be called before the model is loaded - sizes the per image instance buffer
+		void SetMaxInstances(int MaxInstances);
+
+		// Draws the model once per world matrix (up to SetMaxInstances()) with one
+		// instanced draw per submesh. The instances are culled with the bounding box
+		// of the whole model. Replaces Update() for the frame.
+		void UpdateInstances(int ImageIndex, const glm::mat4& VP, const std::vector<glm::mat4>& WorldMatrices);
+
+		// In the space of the model
+		void GetBoundingBox(glm::vec3& MinPos, glm::vec3& MaxPos) const { MinPos = m_boundsMin; MaxPos = m_boundsMax; }
+
 		const BufferAndMemory* GetVB() const { return &m_vb; }
 
 		const BufferAndMemory* GetIB() const { return &m_ib; }
 
+		void SetFrustumCulling(bool Enabled) { m_frustumCulling = Enabled; }
+
+		bool IsFrustumCulling() const { return m_frustumCulling; }
+
+		// Must match GraphicsPipeline::IsIndexedDraws() of the pipeline used for recording
+		void SetIndexedDraws(bool Enabled) { m_indexedDraws = Enabled; }
+
+		bool IsIndexedDraws() const { return m_indexedDraws; }
+
+		// Must be called before the model is loaded. The pipeline must be created with the same setting.
+		void SetPackedVertices(bool Enabled) { m_packedVertices = Enabled; }
+
+		bool IsPackedVertices() const { return m_packedVertices; }
+
+		// Picks the coarsest LOD of every submesh whose simplification error
+		// projects to at most MaxErrorPixels on a viewport of ViewportHeight pixels
+		void SetLODSelection(bool Enabled, float ViewportHeight, float MaxErrorPixels = 1.0f);
+
+		bool IsLODSelection() const { return m_lodSelection; }
+
+		// Splits the visible submeshes at LOD 0 into their meshlets and draws only
+		// the ones that are inside the frustum and not back-facing
+		void SetMeshletCulling(bool Enabled) { m_meshletCulling = Enabled; }
+
+		bool IsMeshletCulling() const { return m_meshletCulling; }
+
+		// Results of the last Update()
+		int GetNumVisibleSubmeshes() const { return m_numVisibleSubmeshes; }
+
+		int GetNumVisibleTriangles() const { return m_numVisibleTriangles; }
+
+		int GetNumDraws() const { return m_numDraws; }
+
+		// Draws generated by the last Update()/UpdateInstances() of the image - the range of RecordDraws()
+		int GetNumDraws(int ImageIndex) const
+		{
+			return (ImageIndex < (int)m_numDrawsPerImage.size()) ? m_numDrawsPerImage[ImageIndex] : 0;
+		}
+
+		int GetNumVisibleInstances() const { return m_numVisibleInstances; }
+
 	protected:
 
 		virtual void AllocBuffers() { /* Nothing to do here */ }
 
 		virtual Texture* AllocTexture2D();
 
-		virtual void InitGeometryPost() { /* Nothing to do here */ }
+		virtual void InitGeometryPost();
 
 		virtual void PopulateBuffersSkinned(std::vector<SkinnedVertex>& Vertices) { assert(0); }
 
@@ -44,13 +102,55 @@ namespace Engine {
 	private:
 		void UpdateModelDesc(ModelDesc& md);
 
+		void BindDescriptorSets(VkCommandBuffer CmdBuf, GraphicsPipeline& Pipeline, int ImageIndex);
+
+		void CreateDrawDataBuffer();
+
+		void CreateTransformBuffer();
+
+		void UpdateDrawCommands(int ImageIndex, const glm::mat4& Transformation);
+
+		int SelectLOD(const BasicMeshEntry& Mesh, const glm::mat4& Transformation) const;
+
+		void WriteDrawCommand(void* pCommands, int DrawIndex, uint32_t SubmeshIndex, unsigned int BaseIndex, unsigned int NumIndices,
+			uint32_t NumInstances = 1) const;
+
+		void CreateMaterialBuffer();
+
+		void SetNumDraws(int ImageIndex, int NumDraws);
+
 		VulkanCore* m_pVulkanCore = NULL;
 
 		BufferAndMemory m_vb;
 		BufferAndMemory m_ib;
-		std::vector<BufferAndMemory> m_uniformBuffers;
-		std::vector<std::vector<VkDescriptorSet>> m_descriptorSets;
-		size_t m_vertexSize = 0;	// sizeof(Vertex) OR sizeof(SkinnedVertex)
+		BufferAndMemory m_drawData;			// DrawData per submesh
+		BufferAndMemory m_transforms;		// mat4 per submesh
+		BufferAndMemory m_materialBuffer;	// MaterialData per material
+		VkDeviceSize m_uniformOffset = 0;	// WVP per instance - reserved in the frame allocator of VulkanCore
+		VkDeviceSize m_drawCmdOffset = 0;	// VkDraw[Indexed]IndirectCommand per visible submesh - reserved as well
+		VkDeviceSize m_drawCountOffset = 0;	// number of visible submeshes - reserved as well
+		FrustumCuller m_frustumCuller;
+		std::vector<uint32_t> m_visibleSubmeshes;
+		bool m_frustumCulling = true;
+		bool m_indexedDraws = true;
+		int m_numVisibleSubmeshes = 0;
+		int m_numVisibleTriangles = 0;
+		int m_numDraws = 0;
+		std::vector<int> m_numDrawsPerImage;	// [image]
+		int m_numVisibleInstances = 0;
+		int m_maxInstances = 1;
+		glm::vec3 m_boundsMin = glm::vec3(0.0f);	// bounding box of all the submeshes
+		glm::vec3 m_boundsMax = glm::vec3(0.0f);
+		uint32_t m_maxDraws = 0;	// one per meshlet (or per submesh without meshlets)
+		MeshletCuller m_meshletCuller;
+		bool m_meshletCulling = true;
+		bool m_lodSelection = false;
+		float m_viewportHeight = 0.0f;
+		float m_maxLODErrorPixels = 1.0f;
+		std::vector<VkDescriptorSet> m_descriptorSets;	// per image
+		size_t m_vertexSize = 0;	// sizeof(Vertex) OR sizeof(SkinnedVertex) OR sizeof(PackedVertex)
+		bool m_packedVertices = false;
+		std::vector<glm::mat4> m_dequantize;	// per submesh - identity if the vertices are not packed
 	};
 
 }
\ No newline at end of file
@@ -1,40 +1,79 @@
 #pragma once
 
 #include <stdio.h>
+#include <vector>
 
 #include <vulkan/vulkan.h>
 
 namespace Engine {
 
+#define MAX_FRAMES_IN_FLIGHT 2
+
+// Returned by AcquireNextImage() when the swapchain must be recreated
+#define INVALID_IMAGE_INDEX 0xFFFFFFFF
+
+	// The CPU can record/submit up to NumFramesInFlight frames ahead of the GPU.
+	// Each frame slot has its own fence and acquire semaphore and the render
+	// complete semaphores are per swapchain image because they are consumed by
+	// the presentation engine. The frame index cycles independently of the
+	// swapchain image index.
+	// Without a swapchain (headless) the images are used in turn, nothing waits
+	// on or signals the semaphores and Present() only moves to the next frame slot.
 	class VulkanQueue {
 
 	public:
 		VulkanQueue() {}
 		~VulkanQueue() {}
 
-		void Init(VkDevice Device, VkSwapchainKHR SwapChain, uint32_t QueueFamily, uint32_t QueueIndex);
+		// SwapChain is VK_NULL_HANDLE for headless rendering
+		void Init(VkDevice Device, VkSwapchainKHR SwapChain, uint32_t QueueFamily, uint32_t QueueIndex,
+			int NumImages, int NumFramesInFlight = MAX_FRAMES_IN_FLIGHT);
 
 		void Destroy();
 
+		// Waits until the GPU is done with the frame slot and with the work
+		// that previously used the acquired image. Returns INVALID_IMAGE_INDEX
+		// if the swapchain is out of date.
 		uint32_t AcquireNextImage();
 
-		void SubmitSync(VkCommandBuffer CmbBuf);
+		// The optional fence is signaled when the command buffer completes
+		void SubmitSync(VkCommandBuffer CmbBuf, VkFence Fence = VK_NULL_HANDLE);
 
 		void SubmitAsync(VkCommandBuffer CmbBuf);
 
-		void Present(uint32_t ImageIndex);
+		// Moves on to the next frame slot. Returns false if the swapchain is out
+		// of date or suboptimal and should be recreated.
+		bool Present(uint32_t ImageIndex);
 
 		void WaitIdle();
 
+		// Call after the swapchain was recreated and the queue is idle. NumImages
+		// may be different from the old swapchain.
+		void SetSwapChain(VkSwapchainKHR SwapChain, int NumImages);
+
+		int GetFrameIndex() const { return m_frameIndex; }
+
+		int GetNumFramesInFlight() const { return (int)m_frames.size(); }
+
 	private:
 
-		void CreateSemaphores();
+		void CreateSyncObjects(int NumImages, int NumFramesInFlight);
+		void DestroySemaphores();
+
+		struct FrameSync {
+			VkSemaphore m_presentCompleteSem = VK_NULL_HANDLE;
+			VkFence m_inFlightFence = VK_NULL_HANDLE;
+		};
 
 		VkDevice m_device = VK_NULL_HANDLE;
 		VkSwapchainKHR m_swapChain = VK_NULL_HANDLE;
 		VkQueue m_queue = VK_NULL_HANDLE;
-		VkSemaphore m_renderCompleteSem;
-		VkSemaphore m_presentCompleteSem;
+		std::vector<FrameSync> m_frames;
+		std::vector<VkSemaphore> m_renderCompleteSems;	// per swapchain image
+		std::vector<VkFence> m_imageFences;				// fence of the last frame that used the image
+		int m_frameIndex = 0;
+		uint32_t m_imageIndex = 0;
+		uint32_t m_nextHeadlessImage = 0;
 	};
 
 }
\ No newline at end of file
@@ -4,6 +4,10 @@
 
 #include <vulkan/vulkan.h>
 
+#include "vulkan_allocator.h"
+#include "vulkan_texture_table.h"
+#include "texture_container.h"
+
 
 namespace Engine {
 
@@ -16,9 +20,12 @@ namespace Engine {
 		VulkanTexture(VulkanCore* pVulkanCore) { m_pVulkanCore = pVulkanCore; }
 
 		VkImage m_image = VK_NULL_HANDLE;
-		VkDeviceMemory m_mem = VK_NULL_HANDLE;
+		VulkanAllocation m_mem;
 		VkImageView m_view = VK_NULL_HANDLE;
 		VkSampler m_sampler = VK_NULL_HANDLE;
+		uint32_t m_bindlessIndex = INVALID_TEXTURE_INDEX;	// slot in the texture table of VulkanCore
+		uint32_t m_mipLevels = 1;
+		VkDeviceSize m_budgetSize = 0;		// counted in VulkanCore::GetTextureMemory() until Destroy()
 
 		void Destroy(VkDevice Device);
 
@@ -26,7 +33,14 @@ namespace Engine {
 
 		void Load(unsigned int BufferSize, void* pImageData);
 
+		// Pixels are 8 bit RGBA
+		void LoadFromPixels(int Width, int Height, const void* pPixels);
+
+		// Uses the format and the mips of the DDS/KTX2 file as is
+		void LoadFromContainer(const TextureContainer& Container);
+
 	private:
+		friend class VulkanCore;	// sets m_pVulkanCore for the memory budget
 
 		VulkanCore* m_pVulkanCore = NULL;
 
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace Engine {
+
+	class VulkanTexture;
+
+// Devices that support descriptor indexing must allow at least 500K update-after-bind sampled images
+#define MAX_BINDLESS_TEXTURES 4096
+
+#define INVALID_TEXTURE_INDEX 0xFFFFFFFF
+
+	// A single descriptor set with one large array of combined image samplers
+	// that is shared by all the models (descriptor indexing). New textures take
+	// a slot that was freed by a destroyed texture or are appended to the array -
+	// the set is never reallocated and the slots that are written later can be
+	// used by command buffers that were already recorded. A slot is freed when its
+	// texture is destroyed so it must no longer be used by the GPU at that point.
+	// The shaders index the array using the material data.
+	class VulkanTextureTable {
+	public:
+		VulkanTextureTable() {}
+
+		void Init(VkDevice Device, uint32_t MaxTextures = MAX_BINDLESS_TEXTURES);
+
+		void Destroy();
+
+		// Returns the slot of the texture in the array. The slot is also stored in the texture.
+		uint32_t Add(VulkanTexture& Tex);
+
+		// The slot is reused by a later Add()
+		void Remove(uint32_t Index);
+
+		VkDescriptorSetLayout GetLayout() const { return m_layout; }
+
+		VkDescriptorSet GetDescriptorSet() const { return m_descriptorSet; }
+
+		// Including the free slots
+		uint32_t GetNumTextures() const { return m_numTextures; }
+
+	private:
+
+		void CreateLayout();
+		void CreateDescriptorSet();
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout m_layout = VK_NULL_HANDLE;
+		VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+		uint32_t m_maxTextures = 0;
+		uint32_t m_numTextures = 0;
+		std::vector<uint32_t> m_freeSlots;
+		std::mutex m_mutex;
+	};
+}
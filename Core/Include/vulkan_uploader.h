@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "vulkan_buffer.h"
+
+namespace Engine {
+
+	class VulkanCore;
+
+#define NUM_UPLOAD_BATCHES 2
+
+	// Batches buffer/image uploads and layout transitions into a single command
+	// buffer instead of submitting and waiting for the queue on every operation.
+	// The source data is copied into a persistently mapped staging ring. A batch is
+	// submitted (with a fence) when the ring wraps around or on Flush(), and the
+	// CPU only waits when it needs ring space that the GPU is still reading.
+	// Uploads that don't fit into the ring get a temporary staging buffer.
+	// The uploaded resources can be used only after Flush().
+	class VulkanUploader {
+	public:
+		VulkanUploader() {}
+
+		void Init(VulkanCore* pVulkanCore, VkDeviceSize RingSize);
+
+		void Destroy();
+
+		void UploadToBuffer(VkBuffer Dst, VkDeviceSize DstOffset, const void* pData, VkDeviceSize Size);
+
+		// Copies the pixels into mip level 0 and generates the levels below it with
+		// linear blits (the format must support it if MipLevels > 1). All the levels
+		// are transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL at the end.
+		void UploadToImage(VkImage Dst, VkFormat Format, uint32_t ImageWidth, uint32_t ImageHeight,
+			uint32_t MipLevels, const void* pPixels, VkDeviceSize Size);
+
+		// Copies MipLevels prebuilt levels (e.g. block compressed) from pData. The offsets
+		// in pRegions are relative to pData. Ends in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+		void UploadMipsToImage(VkImage Dst, uint32_t MipLevels, const VkBufferImageCopy* pRegions,
+			const void* pData, VkDeviceSize Size);
+
+		void TransitionImageLayout(VkImage Image, VkFormat Format, VkImageLayout OldLayout, VkImageLayout NewLayout);
+
+		// Submits the pending work and waits for all the uploads to complete
+		void Flush();
+
+		int GetNumSubmits() const { return m_numSubmits; }
+
+	private:
+
+		struct UploadBatch {
+			VkCommandBuffer m_cmdBuf = VK_NULL_HANDLE;
+			VkFence m_fence = VK_NULL_HANDLE;
+			VkDeviceSize m_ringStart = 0;
+			VkDeviceSize m_ringEnd = 0;
+			bool m_isRecording = false;
+			bool m_isInFlight = false;
+			std::vector<BufferAndMemory> m_tempBuffers;
+		};
+
+		void Stage(const void* pData, VkDeviceSize Size, VkBuffer& SrcBuffer, VkDeviceSize& SrcOffset);
+
+		VkCommandBuffer GetCommandBuffer();
+
+		void SubmitBatch();
+
+		void WaitForBatch(UploadBatch& Batch);
+
+		int GetProfilerSet(const UploadBatch& Batch) const;
+
+		VulkanCore* m_pVulkanCore = NULL;
+		VkDevice m_device = VK_NULL_HANDLE;
+		BufferAndMemory m_ring;
+		void* m_pRingMem = NULL;
+		VkDeviceSize m_ringSize = 0;
+		VkDeviceSize m_ringHead = 0;
+		UploadBatch m_batches[NUM_UPLOAD_BATCHES];
+		int m_curBatch = 0;
+		int m_numSubmits = 0;
+	};
+}
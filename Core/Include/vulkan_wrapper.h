@@ -11,12 +11,18 @@ namespace Engine {
 
 	VkSemaphore CreateSemaphore(VkDevice Device);
 
+	VkFence CreateFence(VkDevice Device, bool Signaled);
+
+	// The pipelines use dynamic viewport and scissor - call this after binding the pipeline
+	void SetViewportAndScissor(VkCommandBuffer CmdBuf, uint32_t Width, uint32_t Height);
+
 	void ImageMemBarrier(VkCommandBuffer CmdBuf, VkImage Image, VkFormat Format,
 		VkImageLayout OldLayout, VkImageLayout NewLayout);
 
 	VkImageView CreateImageView(VkDevice Device, VkImage Image, VkFormat Format,
-		VkImageAspectFlags AspectFlags);
+		VkImageAspectFlags AspectFlags, uint32_t MipLevels = 1);
 
+	// Samples all the MipLevels of the image. Anisotropic filtering is enabled if MaxAnisotropy > 1.
 	VkSampler CreateTextureSampler(VkDevice Device, VkFilter MinFilter, VkFilter MaxFilter,
-		VkSamplerAddressMode AddressMode);
+		VkSamplerAddressMode AddressMode, uint32_t MipLevels = 1, float MaxAnisotropy = 1.0f);
 }
\ No newline at end of file
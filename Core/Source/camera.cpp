@@ -64,6 +64,13 @@ void Camera::SetUp(const glm::vec3& up)
 {
 }
 
+void Camera::SetViewportSize(unsigned int width, unsigned int height)
+{
+    m_projInfo.Width = width;
+    m_projInfo.Height = height;
+    updateProjectionMatrix();
+}
+
 
 void Camera::SetMousePos(float x, float y) {
     m_currentMousePos = { x, y };
@@ -3,15 +3,35 @@
 #include "core_model.h"
 #include "util.h"
 #include "meshoptimizer.h"
+#include "thread_pool.h"
+#include "cpu_profiler.h"
 #include <algorithm>
+#include <string.h>
 
 using namespace std;
 
 // config flags
 static bool UseMeshOptimizer = false;
+static bool UseMeshCache = true;
+static bool UseParallelMeshImport = true;
 
 #define MAX_BONES 100
 
+// Upper limit for meshopt_simplify, relative to the size of the submesh. The LOD
+// selection decides when an error is small enough so this only prevents the
+// coarsest levels from collapsing the shape completely.
+#define LOD_MAX_SIMPLIFY_ERROR 0.1f
+
+// Limits of meshopt_buildMeshlets. 64/124 are the values recommended by meshoptimizer.
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// Trades vertex reuse inside a meshlet for tighter normal cones
+#define MESHLET_CONE_WEIGHT 0.25f
+
+// A LOD that doesn't remove at least this fraction of the previous level ends the chain
+#define LOD_MIN_REDUCTION 0.1f
+
 #define DEMOLITION_ASSIMP_LOAD_FLAGS (aiProcess_JoinIdenticalVertices | \
                                       aiProcess_Triangulate | \
                                       aiProcess_GenSmoothNormals | \
@@ -51,11 +71,30 @@ static inline float ToDegree(float radians)
     return radians * 180.0f / 3.1415926535f;
 }
 
+// Everything that changes the imported data must go in here so that
+// a cache created with different options is rejected
+static uint32_t GetMeshCacheImportFlags()
+{
+    uint32_t Flags = DEMOLITION_ASSIMP_LOAD_FLAGS & 0x7FFFFFFF;
+
+    if (UseMeshOptimizer) {
+        Flags |= 0x80000000;
+    }
+
+    return Flags;
+}
+
 
 bool CoreModel::LoadAssimpModel(const string& Filename)
 {
+    PROFILE_ZONE("LoadAssimpModel");
+
     AllocBuffers();
 
+    if (UseMeshCache && LoadFromMeshCache(Filename)) {
+        return true;
+    }
+
     bool Ret = false;
 
     m_pScene = m_Importer.ReadFile(Filename.c_str(), DEMOLITION_ASSIMP_LOAD_FLAGS);
@@ -77,14 +116,15 @@ bool CoreModel::LoadAssimpModel(const string& Filename)
 
 bool CoreModel::InitFromScene(const aiScene* pScene, const string& Filename)
 {
-    if (!InitGeometry(pScene, Filename)) {
-        return false;
-    }
-
+    // Cameras and lights first so that they are ready when the mesh cache is written
     InitCameras(pScene);
 
     InitLights(pScene);
 
+    if (!InitGeometry(pScene, Filename)) {
+        return false;
+    }
+
     return true;
 }
 
@@ -94,6 +134,7 @@ bool CoreModel::InitGeometry(const aiScene* pScene, const string& Filename)
     printf("\n*** Initializing geometry ***\n");
     m_Meshes.resize(pScene->mNumMeshes);
     m_Materials.resize(pScene->mNumMaterials);
+    m_texturePaths.resize(pScene->mNumMaterials);
 
     unsigned int NumVertices = 0;
     unsigned int NumIndices = 0;
@@ -102,22 +143,33 @@ bool CoreModel::InitGeometry(const aiScene* pScene, const string& Filename)
 
     printf("Num animations %d\n", pScene->mNumAnimations);
 
+    // Start decoding the textures in the background before importing the meshes
+    if (!InitMaterials(pScene, Filename)) {
+        return false;
+    }
+
+    // Needed by the bounds of the submeshes
+    CalculateMeshTransformations(pScene);
+
+    // Static vertices are kept around until the mesh cache is written
+    std::vector<Vertex> Vertices;
+
     if (pScene->mNumAnimations > 0) {
-        std::vector<SkinnedVertex> Vertices;
-        InitGeometryInternal<SkinnedVertex>(Vertices, NumVertices, NumIndices);
-        PopulateBuffersSkinned(Vertices);
+        std::vector<SkinnedVertex> SkinnedVertices;
+        InitGeometryInternal<SkinnedVertex>(SkinnedVertices, NumVertices, NumIndices);
+        PopulateBuffersSkinned(SkinnedVertices);
     }
     else {
-        std::vector<Vertex> Vertices;
         InitGeometryInternal<Vertex>(Vertices, NumVertices, NumIndices);
         PopulateBuffers(Vertices);
     }
 
-    if (!InitMaterials(pScene, Filename)) {
-        return false;
-    }
+    m_textureLoader.Finish();
 
-    CalculateMeshTransformations(pScene);
+    // Skinned models need the Assimp scene for the animations so they are never cached
+    if (UseMeshCache && (pScene->mNumAnimations == 0)) {
+        SaveToMeshCache(Filename, Vertices);
+    }
 
     InitGeometryPost();
 
@@ -132,6 +184,12 @@ void CoreModel::InitGeometryInternal(std::vector<VertexType>& Vertices, int NumV
 
     InitAllMeshes<VertexType>(m_pScene, Vertices);
 
+    BuildMeshlets<VertexType>(Vertices);
+
+    GenerateLODs<VertexType>(Vertices);
+
+    CalculateMeshBounds<VertexType>(Vertices);
+
     printf("Min pos: %s\n", glm::to_string(m_minPos).c_str());
     printf("Max pos: %s\n", glm::to_string(m_maxPos).c_str());
 }
@@ -182,14 +240,83 @@ void CoreModel::ReserveSpace(std::vector<VertexType>& Vertices, unsigned int Num
 template<typename VertexType>
 void CoreModel::InitAllMeshes(const aiScene* pScene, std::vector<VertexType>& Vertices)
 {
+    // The bones are shared by all the meshes so skinned models are imported serially
+    if constexpr (std::is_same_v<VertexType, Vertex>) {
+        if (UseParallelMeshImport) {
+            InitAllMeshesParallel(pScene, Vertices);
+            return;
+        }
+    }
+
+    size_t NumSourceIndices = 0;
+
     for (unsigned int i = 0; i < m_Meshes.size(); i++) {
         const aiMesh* paiMesh = pScene->mMeshes[i];
         if (UseMeshOptimizer) {
-            InitSingleMeshOpt<VertexType>(Vertices, i, paiMesh);
+            InitSingleMeshOpt<VertexType>(Vertices, m_Indices, m_minPos, m_maxPos, i, paiMesh);
+            NumSourceIndices += paiMesh->mNumFaces * 3;
+        }
+        else {
+            InitSingleMesh<VertexType>(Vertices, m_Indices, m_minPos, m_maxPos, i, paiMesh);
+        }
+    }
+
+    if (UseMeshOptimizer) {
+        printf("Num indices %d\n", (int)NumSourceIndices);
+        printf("Optimized number of indices %d\n", (int)m_Indices.size());
+    }
+}
+
+
+void CoreModel::InitAllMeshesParallel(const aiScene* pScene, std::vector<Vertex>& Vertices)
+{
+    struct MeshImportData {
+        std::vector<Vertex> Vertices;
+        std::vector<unsigned int> Indices;
+        glm::vec3 MinPos = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+        glm::vec3 MaxPos = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        size_t NumSourceIndices = 0;    // before OptimizeMesh()
+    };
+
+    int NumMeshes = (int)m_Meshes.size();
+
+    std::vector<MeshImportData> MeshData(NumMeshes);
+
+    // Each job only touches its own MeshImportData and m_Meshes entry
+    ThreadPool::Get().ParallelFor(NumMeshes, [&](int i) {
+        MeshImportData& Data = MeshData[i];
+        const aiMesh* paiMesh = pScene->mMeshes[i];
+
+        if (UseMeshOptimizer) {
+            InitSingleMeshOpt<Vertex>(Data.Vertices, Data.Indices, Data.MinPos, Data.MaxPos, i, paiMesh);
+            Data.NumSourceIndices = paiMesh->mNumFaces * 3;
         }
         else {
-            InitSingleMesh<VertexType>(Vertices, i, paiMesh);
+            InitSingleMesh<Vertex>(Data.Vertices, Data.Indices, Data.MinPos, Data.MaxPos, i, paiMesh);
         }
+    });
+
+    size_t NumSourceIndices = 0;
+
+    // Concatenate in mesh order so that the result is identical to the serial import
+    for (int i = 0; i < NumMeshes; i++) {
+        const MeshImportData& Data = MeshData[i];
+
+        NumSourceIndices += Data.NumSourceIndices;
+
+        m_Meshes[i].BaseVertex = (unsigned int)Vertices.size();
+        m_Meshes[i].BaseIndex = (unsigned int)m_Indices.size();
+
+        Vertices.insert(Vertices.end(), Data.Vertices.begin(), Data.Vertices.end());
+        m_Indices.insert(m_Indices.end(), Data.Indices.begin(), Data.Indices.end());
+
+        m_minPos = glm::min(m_minPos, Data.MinPos);
+        m_maxPos = glm::max(m_maxPos, Data.MaxPos);
+    }
+
+    if (UseMeshOptimizer) {
+        printf("Num indices %d\n", (int)NumSourceIndices);
+        printf("Optimized number of indices %d\n", (int)m_Indices.size());
     }
 }
 
@@ -204,6 +331,328 @@ void CoreModel::CalculateMeshTransformations(const aiScene* pScene)
 }
 
 
+template<typename VertexType>
+void CoreModel::CalculateMeshBounds(const std::vector<VertexType>& Vertices)
+{
+    for (BasicMeshEntry& Mesh : m_Meshes) {
+        glm::vec3 MinPos = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+        glm::vec3 MaxPos = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+        // Only the vertices that are actually referenced by the indices
+        for (unsigned int i = 0; i < Mesh.NumIndices; i++) {
+            const VertexType& v = Vertices[Mesh.BaseVertex + m_Indices[Mesh.BaseIndex + i]];
+            glm::vec3 Pos = glm::vec3(Mesh.Transformation * glm::vec4(v.Position, 1.0f));
+            MinPos = glm::min(MinPos, Pos);
+            MaxPos = glm::max(MaxPos, Pos);
+        }
+
+        if (Mesh.NumIndices == 0) {
+            MinPos = MaxPos = glm::vec3(0.0f);
+        }
+
+        glm::vec3 Center = (MinPos + MaxPos) * 0.5f;
+        float RadiusSq = 0.0f;
+
+        for (unsigned int i = 0; i < Mesh.NumIndices; i++) {
+            const VertexType& v = Vertices[Mesh.BaseVertex + m_Indices[Mesh.BaseIndex + i]];
+            glm::vec3 Pos = glm::vec3(Mesh.Transformation * glm::vec4(v.Position, 1.0f));
+            glm::vec3 d = Pos - Center;
+            RadiusSq = std::max(RadiusSq, glm::dot(d, d));
+        }
+
+        Mesh.MinPos = MinPos;
+        Mesh.MaxPos = MaxPos;
+        Mesh.BoundingSphere = glm::vec4(Center, sqrtf(RadiusSq));
+    }
+}
+
+
+// Largest scale factor of the 3x3 part
+static float GetMaxScale(const glm::mat4& m)
+{
+    float ScaleX = glm::length(glm::vec3(m[0]));
+    float ScaleY = glm::length(glm::vec3(m[1]));
+    float ScaleZ = glm::length(glm::vec3(m[2]));
+
+    return std::max(std::max(ScaleX, ScaleY), ScaleZ);
+}
+
+
+// True if the 3x3 part scales all the axes by the same amount
+static bool IsUniformScale(const glm::mat4& m)
+{
+    float ScaleX = glm::length(glm::vec3(m[0]));
+    float ScaleY = glm::length(glm::vec3(m[1]));
+    float ScaleZ = glm::length(glm::vec3(m[2]));
+
+    float MaxScale = std::max(std::max(ScaleX, ScaleY), ScaleZ);
+    float MinScale = std::min(std::min(ScaleX, ScaleY), ScaleZ);
+
+    return (MaxScale - MinScale) <= MaxScale * 0.001f;
+}
+
+
+template<typename VertexType>
+void CoreModel::BuildMeshlets(const std::vector<VertexType>& Vertices)
+{
+    int NumMeshes = (int)m_Meshes.size();
+
+    std::vector<std::vector<Meshlet>> MeshletsPerMesh(NumMeshes);
+    std::vector<std::vector<unsigned int>> IndicesPerMesh(NumMeshes);
+
+    // Each job only reads the shared arrays and writes its own meshlets and indices
+    ThreadPool::Get().ParallelFor(NumMeshes, [&](int MeshIndex) {
+        const BasicMeshEntry& Mesh = m_Meshes[MeshIndex];
+
+        if (Mesh.NumIndices == 0) {
+            return;
+        }
+
+        const unsigned int* pIndices = &m_Indices[Mesh.BaseIndex];
+
+        unsigned int NumVertices = 0;
+
+        for (unsigned int i = 0; i < Mesh.NumIndices; i++) {
+            NumVertices = std::max(NumVertices, pIndices[i] + 1);
+        }
+
+        const float* pPositions = &Vertices[Mesh.BaseVertex].Position.x;
+
+        size_t MaxMeshlets = meshopt_buildMeshletsBound(Mesh.NumIndices, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+
+        std::vector<meshopt_Meshlet> OptMeshlets(MaxMeshlets);
+        std::vector<unsigned int> MeshletVertices(MaxMeshlets * MESHLET_MAX_VERTICES);
+        std::vector<unsigned char> MeshletTriangles(MaxMeshlets * MESHLET_MAX_TRIANGLES * 3);
+
+        size_t NumMeshlets = meshopt_buildMeshlets(OptMeshlets.data(), MeshletVertices.data(), MeshletTriangles.data(),
+            pIndices, Mesh.NumIndices, pPositions, NumVertices, sizeof(VertexType),
+            MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, MESHLET_CONE_WEIGHT);
+
+        // The bounds are moved to the space of the whole model. A normal cone
+        // doesn't survive a non-uniform scale so it is disabled in that case.
+        float MaxScale = GetMaxScale(Mesh.Transformation);
+        bool UseCone = IsUniformScale(Mesh.Transformation);
+        glm::mat3 Rotation = glm::mat3(Mesh.Transformation);
+
+        std::vector<Meshlet>& Meshlets = MeshletsPerMesh[MeshIndex];
+        Meshlets.resize(NumMeshlets);
+
+        // A copy of the indices in meshlet order - the original range keeps the vertex cache
+        // and overdraw order of OptimizeMesh() for the draws of the whole submesh.
+        // The base indices are relative to the copy until it is appended below.
+        std::vector<unsigned int>& MeshletIndices = IndicesPerMesh[MeshIndex];
+        MeshletIndices.reserve(Mesh.NumIndices);
+
+        for (size_t i = 0; i < NumMeshlets; i++) {
+            const meshopt_Meshlet& m = OptMeshlets[i];
+
+            meshopt_Bounds Bounds = meshopt_computeMeshletBounds(&MeshletVertices[m.vertex_offset],
+                &MeshletTriangles[m.triangle_offset], m.triangle_count, pPositions, NumVertices, sizeof(VertexType));
+
+            Meshlet& Dst = Meshlets[i];
+            Dst.BaseIndex = (unsigned int)MeshletIndices.size();
+            Dst.NumIndices = m.triangle_count * 3;
+
+            for (unsigned int j = 0; j < Dst.NumIndices; j++) {
+                MeshletIndices.push_back(MeshletVertices[m.vertex_offset + MeshletTriangles[m.triangle_offset + j]]);
+            }
+
+            glm::vec4 Center = Mesh.Transformation * glm::vec4(Bounds.center[0], Bounds.center[1], Bounds.center[2], 1.0f);
+            Dst.BoundingSphere = glm::vec4(glm::vec3(Center), Bounds.radius * MaxScale);
+
+            if (UseCone && (Bounds.cone_cutoff < 1.0f)) {
+                Dst.ConeAxis = glm::normalize(Rotation * glm::vec3(Bounds.cone_axis[0], Bounds.cone_axis[1], Bounds.cone_axis[2]));
+                Dst.ConeCutoff = Bounds.cone_cutoff;
+            }
+        }
+    });
+
+    // The copies go after all the original indices so the existing ranges don't move
+    m_meshlets.clear();
+
+    for (int MeshIndex = 0; MeshIndex < NumMeshes; MeshIndex++) {
+        unsigned int BaseIndex = (unsigned int)m_Indices.size();
+        m_Indices.insert(m_Indices.end(), IndicesPerMesh[MeshIndex].begin(), IndicesPerMesh[MeshIndex].end());
+
+        for (Meshlet& m : MeshletsPerMesh[MeshIndex]) {
+            m.BaseIndex += BaseIndex;
+        }
+
+        m_Meshes[MeshIndex].BaseMeshlet = (unsigned int)m_meshlets.size();
+        m_Meshes[MeshIndex].NumMeshlets = (unsigned int)MeshletsPerMesh[MeshIndex].size();
+        m_meshlets.insert(m_meshlets.end(), MeshletsPerMesh[MeshIndex].begin(), MeshletsPerMesh[MeshIndex].end());
+    }
+
+    printf("%d meshlets\n", (int)m_meshlets.size());
+}
+
+
+template<typename VertexType>
+void CoreModel::GenerateLODs(const std::vector<VertexType>& Vertices)
+{
+    int NumMeshes = (int)m_Meshes.size();
+    int NumLODs = std::min((int)m_lodRatios.size() + 1, MAX_MESH_LODS);
+
+    for (BasicMeshEntry& Mesh : m_Meshes) {
+        Mesh.NumLODs = 1;
+        Mesh.LODs[0].BaseIndex = Mesh.BaseIndex;
+        Mesh.LODs[0].NumIndices = Mesh.NumIndices;
+        Mesh.LODs[0].Error = 0.0f;
+    }
+
+    if (NumLODs == 1) {
+        return;
+    }
+
+    struct MeshLODData {
+        std::vector<unsigned int> Indices[MAX_MESH_LODS];
+        float Error[MAX_MESH_LODS] = {};
+        int NumLODs = 1;
+    };
+
+    std::vector<MeshLODData> LODData(NumMeshes);
+
+    // Each job only reads the shared arrays and writes its own MeshLODData
+    ThreadPool::Get().ParallelFor(NumMeshes, [&](int MeshIndex) {
+        const BasicMeshEntry& Mesh = m_Meshes[MeshIndex];
+        MeshLODData& Data = LODData[MeshIndex];
+
+        if (Mesh.NumIndices == 0) {
+            return;
+        }
+
+        const unsigned int* pIndices = &m_Indices[Mesh.BaseIndex];
+
+        unsigned int NumVertices = 0;
+
+        for (unsigned int i = 0; i < Mesh.NumIndices; i++) {
+            NumVertices = std::max(NumVertices, pIndices[i] + 1);
+        }
+
+        const float* pPositions = &Vertices[Mesh.BaseVertex].Position.x;
+
+        // meshopt_simplify reports the error relative to the size of the submesh
+        // and the submesh is scaled by its node transformation
+        float ErrorScale = meshopt_simplifyScale(pPositions, NumVertices, sizeof(VertexType)) *
+                           GetMaxScale(Mesh.Transformation);
+
+        size_t PrevNumIndices = Mesh.NumIndices;
+
+        for (int Level = 1; Level < NumLODs; Level++) {
+            // Always simplify the original so that the error is measured against it
+            size_t TargetIndexCount = (size_t)(Mesh.NumIndices * m_lodRatios[Level - 1]) / 3 * 3;
+
+            std::vector<unsigned int>& Indices = Data.Indices[Level];
+            Indices.resize(Mesh.NumIndices);
+
+            float Error = 0.0f;
+            size_t NumIndices = meshopt_simplify(Indices.data(), pIndices, Mesh.NumIndices, pPositions, NumVertices,
+                sizeof(VertexType), TargetIndexCount, LOD_MAX_SIMPLIFY_ERROR, 0, &Error);
+
+            if ((NumIndices == 0) || (NumIndices > (size_t)(PrevNumIndices * (1.0f - LOD_MIN_REDUCTION)))) {
+                Indices.clear();
+                break;
+            }
+
+            Indices.resize(NumIndices);
+            Data.Error[Level] = std::max(Error * ErrorScale, Data.Error[Level - 1]);
+            Data.NumLODs = Level + 1;
+            PrevNumIndices = NumIndices;
+        }
+    });
+
+    // The LODs go after all the original indices so the existing ranges don't move
+    std::vector<size_t> NumTrianglesPerLevel(NumLODs, 0);
+
+    for (int MeshIndex = 0; MeshIndex < NumMeshes; MeshIndex++) {
+        BasicMeshEntry& Mesh = m_Meshes[MeshIndex];
+        MeshLODData& Data = LODData[MeshIndex];
+
+        NumTrianglesPerLevel[0] += Mesh.NumIndices / 3;
+
+        for (int Level = 1; Level < Data.NumLODs; Level++) {
+            Mesh.LODs[Level].BaseIndex = (unsigned int)m_Indices.size();
+            Mesh.LODs[Level].NumIndices = (unsigned int)Data.Indices[Level].size();
+            Mesh.LODs[Level].Error = Data.Error[Level];
+
+            m_Indices.insert(m_Indices.end(), Data.Indices[Level].begin(), Data.Indices[Level].end());
+
+            NumTrianglesPerLevel[Level] += Mesh.LODs[Level].NumIndices / 3;
+        }
+
+        Mesh.NumLODs = Data.NumLODs;
+    }
+
+    for (int Level = 0; Level < NumLODs; Level++) {
+        printf("LOD %d: %d triangles\n", Level, (int)NumTrianglesPerLevel[Level]);
+    }
+}
+
+
+uint32_t CoreModel::GetLODConfig() const
+{
+    // FNV-1a over the ratios
+    uint32_t Hash = 2166136261u;
+
+    for (float Ratio : m_lodRatios) {
+        uint32_t Bits = 0;
+        memcpy(&Bits, &Ratio, sizeof(Bits));
+        Hash = (Hash ^ Bits) * 16777619u;
+    }
+
+    return Hash;
+}
+
+
+void CoreModel::PackVertices(const std::vector<Vertex>& Vertices, std::vector<PackedVertex>& PackedVertices,
+                             std::vector<glm::mat4>& Dequantize) const
+{
+    PackedVertices.resize(Vertices.size());
+    Dequantize.resize(m_Meshes.size());
+
+    VertexQuantizationError Error;
+
+    for (size_t MeshIndex = 0; MeshIndex < m_Meshes.size(); MeshIndex++) {
+        const BasicMeshEntry& Mesh = m_Meshes[MeshIndex];
+
+        // The vertices of the submesh are the ones its indices reference
+        unsigned int NumVertices = 0;
+
+        for (unsigned int i = 0; i < Mesh.NumIndices; i++) {
+            NumVertices = std::max(NumVertices, m_Indices[Mesh.BaseIndex + i] + 1);
+        }
+
+        if (NumVertices == 0) {
+            Dequantize[MeshIndex] = glm::mat4(1.0f);
+            continue;
+        }
+
+        // The positions are quantized in the space of the submesh (before Mesh.Transformation)
+        glm::vec3 MinPos = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+        glm::vec3 MaxPos = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+        for (unsigned int i = Mesh.BaseVertex; i < Mesh.BaseVertex + NumVertices; i++) {
+            MinPos = glm::min(MinPos, Vertices[i].Position);
+            MaxPos = glm::max(MaxPos, Vertices[i].Position);
+        }
+
+        PositionQuantizer Quantizer(MinPos, MaxPos);
+        Dequantize[MeshIndex] = Quantizer.GetDequantizeMatrix();
+
+        for (unsigned int i = Mesh.BaseVertex; i < Mesh.BaseVertex + NumVertices; i++) {
+            const Vertex& v = Vertices[i];
+            PackedVertices[i] = PackVertex(Quantizer, v.Position, v.TexCoords, v.Normal, v.Tangent, v.Bitangent);
+            Error.Add(Quantizer, PackedVertices[i], v.Position, v.TexCoords, v.Normal, v.Tangent);
+        }
+    }
+
+    printf("Packed %d vertices: %d bytes instead of %d\n", (int)Vertices.size(),
+           (int)(Vertices.size() * sizeof(PackedVertex)), (int)(Vertices.size() * sizeof(Vertex)));
+
+    Error.Print();
+}
+
+
 void CoreModel::TraverseNodeHierarchy(glm::mat4 ParentTransformation, aiNode* pNode)
 {
     printf("Traversing node '%s'\n", pNode->mName.C_Str());
@@ -232,7 +681,8 @@ void CoreModel::TraverseNodeHierarchy(glm::mat4 ParentTransformation, aiNode* pN
 
 
 template<typename VertexType>
-void CoreModel::InitSingleMesh(vector<VertexType>& Vertices, unsigned int MeshIndex, const aiMesh* paiMesh)
+void CoreModel::InitSingleMesh(vector<VertexType>& Vertices, vector<unsigned int>& Indices, glm::vec3& MinPos, glm::vec3& MaxPos,
+                               unsigned int MeshIndex, const aiMesh* paiMesh)
 {
     const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
 
@@ -244,13 +694,13 @@ void CoreModel::InitSingleMesh(vector<VertexType>& Vertices, unsigned int MeshIn
         const aiVector3D& Pos = paiMesh->mVertices[i];
         v.Position = glm::vec3(Pos.x, Pos.y, Pos.z);
 
-        m_minPos.x = std::min(m_minPos.x, v.Position.x);
-        m_minPos.y = std::min(m_minPos.y, v.Position.y);
-        m_minPos.z = std::min(m_minPos.z, v.Position.z);
+        MinPos.x = std::min(MinPos.x, v.Position.x);
+        MinPos.y = std::min(MinPos.y, v.Position.y);
+        MinPos.z = std::min(MinPos.z, v.Position.z);
 
-        m_maxPos.x = std::max(m_maxPos.x, v.Position.x);
-        m_maxPos.y = std::max(m_maxPos.y, v.Position.y);
-        m_maxPos.z = std::max(m_maxPos.z, v.Position.z);
+        MaxPos.x = std::max(MaxPos.x, v.Position.x);
+        MaxPos.y = std::max(MaxPos.y, v.Position.y);
+        MaxPos.z = std::max(MaxPos.z, v.Position.z);
 
         if (paiMesh->mNormals) {
             const aiVector3D& pNormal = paiMesh->mNormals[i];
@@ -296,9 +746,9 @@ void CoreModel::InitSingleMesh(vector<VertexType>& Vertices, unsigned int MeshIn
         /*   printf("%d: %d\n", i * 3, Face.mIndices[0]);
            printf("%d: %d\n", i * 3 + 1, Face.mIndices[1]);
            printf("%d: %d\n", i * 3 + 2, Face.mIndices[2]);*/
-        m_Indices.push_back(Face.mIndices[0]);
-        m_Indices.push_back(Face.mIndices[1]);
-        m_Indices.push_back(Face.mIndices[2]);
+        Indices.push_back(Face.mIndices[0]);
+        Indices.push_back(Face.mIndices[1]);
+        Indices.push_back(Face.mIndices[2]);
     }
 
     if constexpr (std::is_same_v<VertexType, SkinnedVertex>) {
@@ -308,7 +758,8 @@ void CoreModel::InitSingleMesh(vector<VertexType>& Vertices, unsigned int MeshIn
 
 
 template<typename VertexType>
-void CoreModel::InitSingleMeshOpt(vector<VertexType>& AllVertices, unsigned int MeshIndex, const aiMesh* paiMesh)
+void CoreModel::InitSingleMeshOpt(vector<VertexType>& AllVertices, vector<unsigned int>& AllIndices, glm::vec3& MinPos, glm::vec3& MaxPos,
+                                  unsigned int MeshIndex, const aiMesh* paiMesh)
 {
     const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
 
@@ -323,12 +774,12 @@ void CoreModel::InitSingleMeshOpt(vector<VertexType>& AllVertices, unsigned int
         // printf("%d: ", i); glm::vec3 v(pPos.x, pPos.y, pPos.z); v.Print();
         v.Position = glm::vec3(Pos.x, Pos.y, Pos.z);
 
-        m_minPos.x = std::min(m_minPos.x, v.Position.x);
-        m_minPos.y = std::min(m_minPos.y, v.Position.y);
-        m_minPos.z = std::min(m_minPos.z, v.Position.z);
-        m_maxPos.x = std::max(m_maxPos.x, v.Position.x);
-        m_maxPos.y = std::max(m_maxPos.y, v.Position.y);
-        m_maxPos.z = std::max(m_maxPos.z, v.Position.z);
+        MinPos.x = std::min(MinPos.x, v.Position.x);
+        MinPos.y = std::min(MinPos.y, v.Position.y);
+        MinPos.z = std::min(MinPos.z, v.Position.z);
+        MaxPos.x = std::max(MaxPos.x, v.Position.x);
+        MaxPos.y = std::max(MaxPos.y, v.Position.y);
+        MaxPos.z = std::max(MaxPos.z, v.Position.z);
 
         if (paiMesh->mNormals) {
             const aiVector3D& pNormal = paiMesh->mNormals[i];
@@ -358,7 +809,7 @@ void CoreModel::InitSingleMeshOpt(vector<VertexType>& AllVertices, unsigned int
     }
 
     m_Meshes[MeshIndex].BaseVertex = (unsigned int)AllVertices.size();
-    m_Meshes[MeshIndex].BaseIndex = (unsigned int)m_Indices.size();
+    m_Meshes[MeshIndex].BaseIndex = (unsigned int)AllIndices.size();
 
     int NumIndices = paiMesh->mNumFaces * 3;
 
@@ -383,13 +834,16 @@ void CoreModel::InitSingleMeshOpt(vector<VertexType>& AllVertices, unsigned int
         LoadMeshBones(Vertices, MeshIndex, paiMesh);
     }
 
-    OptimizeMesh(MeshIndex, Indices, Vertices, AllVertices);
+    OptimizeMesh(MeshIndex, Indices, Vertices, AllIndices, AllVertices);
 }
 
 
 template<typename VertexType>
-void CoreModel::OptimizeMesh(int MeshIndex, std::vector<unsigned int>& Indices, std::vector<VertexType>& Vertices, std::vector<VertexType>& AllVertices)
+void CoreModel::OptimizeMesh(int MeshIndex, std::vector<unsigned int>& Indices, std::vector<VertexType>& Vertices,
+                             std::vector<unsigned int>& AllIndices, std::vector<VertexType>& AllVertices)
 {
+    PROFILE_ZONE("OptimizeMesh");
+
     size_t NumIndices = Indices.size();
     size_t NumVertices = Vertices.size();
 
@@ -430,17 +884,11 @@ void CoreModel::OptimizeMesh(int MeshIndex, std::vector<unsigned int>& Indices,
     size_t OptIndexCount = meshopt_simplify(SimplifiedIndices.data(), OptIndices.data(), NumIndices,
         &OptVertices[0].Position.x, OptVertexCount, sizeof(VertexType), TargetIndexCount, TargetError);
 
-    static int num_indices = 0;
-    num_indices += (int)NumIndices;
-    static int opt_indices = 0;
-    opt_indices += (int)OptIndexCount;
-    printf("Num indices %d\n", num_indices);
-    //printf("Target num indices %d\n", TargetIndexCount);
-    printf("Optimized number of indices %d\n", opt_indices);
+    // The totals are printed by the caller - meshes may be optimized in parallel
     SimplifiedIndices.resize(OptIndexCount);
 
     // Concatenate the local arrays into the class attributes arrays
-    m_Indices.insert(m_Indices.end(), SimplifiedIndices.begin(), SimplifiedIndices.end());
+    AllIndices.insert(AllIndices.end(), SimplifiedIndices.begin(), SimplifiedIndices.end());
 
     AllVertices.insert(AllVertices.end(), OptVertices.begin(), OptVertices.end());
 
@@ -567,22 +1015,44 @@ void CoreModel::LoadDiffuseTexture(const string& Dir, const aiMaterial* pMateria
     else {
         printf("Warning! no diffuse texture\n");
 
-        if (!s_pMissingTexture) {
-            printf("Loading default texture\n");
-            s_pMissingTexture = AllocTexture2D();
+        m_Materials[MaterialIndex].pDiffuse = GetMissingTexture();
+    }
+}
 
-            s_pMissingTexture->Load("../Assets/Textures/no_texture.png");
-        }
 
-        m_Materials[MaterialIndex].pDiffuse = s_pMissingTexture;
+Texture* CoreModel::RequestTexture(const string& FullPath)
+{
+    Texture* pTexture = m_textureLoader.Find(FullPath);
+
+    if (!pTexture) {
+        pTexture = AllocTexture2D();
+        m_textures.push_back(pTexture);
+        m_textureLoader.Request(FullPath, pTexture);
     }
+
+    return pTexture;
+}
+
+
+Texture* CoreModel::GetMissingTexture()
+{
+    if (!s_pMissingTexture) {
+        printf("Loading default texture\n");
+        s_pMissingTexture = AllocTexture2D();
+
+        s_pMissingTexture->Load("../Assets/Textures/no_texture.png");
+    }
+
+    return s_pMissingTexture;
 }
 
 
 void CoreModel::LoadDiffuseTextureEmbedded(const aiTexture* paiTexture, int MaterialIndex)
 {
     printf("Embeddeded diffuse texture type '%s'\n", paiTexture->achFormatHint);
+    m_meshCacheable = false;
     m_Materials[MaterialIndex].pDiffuse = AllocTexture2D();
+    m_textures.push_back(m_Materials[MaterialIndex].pDiffuse);
     int buffer_size = paiTexture->mWidth;   // TODO: just the width???
     m_Materials[MaterialIndex].pDiffuse->Load(buffer_size, paiTexture->pcData);
 }
@@ -604,10 +1074,9 @@ void CoreModel::LoadDiffuseTextureFromFile(const string& Dir, const aiString& Pa
 
     string FullPath = Dir + "/" + p;
 
-    m_Materials[MaterialIndex].pDiffuse = AllocTexture2D();
-
-    m_Materials[MaterialIndex].pDiffuse->Load(FullPath.c_str());
-    printf("Loaded diffuse texture '%s' at index %d\n", FullPath.c_str(), MaterialIndex);
+    m_Materials[MaterialIndex].pDiffuse = RequestTexture(FullPath);
+    m_texturePaths[MaterialIndex].Diffuse = FullPath;
+    printf("Requested diffuse texture '%s' at index %d\n", FullPath.c_str(), MaterialIndex);
 }
 
 
@@ -635,7 +1104,9 @@ void CoreModel::LoadSpecularTexture(const string& Dir, const aiMaterial* pMateri
 void CoreModel::LoadSpecularTextureEmbedded(const aiTexture* paiTexture, int MaterialIndex)
 {
     printf("Embeddeded specular texture type '%s'\n", paiTexture->achFormatHint);
+    m_meshCacheable = false;
     m_Materials[MaterialIndex].pSpecularExponent = AllocTexture2D();
+    m_textures.push_back(m_Materials[MaterialIndex].pSpecularExponent);
     int buffer_size = paiTexture->mWidth;   // TODO: just the width???
     m_Materials[MaterialIndex].pSpecularExponent->Load(buffer_size, paiTexture->pcData);
 }
@@ -654,10 +1125,9 @@ void CoreModel::LoadSpecularTextureFromFile(const string& Dir, const aiString& P
 
     string FullPath = Dir + "/" + p;
 
-    m_Materials[MaterialIndex].pSpecularExponent = AllocTexture2D();
-
-    m_Materials[MaterialIndex].pSpecularExponent->Load(FullPath.c_str());
-    printf("Loaded specular texture '%s'\n", FullPath.c_str());
+    m_Materials[MaterialIndex].pSpecularExponent = RequestTexture(FullPath);
+    m_texturePaths[MaterialIndex].Specular = FullPath;
+    printf("Requested specular texture '%s'\n", FullPath.c_str());
 }
 
 
@@ -685,7 +1155,9 @@ void CoreModel::LoadNormalTexture(const string& Dir, const aiMaterial* pMaterial
 void CoreModel::LoadNormalTextureEmbedded(const aiTexture* paiTexture, int MaterialIndex)
 {
     printf("Embeddeded nroaml texture type '%s'\n", paiTexture->achFormatHint);
+    m_meshCacheable = false;
     m_Materials[MaterialIndex].pNormal = AllocTexture2D();
+    m_textures.push_back(m_Materials[MaterialIndex].pNormal);
     int buffer_size = paiTexture->mWidth;   // TODO: just the width???
     m_Materials[MaterialIndex].pNormal->Load(buffer_size, paiTexture->pcData);
 }
@@ -704,10 +1176,9 @@ void CoreModel::LoadNormalTextureFromFile(const string& Dir, const aiString& Pat
 
     string FullPath = Dir + "/" + p;
 
-    m_Materials[MaterialIndex].pNormal = AllocTexture2D();
-
-    m_Materials[MaterialIndex].pNormal->Load(FullPath.c_str());
-    printf("Loaded normal texture '%s'\n", FullPath.c_str());
+    m_Materials[MaterialIndex].pNormal = RequestTexture(FullPath);
+    m_texturePaths[MaterialIndex].Normal = FullPath;
+    printf("Requested normal texture '%s'\n", FullPath.c_str());
 }
 
 
@@ -795,6 +1266,203 @@ void CoreModel::LoadColors(const aiMaterial* pMaterial, int index)
 
 
 
+bool CoreModel::LoadFromMeshCache(const string& Filename)
+{
+    MeshCacheReader Reader;
+
+    if (!Reader.Open(Filename, sizeof(Vertex), GetMeshCacheImportFlags(), GetLODConfig())) {
+        return false;
+    }
+
+    printf("\n*** Loading '%s' from the mesh cache ***\n", Filename.c_str());
+
+    const MeshCacheHeader& Header = Reader.GetHeader();
+
+    size_t NumMeshes = 0;
+    const BasicMeshEntry* pMeshes = Reader.GetSection<BasicMeshEntry>(MESH_CACHE_SECTION_MESHES, NumMeshes);
+    m_Meshes.assign(pMeshes, pMeshes + NumMeshes);
+
+    size_t NumIndices = 0;
+    const unsigned int* pIndices = Reader.GetSection<unsigned int>(MESH_CACHE_SECTION_INDICES, NumIndices);
+    m_Indices.assign(pIndices, pIndices + NumIndices);
+
+    size_t NumMeshlets = 0;
+    const Meshlet* pMeshlets = Reader.GetSection<Meshlet>(MESH_CACHE_SECTION_MESHLETS, NumMeshlets);
+    m_meshlets.assign(pMeshlets, pMeshlets + NumMeshlets);
+
+    size_t NumMaterials = 0;
+    const MeshCacheMaterial* pMaterials = Reader.GetSection<MeshCacheMaterial>(MESH_CACHE_SECTION_MATERIALS, NumMaterials);
+    m_Materials.resize(NumMaterials);
+
+    for (size_t i = 0; i < NumMaterials; i++) {
+        const MeshCacheMaterial& CacheMaterial = pMaterials[i];
+        Material& material = m_Materials[i];
+
+        const char* pName = Reader.GetString(CacheMaterial.Name);
+        material.m_name = pName ? pName : "";
+        material.AmbientColor = CacheMaterial.AmbientColor;
+        material.DiffuseColor = CacheMaterial.DiffuseColor;
+        material.SpecularColor = CacheMaterial.SpecularColor;
+        material.m_transparencyFactor = CacheMaterial.TransparencyFactor;
+        material.m_alphaTest = CacheMaterial.AlphaTest;
+
+        material.pDiffuse = LoadCachedTexture(Reader.GetString(CacheMaterial.DiffusePath));
+
+        if (!material.pDiffuse) {
+            material.pDiffuse = GetMissingTexture();
+        }
+
+        material.pSpecularExponent = LoadCachedTexture(Reader.GetString(CacheMaterial.SpecularPath));
+        material.pNormal = LoadCachedTexture(Reader.GetString(CacheMaterial.NormalPath));
+    }
+
+    size_t NumVertices = 0;
+    const Vertex* pVertices = Reader.GetSection<Vertex>(MESH_CACHE_SECTION_VERTICES, NumVertices);
+    std::vector<Vertex> Vertices(pVertices, pVertices + NumVertices);
+
+    m_minPos = glm::vec3(Header.MinPos);
+    m_maxPos = glm::vec3(Header.MaxPos);
+
+    printf("Num meshes %d vertices %d indices %d\n", (int)NumMeshes, (int)NumVertices, (int)NumIndices);
+
+    PopulateBuffers(Vertices);
+
+    m_textureLoader.Finish();
+
+    size_t NumCameras = 0;
+    const MeshCacheCamera* pCameras = Reader.GetSection<MeshCacheCamera>(MESH_CACHE_SECTION_CAMERAS, NumCameras);
+    m_cameras.resize(NumCameras);
+
+    for (size_t i = 0; i < NumCameras; i++) {
+        m_cameras[i].Init(pCameras[i].Pos, pCameras[i].ProjInfo);
+    }
+
+    size_t NumLights = 0;
+    const DirectionalLight* pDirLights = Reader.GetSection<DirectionalLight>(MESH_CACHE_SECTION_DIR_LIGHTS, NumLights);
+    m_dirLights.assign(pDirLights, pDirLights + NumLights);
+
+    const PointLight* pPointLights = Reader.GetSection<PointLight>(MESH_CACHE_SECTION_POINT_LIGHTS, NumLights);
+    m_pointLights.assign(pPointLights, pPointLights + NumLights);
+
+    const SpotLight* pSpotLights = Reader.GetSection<SpotLight>(MESH_CACHE_SECTION_SPOT_LIGHTS, NumLights);
+    m_spotLights.assign(pSpotLights, pSpotLights + NumLights);
+
+    InitGeometryPost();
+
+    return true;
+}
+
+
+Texture* CoreModel::LoadCachedTexture(const char* pFullPath)
+{
+    if (!pFullPath) {
+        return NULL;
+    }
+
+    return RequestTexture(pFullPath);
+}
+
+
+// The material libraries referenced by an OBJ file ('mtllib' lines). Assimp
+// doesn't report the files it read besides the model itself.
+static void GetMaterialLibraries(const string& Filename, std::vector<string>& Libraries)
+{
+    string Ext = (Filename.size() >= 4) ? Filename.substr(Filename.size() - 4) : "";
+    std::transform(Ext.begin(), Ext.end(), Ext.begin(), [](unsigned char c) { return (char)tolower(c); });
+
+    if (Ext != ".obj") {
+        return;
+    }
+
+    FILE* f = fopen(Filename.c_str(), "r");
+
+    if (!f) {
+        return;
+    }
+
+    string Dir = GetDirFromFilename(Filename);
+
+    char Line[1024];
+
+    while (fgets(Line, sizeof(Line), f)) {
+        if (strncmp(Line, "mtllib", 6) != 0 || !isspace((unsigned char)Line[6])) {
+            continue;
+        }
+
+        // The rest of the line may be several names separated by spaces
+        const char* p = Line + 6;
+
+        while (*p) {
+            while (*p && isspace((unsigned char)*p)) {
+                p++;
+            }
+
+            const char* pName = p;
+
+            while (*p && !isspace((unsigned char)*p)) {
+                p++;
+            }
+
+            if (p > pName) {
+                Libraries.push_back(Dir + "/" + string(pName, p - pName));
+            }
+        }
+    }
+
+    fclose(f);
+}
+
+
+void CoreModel::SaveToMeshCache(const string& Filename, const std::vector<Vertex>& Vertices)
+{
+    if (!m_meshCacheable) {
+        printf("'%s' contains embedded textures - mesh cache not written\n", Filename.c_str());
+        return;
+    }
+
+    MeshCacheWriter Writer;
+
+    std::vector<MeshCacheMaterial> CacheMaterials(m_Materials.size());
+
+    for (unsigned int i = 0; i < m_Materials.size(); i++) {
+        const Material& material = m_Materials[i];
+        MeshCacheMaterial& CacheMaterial = CacheMaterials[i];
+
+        CacheMaterial.AmbientColor = material.AmbientColor;
+        CacheMaterial.DiffuseColor = material.DiffuseColor;
+        CacheMaterial.SpecularColor = material.SpecularColor;
+        CacheMaterial.TransparencyFactor = material.m_transparencyFactor;
+        CacheMaterial.AlphaTest = material.m_alphaTest;
+        CacheMaterial.Name = Writer.AddString(material.m_name);
+        CacheMaterial.DiffusePath = Writer.AddString(m_texturePaths[i].Diffuse);
+        CacheMaterial.SpecularPath = Writer.AddString(m_texturePaths[i].Specular);
+        CacheMaterial.NormalPath = Writer.AddString(m_texturePaths[i].Normal);
+
+        Writer.AddDependency(m_texturePaths[i].Diffuse);
+        Writer.AddDependency(m_texturePaths[i].Specular);
+        Writer.AddDependency(m_texturePaths[i].Normal);
+    }
+
+    std::vector<string> MaterialLibraries;
+    GetMaterialLibraries(Filename, MaterialLibraries);
+
+    for (const string& Library : MaterialLibraries) {
+        Writer.AddDependency(Library);
+    }
+
+    Writer.SetSection(MESH_CACHE_SECTION_VERTICES, Vertices);
+    Writer.SetSection(MESH_CACHE_SECTION_INDICES, m_Indices);
+    Writer.SetSection(MESH_CACHE_SECTION_MESHES, m_Meshes);
+    Writer.SetSection(MESH_CACHE_SECTION_MESHLETS, m_meshlets);
+    Writer.SetSection(MESH_CACHE_SECTION_MATERIALS, CacheMaterials);
+    Writer.SetSection(MESH_CACHE_SECTION_CAMERAS, m_cacheCameras);
+    Writer.SetSection(MESH_CACHE_SECTION_DIR_LIGHTS, m_dirLights);
+    Writer.SetSection(MESH_CACHE_SECTION_POINT_LIGHTS, m_pointLights);
+    Writer.SetSection(MESH_CACHE_SECTION_SPOT_LIGHTS, m_spotLights);
+
+    Writer.Write(Filename, sizeof(Vertex), GetMeshCacheImportFlags(), GetLODConfig(), m_minPos, m_maxPos);
+}
+
 
 static void traverse(int depth, aiNode* pNode)
 {
@@ -856,6 +1524,11 @@ void CoreModel::InitSingleCamera(int Index, const aiScene* pScene)
 
     glm::vec3 Center = FinalPos + FinalTarget;
     m_cameras[Index].Init(FinalPos, persProjInfo);
+
+    MeshCacheCamera CacheCamera;
+    CacheCamera.Pos = FinalPos;
+    CacheCamera.ProjInfo = persProjInfo;
+    m_cacheCameras.push_back(CacheCamera);
 }
 
 
@@ -1468,6 +2141,11 @@ const aiNodeAnim* CoreModel::FindNodeAnim(const aiAnimation&
 
 bool CoreModel::IsAnimated() const
 {
+    // No scene means the model was loaded from the mesh cache which only holds static models
+    if (!m_pScene) {
+        return false;
+    }
+
     bool ret = m_pScene->mNumAnimations > 0;
 
     if (ret && (NumBones() == 0)) {
@@ -196,6 +196,18 @@ bool CoreScene::RemoveFromRenderList(SceneObject* pSceneObject)
 
 
 
+void CoreScene::GetRenderListByModel(std::map<CoreModel*, std::vector<glm::mat4>>& Instances) const
+{
+    for (auto& it : Instances) {
+        it.second.clear();
+    }
+
+    for (const CoreSceneObject* pSceneObject : m_renderList) {
+        Instances[pSceneObject->GetModel()].push_back(pSceneObject->GetMatrix());
+    }
+}
+
+
 std::list<SceneObject*> CoreScene::GetSceneObjectsList()
 {
     // TODO: not very efficient. Currently used only by the GUI. For small lists it should be ok.
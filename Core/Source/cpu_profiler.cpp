@@ -0,0 +1,205 @@
+#include <stdio.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CPU_PROFILER_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CPU_PROFILER_RDTSC
+#endif
+
+#include "cpu_profiler.h"
+
+
+CpuProfiler& CpuProfiler::Get()
+{
+    static CpuProfiler s_cpuProfiler;
+    return s_cpuProfiler;
+}
+
+
+uint64_t CpuProfiler::GetTimestamp()
+{
+#ifdef CPU_PROFILER_RDTSC
+    // Invariant TSC on all the x86 CPUs we care about - constant rate and synchronized between the cores
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+
+void CpuProfiler::Start()
+{
+    std::lock_guard<std::mutex> Lock(m_mutex);
+
+    // The rings of the previous capture are reset by their own threads (see AddZone())
+    m_generation.fetch_add(1, std::memory_order_relaxed);
+
+    m_startTime = std::chrono::steady_clock::now();
+    m_startTimestamp = GetTimestamp();
+
+    m_enabled.store(true, std::memory_order_release);
+}
+
+
+void CpuProfiler::Stop()
+{
+    m_enabled.store(false, std::memory_order_relaxed);
+}
+
+
+CpuProfiler::ThreadRing* CpuProfiler::GetThreadRing()
+{
+    static thread_local ThreadRing* t_pThreadRing = NULL;
+
+    if (!t_pThreadRing) {
+        // Never freed - the threads can outlive a capture and the export reads the rings of finished threads
+        std::unique_ptr<ThreadRing> Ring = std::make_unique<ThreadRing>();
+
+        std::lock_guard<std::mutex> Lock(m_mutex);
+        Ring->ThreadIndex = (int)m_rings.size();
+        t_pThreadRing = Ring.get();
+        m_rings.push_back(std::move(Ring));
+    }
+
+    return t_pThreadRing;
+}
+
+
+void CpuProfiler::AddZone(const char* pName, uint64_t Begin, uint64_t End, uint32_t Generation)
+{
+    if (Generation != m_generation.load(std::memory_order_relaxed)) {
+        return;     // began in an older capture
+    }
+
+    ThreadRing* pRing = GetThreadRing();
+
+    // Only this thread writes the ring - the releases make the zones visible to the export
+    uint64_t NumZones = pRing->NumZones.load(std::memory_order_relaxed);
+
+    if (pRing->Generation.load(std::memory_order_relaxed) != Generation) {
+        NumZones = 0;
+        pRing->NumZones.store(0, std::memory_order_relaxed);
+        pRing->Generation.store(Generation, std::memory_order_release);
+    }
+
+    Zone& z = pRing->Zones[NumZones & (CPU_PROFILER_RING_SIZE - 1)];
+    z.pName = pName;
+    z.Begin = Begin;
+    z.End = End;
+
+    pRing->NumZones.store(NumZones + 1, std::memory_order_release);
+}
+
+
+static void WriteJsonString(FILE* f, const char* pStr)
+{
+    fputc('"', f);
+
+    for (const char* p = pStr; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', f);
+            fputc(*p, f);
+        }
+        else if ((unsigned char)*p < 0x20) {
+            fprintf(f, "\\u%04x", (unsigned char)*p);
+        }
+        else {
+            fputc(*p, f);
+        }
+    }
+
+    fputc('"', f);
+}
+
+
+bool CpuProfiler::ExportChromeTrace(const char* pFilename)
+{
+    std::lock_guard<std::mutex> Lock(m_mutex);
+
+    // The rate of the timestamps over the whole capture
+    std::chrono::duration<double, std::micro> Elapsed = std::chrono::steady_clock::now() - m_startTime;
+    uint64_t ElapsedTicks = GetTimestamp() - m_startTimestamp;
+
+    if (ElapsedTicks == 0 || Elapsed.count() <= 0.0) {
+        printf("No CPU profiler capture to export\n");
+        return false;
+    }
+
+    double MicrosPerTick = Elapsed.count() / (double)ElapsedTicks;
+
+    FILE* f = fopen(pFilename, "w");
+
+    if (!f) {
+        printf("Error opening '%s' for writing\n", pFilename);
+        return false;
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"VulkanEngine\"}}");
+
+    int NumExported = 0;
+    int NumDropped = 0;
+
+    uint32_t Generation = m_generation.load(std::memory_order_relaxed);
+
+    for (std::unique_ptr<ThreadRing>& Ring : m_rings) {
+        // A ring that wasn't written since Start() still holds an older capture
+        if (Ring->Generation.load(std::memory_order_acquire) != Generation) {
+            continue;
+        }
+
+        uint64_t NumZones = Ring->NumZones.load(std::memory_order_acquire);
+
+        if (NumZones == 0) {
+            continue;
+        }
+
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"Thread %d\"}}",
+                Ring->ThreadIndex, Ring->ThreadIndex);
+
+        // Only the last CPU_PROFILER_RING_SIZE zones of the thread are still in the ring
+        uint64_t First = 0;
+
+        if (NumZones > CPU_PROFILER_RING_SIZE) {
+            First = NumZones - CPU_PROFILER_RING_SIZE;
+            NumDropped += (int)First;
+        }
+
+        for (uint64_t i = First; i < NumZones; i++) {
+            const Zone& z = Ring->Zones[i & (CPU_PROFILER_RING_SIZE - 1)];
+
+            double Begin = (double)(int64_t)(z.Begin - m_startTimestamp) * MicrosPerTick;
+            double Duration = (double)(z.End - z.Begin) * MicrosPerTick;
+
+            fprintf(f, ",\n{\"name\":");
+            WriteJsonString(f, z.pName);
+            fprintf(f, ",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                    Begin, Duration, Ring->ThreadIndex);
+
+            NumExported++;
+        }
+    }
+
+    fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    bool Success = (ferror(f) == 0);
+
+    fclose(f);
+
+    if (!Success) {
+        printf("Error writing CPU trace '%s'\n", pFilename);
+        return false;
+    }
+
+    printf("CPU trace written to '%s': %d zones", pFilename, NumExported);
+
+    if (NumDropped > 0) {
+        printf(", %d older zones were overwritten", NumDropped);
+    }
+
+    printf("\n");
+
+    return true;
+}
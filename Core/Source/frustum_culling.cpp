@@ -0,0 +1,242 @@
+#include <math.h>
+
+#include "frustum_culling.h"
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+    #define CULL_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    #include <emmintrin.h>
+    #define CULL_SIMD_WIDTH 4
+#else
+    #define CULL_SIMD_WIDTH 1
+#endif
+
+#define NUM_FRUSTUM_PLANES 6
+
+
+// Gribb/Hartmann. The planes point into the frustum and are not normalized
+// because the box test compares two distances with the same scale.
+void ExtractFrustumPlanes(const glm::mat4& WVP, glm::vec4 Planes[6])
+{
+    // GLM is column major so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    glm::vec4 Row0 = glm::vec4(WVP[0][0], WVP[1][0], WVP[2][0], WVP[3][0]);
+    glm::vec4 Row1 = glm::vec4(WVP[0][1], WVP[1][1], WVP[2][1], WVP[3][1]);
+    glm::vec4 Row2 = glm::vec4(WVP[0][2], WVP[1][2], WVP[2][2], WVP[3][2]);
+    glm::vec4 Row3 = glm::vec4(WVP[0][3], WVP[1][3], WVP[2][3], WVP[3][3]);
+
+    Planes[0] = Row3 + Row0;    // left
+    Planes[1] = Row3 - Row0;    // right
+    Planes[2] = Row3 + Row1;    // bottom
+    Planes[3] = Row3 - Row1;    // top
+    Planes[4] = Row3 + Row2;    // near (-w <= z - the projection of the camera uses the GL depth range)
+    Planes[5] = Row3 - Row2;    // far
+}
+
+
+bool IsBoxVisible(const glm::mat4& WVP, const glm::vec3& MinPos, const glm::vec3& MaxPos)
+{
+    glm::vec4 Planes[NUM_FRUSTUM_PLANES];
+    ExtractFrustumPlanes(WVP, Planes);
+
+    glm::vec3 Center = (MinPos + MaxPos) * 0.5f;
+    glm::vec3 Extent = (MaxPos - MinPos) * 0.5f;
+
+    for (int p = 0; p < NUM_FRUSTUM_PLANES; p++) {
+        const glm::vec4& Plane = Planes[p];
+        float Dist = Plane.x * Center.x + Plane.y * Center.y + Plane.z * Center.z + Plane.w;
+        float Radius = fabsf(Plane.x) * Extent.x + fabsf(Plane.y) * Extent.y + fabsf(Plane.z) * Extent.z;
+
+        if (Dist + Radius < 0.0f) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void FrustumCuller::SetBoxes(const std::vector<BasicMeshEntry>& Meshes)
+{
+    m_numBoxes = (int)Meshes.size();
+
+    int PaddedSize = (m_numBoxes + CULL_SIMD_WIDTH - 1) / CULL_SIMD_WIDTH * CULL_SIMD_WIDTH;
+
+    m_centerX.assign(PaddedSize, 0.0f);
+    m_centerY.assign(PaddedSize, 0.0f);
+    m_centerZ.assign(PaddedSize, 0.0f);
+    m_extentX.assign(PaddedSize, 0.0f);
+    m_extentY.assign(PaddedSize, 0.0f);
+    m_extentZ.assign(PaddedSize, 0.0f);
+
+    for (int i = 0; i < m_numBoxes; i++) {
+        glm::vec3 Center = (Meshes[i].MinPos + Meshes[i].MaxPos) * 0.5f;
+        glm::vec3 Extent = (Meshes[i].MaxPos - Meshes[i].MinPos) * 0.5f;
+
+        m_centerX[i] = Center.x;
+        m_centerY[i] = Center.y;
+        m_centerZ[i] = Center.z;
+        m_extentX[i] = Extent.x;
+        m_extentY[i] = Extent.y;
+        m_extentZ[i] = Extent.z;
+    }
+}
+
+
+// A box is outside if it is completely behind one of the planes:
+// dot(N, Center) + D + dot(|N|, Extent) < 0
+int FrustumCuller::Cull(const glm::mat4& WVP, uint32_t* pVisible) const
+{
+    glm::vec4 Planes[NUM_FRUSTUM_PLANES];
+    ExtractFrustumPlanes(WVP, Planes);
+
+    int NumVisible = 0;
+
+#if CULL_SIMD_WIDTH == 8
+    __m256 Nx[NUM_FRUSTUM_PLANES], Ny[NUM_FRUSTUM_PLANES], Nz[NUM_FRUSTUM_PLANES], D[NUM_FRUSTUM_PLANES];
+    __m256 AbsNx[NUM_FRUSTUM_PLANES], AbsNy[NUM_FRUSTUM_PLANES], AbsNz[NUM_FRUSTUM_PLANES];
+
+    for (int p = 0; p < NUM_FRUSTUM_PLANES; p++) {
+        Nx[p] = _mm256_set1_ps(Planes[p].x);
+        Ny[p] = _mm256_set1_ps(Planes[p].y);
+        Nz[p] = _mm256_set1_ps(Planes[p].z);
+        D[p] = _mm256_set1_ps(Planes[p].w);
+        AbsNx[p] = _mm256_set1_ps(fabsf(Planes[p].x));
+        AbsNy[p] = _mm256_set1_ps(fabsf(Planes[p].y));
+        AbsNz[p] = _mm256_set1_ps(fabsf(Planes[p].z));
+    }
+
+    const __m256 Zero = _mm256_setzero_ps();
+
+    for (int i = 0; i < m_numBoxes; i += 8) {
+        __m256 Cx = _mm256_loadu_ps(&m_centerX[i]);
+        __m256 Cy = _mm256_loadu_ps(&m_centerY[i]);
+        __m256 Cz = _mm256_loadu_ps(&m_centerZ[i]);
+        __m256 Ex = _mm256_loadu_ps(&m_extentX[i]);
+        __m256 Ey = _mm256_loadu_ps(&m_extentY[i]);
+        __m256 Ez = _mm256_loadu_ps(&m_extentZ[i]);
+
+        __m256 Inside = _mm256_cmp_ps(Zero, Zero, _CMP_EQ_OQ);    // all ones
+
+        for (int p = 0; p < NUM_FRUSTUM_PLANES; p++) {
+            __m256 Dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(Nx[p], Cx), _mm256_mul_ps(Ny[p], Cy)),
+                                        _mm256_add_ps(_mm256_mul_ps(Nz[p], Cz), D[p]));
+            __m256 Radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(AbsNx[p], Ex), _mm256_mul_ps(AbsNy[p], Ey)),
+                                          _mm256_mul_ps(AbsNz[p], Ez));
+            Inside = _mm256_and_ps(Inside, _mm256_cmp_ps(_mm256_add_ps(Dist, Radius), Zero, _CMP_GE_OQ));
+        }
+
+        int Mask = _mm256_movemask_ps(Inside);
+
+        for (int j = 0; (j < 8) && (i + j < m_numBoxes); j++) {
+            if (Mask & (1 << j)) {
+                pVisible[NumVisible++] = i + j;
+            }
+        }
+    }
+#elif CULL_SIMD_WIDTH == 4
+    __m128 Nx[NUM_FRUSTUM_PLANES], Ny[NUM_FRUSTUM_PLANES], Nz[NUM_FRUSTUM_PLANES], D[NUM_FRUSTUM_PLANES];
+    __m128 AbsNx[NUM_FRUSTUM_PLANES], AbsNy[NUM_FRUSTUM_PLANES], AbsNz[NUM_FRUSTUM_PLANES];
+
+    for (int p = 0; p < NUM_FRUSTUM_PLANES; p++) {
+        Nx[p] = _mm_set1_ps(Planes[p].x);
+        Ny[p] = _mm_set1_ps(Planes[p].y);
+        Nz[p] = _mm_set1_ps(Planes[p].z);
+        D[p] = _mm_set1_ps(Planes[p].w);
+        AbsNx[p] = _mm_set1_ps(fabsf(Planes[p].x));
+        AbsNy[p] = _mm_set1_ps(fabsf(Planes[p].y));
+        AbsNz[p] = _mm_set1_ps(fabsf(Planes[p].z));
+    }
+
+    const __m128 Zero = _mm_setzero_ps();
+
+    for (int i = 0; i < m_numBoxes; i += 4) {
+        __m128 Cx = _mm_loadu_ps(&m_centerX[i]);
+        __m128 Cy = _mm_loadu_ps(&m_centerY[i]);
+        __m128 Cz = _mm_loadu_ps(&m_centerZ[i]);
+        __m128 Ex = _mm_loadu_ps(&m_extentX[i]);
+        __m128 Ey = _mm_loadu_ps(&m_extentY[i]);
+        __m128 Ez = _mm_loadu_ps(&m_extentZ[i]);
+
+        __m128 Inside = _mm_cmpeq_ps(Zero, Zero);    // all ones
+
+        for (int p = 0; p < NUM_FRUSTUM_PLANES; p++) {
+            __m128 Dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Nx[p], Cx), _mm_mul_ps(Ny[p], Cy)),
+                                     _mm_add_ps(_mm_mul_ps(Nz[p], Cz), D[p]));
+            __m128 Radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(AbsNx[p], Ex), _mm_mul_ps(AbsNy[p], Ey)),
+                                       _mm_mul_ps(AbsNz[p], Ez));
+            Inside = _mm_and_ps(Inside, _mm_cmpge_ps(_mm_add_ps(Dist, Radius), Zero));
+        }
+
+        int Mask = _mm_movemask_ps(Inside);
+
+        for (int j = 0; (j < 4) && (i + j < m_numBoxes); j++) {
+            if (Mask & (1 << j)) {
+                pVisible[NumVisible++] = i + j;
+            }
+        }
+    }
+#else
+    for (int i = 0; i < m_numBoxes; i++) {
+        bool Inside = true;
+
+        for (int p = 0; (p < NUM_FRUSTUM_PLANES) && Inside; p++) {
+            const glm::vec4& Plane = Planes[p];
+            float Dist = Plane.x * m_centerX[i] + Plane.y * m_centerY[i] + Plane.z * m_centerZ[i] + Plane.w;
+            float Radius = fabsf(Plane.x) * m_extentX[i] + fabsf(Plane.y) * m_extentY[i] + fabsf(Plane.z) * m_extentZ[i];
+            Inside = (Dist + Radius >= 0.0f);
+        }
+
+        if (Inside) {
+            pVisible[NumVisible++] = i;
+        }
+    }
+#endif
+
+    return NumVisible;
+}
+
+
+void MeshletCuller::SetWVP(const glm::mat4& WVP)
+{
+    ExtractFrustumPlanes(WVP, m_planes);
+
+    for (int p = 0; p < NUM_FRUSTUM_PLANES; p++) {
+        m_planes[p] /= glm::length(glm::vec3(m_planes[p]));
+    }
+
+    // A perspective projection takes the camera to (0, 0, z, 0) in clip space
+    // so it can be recovered from the WVP matrix alone
+    glm::vec4 CameraPos = glm::inverse(WVP) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+
+    m_perspective = (fabsf(CameraPos.w) > 1e-6f);
+
+    if (m_perspective) {
+        m_cameraPos = glm::vec3(CameraPos) / CameraPos.w;
+    }
+}
+
+
+bool MeshletCuller::IsVisible(const Meshlet& m) const
+{
+    glm::vec3 Center = glm::vec3(m.BoundingSphere);
+    float Radius = m.BoundingSphere.w;
+
+    for (int p = 0; p < NUM_FRUSTUM_PLANES; p++) {
+        if (glm::dot(glm::vec3(m_planes[p]), Center) + m_planes[p].w < -Radius) {
+            return false;
+        }
+    }
+
+    // meshopt_computeMeshletBounds: the cone rejects the meshlet if
+    // dot(Center - CameraPos, ConeAxis) >= ConeCutoff * length(Center - CameraPos) + Radius
+    if (m_perspective && (m.ConeCutoff < 1.0f)) {
+        glm::vec3 v = Center - m_cameraPos;
+
+        if (glm::dot(v, m.ConeAxis) >= m.ConeCutoff * glm::length(v) + Radius) {
+            return false;
+        }
+    }
+
+    return true;
+}
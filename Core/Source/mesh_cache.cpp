@@ -0,0 +1,365 @@
+#include <filesystem>
+#include <stdio.h>
+#include <string.h>
+
+#include "util.h"
+#include "mesh_cache.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+static bool GetSourceFileInfo(const std::string& Filename, uint64_t& Size, int64_t& ModTime)
+{
+    std::error_code ec;
+
+    uintmax_t FileSize = std::filesystem::file_size(Filename, ec);
+
+    if (ec) {
+        return false;
+    }
+
+    std::filesystem::file_time_type WriteTime = std::filesystem::last_write_time(Filename, ec);
+
+    if (ec) {
+        return false;
+    }
+
+    Size = (uint64_t)FileSize;
+    ModTime = (int64_t)WriteTime.time_since_epoch().count();
+
+    return true;
+}
+
+
+static uint64_t AlignUp(uint64_t Value, uint64_t Alignment)
+{
+    return (Value + Alignment - 1) & ~(Alignment - 1);
+}
+
+
+std::string GetMeshCacheFilename(const std::string& SourceFilename)
+{
+    return SourceFilename + ".meshcache";
+}
+
+
+MeshCacheReader::~MeshCacheReader()
+{
+    Close();
+}
+
+
+bool MeshCacheReader::Open(const std::string& SourceFilename, uint32_t VertexStride, uint32_t ImportFlags, uint32_t LODConfig)
+{
+    Close();
+
+    uint64_t SourceSize = 0;
+    int64_t SourceModTime = 0;
+
+    if (!GetSourceFileInfo(SourceFilename, SourceSize, SourceModTime)) {
+        return false;
+    }
+
+    std::string CacheFilename = GetMeshCacheFilename(SourceFilename);
+
+    if (!MapFile(CacheFilename)) {
+        return false;
+    }
+
+    if (m_size < sizeof(MeshCacheHeader)) {
+        printf("Mesh cache '%s' is truncated\n", CacheFilename.c_str());
+        Close();
+        return false;
+    }
+
+    const MeshCacheHeader& Header = GetHeader();
+
+    bool IsFresh = (Header.Magic == MESH_CACHE_MAGIC) &&
+                   (Header.Version == MESH_CACHE_VERSION) &&
+                   (Header.VertexStride == VertexStride) &&
+                   (Header.ImportFlags == ImportFlags) &&
+                   (Header.LODConfig == LODConfig) &&
+                   (Header.SourceSize == SourceSize) &&
+                   (Header.SourceModTime == SourceModTime);
+
+    if (!IsFresh) {
+        printf("Mesh cache '%s' is stale\n", CacheFilename.c_str());
+        Close();
+        return false;
+    }
+
+    for (int i = 0; i < MESH_CACHE_NUM_SECTIONS; i++) {
+        const MeshCacheSection& Section = Header.Sections[i];
+
+        if ((Section.Offset % MESH_CACHE_SECTION_ALIGNMENT) || (Section.Offset + Section.Size > m_size)) {
+            printf("Mesh cache '%s' is corrupted (section %d)\n", CacheFilename.c_str(), i);
+            Close();
+            return false;
+        }
+    }
+
+    // E.g. an edited material library changes the materials and the texture paths
+    size_t NumDependencies = 0;
+    const MeshCacheDependency* pDependencies = GetSection<MeshCacheDependency>(MESH_CACHE_SECTION_DEPENDENCIES, NumDependencies);
+
+    for (size_t i = 0; i < NumDependencies; i++) {
+        const char* pPath = GetString(pDependencies[i].Path);
+
+        uint64_t Size = 0;
+        int64_t ModTime = 0;
+
+        if (!pPath || !GetSourceFileInfo(pPath, Size, ModTime) ||
+            (Size != pDependencies[i].Size) || (ModTime != pDependencies[i].ModTime)) {
+            printf("Mesh cache '%s' is stale ('%s' changed)\n", CacheFilename.c_str(), pPath ? pPath : "");
+            Close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool MeshCacheReader::MapFile(const std::string& Filename)
+{
+#ifdef _WIN32
+    HANDLE hFile = CreateFileA(Filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    m_hFile = hFile;
+
+    LARGE_INTEGER FileSize;
+
+    if (!GetFileSizeEx(hFile, &FileSize) || (FileSize.QuadPart == 0)) {
+        Close();
+        return false;
+    }
+
+    m_hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (!m_hMapping) {
+        Close();
+        return false;
+    }
+
+    m_pData = (const uint8_t*)MapViewOfFile((HANDLE)m_hMapping, FILE_MAP_READ, 0, 0, 0);
+    m_size = (size_t)FileSize.QuadPart;
+#else
+    int fd = open(Filename.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat StatBuf;
+
+    if ((fstat(fd, &StatBuf) != 0) || (StatBuf.st_size == 0)) {
+        close(fd);
+        return false;
+    }
+
+    void* p = mmap(NULL, (size_t)StatBuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+
+    if (p == MAP_FAILED) {
+        return false;
+    }
+
+    m_pData = (const uint8_t*)p;
+    m_size = (size_t)StatBuf.st_size;
+#endif
+
+    if (!m_pData) {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+
+void MeshCacheReader::Close()
+{
+#ifdef _WIN32
+    if (m_pData) {
+        UnmapViewOfFile(m_pData);
+    }
+
+    if (m_hMapping) {
+        CloseHandle((HANDLE)m_hMapping);
+        m_hMapping = NULL;
+    }
+
+    if (m_hFile) {
+        CloseHandle((HANDLE)m_hFile);
+        m_hFile = NULL;
+    }
+#else
+    if (m_pData) {
+        munmap((void*)m_pData, m_size);
+    }
+#endif
+
+    m_pData = NULL;
+    m_size = 0;
+}
+
+
+const void* MeshCacheReader::GetSection(MESH_CACHE_SECTION Section, size_t ElementSize, size_t& Count) const
+{
+    assert(m_pData);
+
+    const MeshCacheSection& s = GetHeader().Sections[Section];
+
+    Count = (size_t)(s.Size / ElementSize);
+
+    return m_pData + s.Offset;
+}
+
+
+const char* MeshCacheReader::GetString(uint32_t Offset) const
+{
+    if (Offset == MESH_CACHE_INVALID_STRING) {
+        return NULL;
+    }
+
+    size_t Size = 0;
+    const char* pStrings = GetSection<char>(MESH_CACHE_SECTION_STRINGS, Size);
+
+    if (Offset >= Size) {
+        printf("Invalid mesh cache string offset %d (string section size %d)\n", Offset, (int)Size);
+        return NULL;
+    }
+
+    return pStrings + Offset;
+}
+
+
+void MeshCacheWriter::SetSection(MESH_CACHE_SECTION Section, const void* pData, size_t Size)
+{
+    m_sections[Section].pData = pData;
+    m_sections[Section].Size = Size;
+}
+
+
+uint32_t MeshCacheWriter::AddString(const std::string& s)
+{
+    if (s.empty()) {
+        return MESH_CACHE_INVALID_STRING;
+    }
+
+    uint32_t Offset = (uint32_t)m_strings.size();
+
+    m_strings.insert(m_strings.end(), s.begin(), s.end());
+    m_strings.push_back('\0');
+
+    return Offset;
+}
+
+
+void MeshCacheWriter::AddDependency(const std::string& Filename)
+{
+    for (const std::string& Name : m_dependencyNames) {
+        if (Name == Filename) {
+            return;
+        }
+    }
+
+    MeshCacheDependency Dependency;
+
+    if (!GetSourceFileInfo(Filename, Dependency.Size, Dependency.ModTime)) {
+        return;
+    }
+
+    Dependency.Path = AddString(Filename);
+
+    m_dependencies.push_back(Dependency);
+    m_dependencyNames.push_back(Filename);
+}
+
+
+bool MeshCacheWriter::Write(const std::string& SourceFilename, uint32_t VertexStride, uint32_t ImportFlags, uint32_t LODConfig,
+                            const glm::vec3& MinPos, const glm::vec3& MaxPos)
+{
+    MeshCacheHeader Header;
+    Header.VertexStride = VertexStride;
+    Header.ImportFlags = ImportFlags;
+    Header.LODConfig = LODConfig;
+    Header.MinPos = glm::vec4(MinPos, 1.0f);
+    Header.MaxPos = glm::vec4(MaxPos, 1.0f);
+
+    if (!GetSourceFileInfo(SourceFilename, Header.SourceSize, Header.SourceModTime)) {
+        printf("Cannot stat '%s' - mesh cache not written\n", SourceFilename.c_str());
+        return false;
+    }
+
+    SetSection(MESH_CACHE_SECTION_DEPENDENCIES, m_dependencies);
+    SetSection(MESH_CACHE_SECTION_STRINGS, m_strings);
+
+    uint64_t Offset = AlignUp(sizeof(MeshCacheHeader), MESH_CACHE_SECTION_ALIGNMENT);
+
+    for (int i = 0; i < MESH_CACHE_NUM_SECTIONS; i++) {
+        Header.Sections[i].Offset = Offset;
+        Header.Sections[i].Size = m_sections[i].Size;
+        Offset = AlignUp(Offset + m_sections[i].Size, MESH_CACHE_SECTION_ALIGNMENT);
+    }
+
+    // Write to a temporary file and rename it so that a crash in the middle
+    // never leaves behind a cache that looks valid
+    std::string CacheFilename = GetMeshCacheFilename(SourceFilename);
+    std::string TempFilename = CacheFilename + ".tmp";
+
+    FILE* f = fopen(TempFilename.c_str(), "wb");
+
+    if (!f) {
+        printf("Error opening '%s' for writing\n", TempFilename.c_str());
+        return false;
+    }
+
+    static const char Padding[MESH_CACHE_SECTION_ALIGNMENT] = { 0 };
+
+    bool Success = (fwrite(&Header, sizeof(Header), 1, f) == 1);
+    uint64_t Pos = sizeof(Header);
+
+    for (int i = 0; Success && (i < MESH_CACHE_NUM_SECTIONS); i++) {
+        size_t PadSize = (size_t)(Header.Sections[i].Offset - Pos);
+        Success = (fwrite(Padding, 1, PadSize, f) == PadSize);
+
+        if (Success && m_sections[i].Size > 0) {
+            Success = (fwrite(m_sections[i].pData, 1, m_sections[i].Size, f) == m_sections[i].Size);
+        }
+
+        Pos = Header.Sections[i].Offset + Header.Sections[i].Size;
+    }
+
+    fclose(f);
+
+    if (!Success) {
+        printf("Error writing mesh cache '%s'\n", TempFilename.c_str());
+        remove(TempFilename.c_str());
+        return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(TempFilename, CacheFilename, ec);
+
+    if (ec) {
+        printf("Error renaming '%s' to '%s': %s\n", TempFilename.c_str(), CacheFilename.c_str(), ec.message().c_str());
+        remove(TempFilename.c_str());
+        return false;
+    }
+
+    printf("Mesh cache '%s' written (%d bytes)\n", CacheFilename.c_str(), (int)Pos);
+
+    return true;
+}
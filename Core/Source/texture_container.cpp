@@ -0,0 +1,630 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "texture_container.h"
+
+#define DDS_MAGIC 0x20534444    // 'DDS '
+
+#define DDS_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define DDPF_FOURCC 0x4
+
+#define DDSCAPS2_CUBEMAP 0x200
+#define DDSCAPS2_VOLUME  0x200000
+
+// The subset of DXGI_FORMAT that we accept in the DX10 extension of DDS
+#define DXGI_FORMAT_R8G8B8A8_UNORM      28
+#define DXGI_FORMAT_R8G8B8A8_UNORM_SRGB 29
+#define DXGI_FORMAT_BC1_UNORM           71
+#define DXGI_FORMAT_BC1_UNORM_SRGB      72
+#define DXGI_FORMAT_BC3_UNORM           77
+#define DXGI_FORMAT_BC3_UNORM_SRGB      78
+#define DXGI_FORMAT_BC4_UNORM           80
+#define DXGI_FORMAT_BC5_UNORM           83
+#define DXGI_FORMAT_BC7_UNORM           98
+#define DXGI_FORMAT_BC7_UNORM_SRGB      99
+
+#define DDS_DIMENSION_TEXTURE2D 3
+
+#pragma pack(push, 1)
+
+struct DDSPixelFormat {
+    uint32_t Size;
+    uint32_t Flags;
+    uint32_t FourCC;
+    uint32_t RGBBitCount;
+    uint32_t RBitMask;
+    uint32_t GBitMask;
+    uint32_t BBitMask;
+    uint32_t ABitMask;
+};
+
+struct DDSHeader {
+    uint32_t Size;
+    uint32_t Flags;
+    uint32_t Height;
+    uint32_t Width;
+    uint32_t PitchOrLinearSize;
+    uint32_t Depth;
+    uint32_t MipMapCount;
+    uint32_t Reserved1[11];
+    DDSPixelFormat PixelFormat;
+    uint32_t Caps;
+    uint32_t Caps2;
+    uint32_t Caps3;
+    uint32_t Caps4;
+    uint32_t Reserved2;
+};
+
+struct DDSHeaderDX10 {
+    uint32_t DXGIFormat;
+    uint32_t ResourceDimension;
+    uint32_t MiscFlag;
+    uint32_t ArraySize;
+    uint32_t MiscFlags2;
+};
+
+struct KTX2Header {
+    uint8_t Identifier[12];
+    uint32_t VkFormat;
+    uint32_t TypeSize;
+    uint32_t PixelWidth;
+    uint32_t PixelHeight;
+    uint32_t PixelDepth;
+    uint32_t LayerCount;
+    uint32_t FaceCount;
+    uint32_t LevelCount;
+    uint32_t SupercompressionScheme;
+    uint32_t DFDByteOffset;
+    uint32_t DFDByteLength;
+    uint32_t KVDByteOffset;
+    uint32_t KVDByteLength;
+    uint64_t SGDByteOffset;
+    uint64_t SGDByteLength;
+};
+
+struct KTX2LevelIndex {
+    uint64_t ByteOffset;
+    uint64_t ByteLength;
+    uint64_t UncompressedByteLength;
+};
+
+#pragma pack(pop)
+
+static const uint8_t KTX2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+
+static bool HasExtension(const std::string& Filename, const char* pExt)
+{
+    size_t Len = strlen(pExt);
+
+    if (Filename.size() < Len) {
+        return false;
+    }
+
+    std::string Ext = Filename.substr(Filename.size() - Len);
+    std::transform(Ext.begin(), Ext.end(), Ext.begin(), [](unsigned char c) { return (char)tolower(c); });
+
+    return Ext == pExt;
+}
+
+
+bool IsTextureContainerFile(const std::string& Filename)
+{
+    return HasExtension(Filename, ".dds") || HasExtension(Filename, ".ktx2");
+}
+
+
+bool IsBlockCompressedFormat(VkFormat Format)
+{
+    return GetBlockSize(Format) != 0;
+}
+
+
+uint32_t GetBlockSize(VkFormat Format)
+{
+    switch (Format) {
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+        return 8;
+
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return 16;
+
+    default:
+        return 0;
+    }
+}
+
+
+VkFormat GetDecodedFormat(VkFormat Format)
+{
+    switch (Format) {
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        return VK_FORMAT_R8G8B8A8_SRGB;
+
+    default:
+        return VK_FORMAT_R8G8B8A8_UNORM;
+    }
+}
+
+
+static uint64_t GetMipSize(VkFormat Format, uint32_t Width, uint32_t Height)
+{
+    uint32_t BlockSize = GetBlockSize(Format);
+
+    if (BlockSize) {
+        return (uint64_t)((Width + 3) / 4) * ((Height + 3) / 4) * BlockSize;
+    }
+
+    return (uint64_t)Width * Height * 4;
+}
+
+
+static VkFormat DXGIToVkFormat(uint32_t DXGIFormat)
+{
+    switch (DXGIFormat) {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:        return VK_FORMAT_R8G8B8A8_UNORM;
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:   return VK_FORMAT_R8G8B8A8_SRGB;
+    case DXGI_FORMAT_BC1_UNORM:             return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case DXGI_FORMAT_BC1_UNORM_SRGB:        return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+    case DXGI_FORMAT_BC3_UNORM:             return VK_FORMAT_BC3_UNORM_BLOCK;
+    case DXGI_FORMAT_BC3_UNORM_SRGB:        return VK_FORMAT_BC3_SRGB_BLOCK;
+    case DXGI_FORMAT_BC4_UNORM:             return VK_FORMAT_BC4_UNORM_BLOCK;
+    case DXGI_FORMAT_BC5_UNORM:             return VK_FORMAT_BC5_UNORM_BLOCK;
+    case DXGI_FORMAT_BC7_UNORM:             return VK_FORMAT_BC7_UNORM_BLOCK;
+    case DXGI_FORMAT_BC7_UNORM_SRGB:        return VK_FORMAT_BC7_SRGB_BLOCK;
+    default:                                return VK_FORMAT_UNDEFINED;
+    }
+}
+
+
+static bool ReadFile(const std::string& Filename, std::vector<uint8_t>& Data)
+{
+    FILE* f = fopen(Filename.c_str(), "rb");
+
+    if (!f) {
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long Size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    Data.resize(Size > 0 ? Size : 0);
+
+    bool Success = (Size > 0) && (fread(Data.data(), 1, Size, f) == (size_t)Size);
+
+    fclose(f);
+
+    return Success;
+}
+
+
+// Down to 1x1
+static uint32_t GetMipChainLength(uint32_t Width, uint32_t Height)
+{
+    uint32_t Size = std::max(Width, Height);
+    uint32_t NumMips = 1;
+
+    while (Size > 1) {
+        Size /= 2;
+        NumMips++;
+    }
+
+    return NumMips;
+}
+
+
+// The mips of a DDS file follow the header(s) tightly packed, largest first
+static bool ParseDDS(const std::string& Filename, std::vector<uint8_t>& File, TextureContainer& Container)
+{
+    if (File.size() < sizeof(uint32_t) + sizeof(DDSHeader)) {
+        printf("'%s' is too small for a DDS file\n", Filename.c_str());
+        return false;
+    }
+
+    DDSHeader Header;
+    memcpy(&Header, &File[sizeof(uint32_t)], sizeof(Header));
+
+    size_t DataOffset = sizeof(uint32_t) + sizeof(DDSHeader);
+
+    if (Header.PixelFormat.Flags & DDPF_FOURCC) {
+        switch (Header.PixelFormat.FourCC) {
+        // The legacy formats have no color space. Like everything else that goes
+        // through stbi_load they are treated as sRGB, except the two channel ones.
+        case DDS_FOURCC('D', 'X', 'T', '1'):
+            Container.Format = VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+            break;
+
+        case DDS_FOURCC('D', 'X', 'T', '5'):
+            Container.Format = VK_FORMAT_BC3_SRGB_BLOCK;
+            break;
+
+        case DDS_FOURCC('A', 'T', 'I', '1'):
+        case DDS_FOURCC('B', 'C', '4', 'U'):
+            Container.Format = VK_FORMAT_BC4_UNORM_BLOCK;
+            break;
+
+        case DDS_FOURCC('A', 'T', 'I', '2'):
+        case DDS_FOURCC('B', 'C', '5', 'U'):
+            Container.Format = VK_FORMAT_BC5_UNORM_BLOCK;
+            break;
+
+        case DDS_FOURCC('D', 'X', '1', '0'):
+        {
+            if (File.size() < DataOffset + sizeof(DDSHeaderDX10)) {
+                printf("'%s' is truncated\n", Filename.c_str());
+                return false;
+            }
+
+            DDSHeaderDX10 HeaderDX10;
+            memcpy(&HeaderDX10, &File[DataOffset], sizeof(HeaderDX10));
+            DataOffset += sizeof(DDSHeaderDX10);
+
+            if ((HeaderDX10.ResourceDimension != DDS_DIMENSION_TEXTURE2D) || (HeaderDX10.ArraySize > 1)) {
+                printf("'%s' is not a single 2D texture\n", Filename.c_str());
+                return false;
+            }
+
+            Container.Format = DXGIToVkFormat(HeaderDX10.DXGIFormat);
+            break;
+        }
+
+        default:
+            Container.Format = VK_FORMAT_UNDEFINED;
+        }
+    }
+    else if ((Header.PixelFormat.RGBBitCount == 32) && (Header.PixelFormat.RBitMask == 0xFF) &&
+             (Header.PixelFormat.GBitMask == 0xFF00) && (Header.PixelFormat.BBitMask == 0xFF0000)) {
+        Container.Format = VK_FORMAT_R8G8B8A8_SRGB;
+    }
+
+    if (Container.Format == VK_FORMAT_UNDEFINED) {
+        printf("'%s' uses an unsupported DDS format\n", Filename.c_str());
+        return false;
+    }
+
+    // An image can't have a zero extent
+    if ((Header.Width == 0) || (Header.Height == 0)) {
+        printf("'%s' has an invalid size %ux%u\n", Filename.c_str(), Header.Width, Header.Height);
+        return false;
+    }
+
+    if ((Header.Caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)) || (Header.Depth > 1)) {
+        printf("'%s' is not a single 2D texture\n", Filename.c_str());
+        return false;
+    }
+
+    if (Header.MipMapCount > GetMipChainLength(Header.Width, Header.Height)) {
+        printf("'%s' has %u mips which is more than a %ux%u image can have\n",
+               Filename.c_str(), Header.MipMapCount, Header.Width, Header.Height);
+        return false;
+    }
+
+    Container.NumMips = std::min(std::max(Header.MipMapCount, 1u), (uint32_t)MAX_TEXTURE_CONTAINER_MIPS);
+
+    uint32_t Width = Header.Width;
+    uint32_t Height = Header.Height;
+    uint64_t Offset = 0;
+
+    for (uint32_t Mip = 0; Mip < Container.NumMips; Mip++) {
+        TextureContainerMip& m = Container.Mips[Mip];
+        m.Width = Width;
+        m.Height = Height;
+        m.Offset = Offset;
+        m.Size = GetMipSize(Container.Format, Width, Height);
+
+        Offset += m.Size;
+        Width = std::max(Width / 2, 1u);
+        Height = std::max(Height / 2, 1u);
+    }
+
+    // Written so that it can't overflow
+    if ((DataOffset > File.size()) || (Offset > File.size() - DataOffset)) {
+        printf("'%s' is truncated\n", Filename.c_str());
+        return false;
+    }
+
+    Container.Data.assign(File.begin() + DataOffset, File.begin() + DataOffset + Offset);
+
+    return true;
+}
+
+
+// The level index of a KTX2 file points to each mip separately (smallest first in the file)
+static bool ParseKTX2(const std::string& Filename, std::vector<uint8_t>& File, TextureContainer& Container)
+{
+    if (File.size() < sizeof(KTX2Header)) {
+        printf("'%s' is too small for a KTX2 file\n", Filename.c_str());
+        return false;
+    }
+
+    KTX2Header Header;
+    memcpy(&Header, File.data(), sizeof(Header));
+
+    if (Header.SupercompressionScheme != 0) {
+        printf("'%s' is supercompressed (scheme %d) which is not supported\n", Filename.c_str(), Header.SupercompressionScheme);
+        return false;
+    }
+
+    if ((Header.PixelDepth > 1) || (Header.LayerCount > 1) || (Header.FaceCount != 1)) {
+        printf("'%s' is not a single 2D texture\n", Filename.c_str());
+        return false;
+    }
+
+    Container.Format = (VkFormat)Header.VkFormat;
+
+    if (!IsBlockCompressedFormat(Container.Format) && (GetDecodedFormat(Container.Format) != Container.Format)) {
+        printf("'%s' uses an unsupported format %d\n", Filename.c_str(), Header.VkFormat);
+        return false;
+    }
+
+    if ((Header.PixelWidth == 0) || (Header.PixelHeight == 0)) {
+        printf("'%s' has an invalid size %ux%u\n", Filename.c_str(), Header.PixelWidth, Header.PixelHeight);
+        return false;
+    }
+
+    if (Header.LevelCount > GetMipChainLength(Header.PixelWidth, Header.PixelHeight)) {
+        printf("'%s' has %u mips which is more than a %ux%u image can have\n",
+               Filename.c_str(), Header.LevelCount, Header.PixelWidth, Header.PixelHeight);
+        return false;
+    }
+
+    // A level count of 0 asks the loader to generate the mips - we use only the base level
+    Container.NumMips = std::min(std::max(Header.LevelCount, 1u), (uint32_t)MAX_TEXTURE_CONTAINER_MIPS);
+
+    if (File.size() < sizeof(KTX2Header) + Container.NumMips * sizeof(KTX2LevelIndex)) {
+        printf("'%s' is truncated\n", Filename.c_str());
+        return false;
+    }
+
+    uint32_t Width = Header.PixelWidth;
+    uint32_t Height = Header.PixelHeight;
+    uint64_t TotalSize = 0;
+
+    for (uint32_t Mip = 0; Mip < Container.NumMips; Mip++) {
+        KTX2LevelIndex Level;
+        memcpy(&Level, &File[sizeof(KTX2Header) + Mip * sizeof(KTX2LevelIndex)], sizeof(Level));
+
+        TextureContainerMip& m = Container.Mips[Mip];
+        m.Width = Width;
+        m.Height = Height;
+        m.Size = GetMipSize(Container.Format, Width, Height);
+
+        // Written so that it can't overflow
+        if ((Level.ByteLength < m.Size) || (Level.ByteOffset > File.size()) || (m.Size > File.size() - Level.ByteOffset)) {
+            printf("'%s' is truncated\n", Filename.c_str());
+            return false;
+        }
+
+        TotalSize += m.Size;
+        Width = std::max(Width / 2, 1u);
+        Height = std::max(Height / 2, 1u);
+    }
+
+    // Repack largest first so that both containers look the same
+    Container.Data.resize(TotalSize);
+
+    uint64_t Offset = 0;
+
+    for (uint32_t Mip = 0; Mip < Container.NumMips; Mip++) {
+        KTX2LevelIndex Level;
+        memcpy(&Level, &File[sizeof(KTX2Header) + Mip * sizeof(KTX2LevelIndex)], sizeof(Level));
+
+        TextureContainerMip& m = Container.Mips[Mip];
+        m.Offset = Offset;
+        memcpy(&Container.Data[Offset], &File[Level.ByteOffset], m.Size);
+
+        Offset += m.Size;
+    }
+
+    return true;
+}
+
+
+bool LoadTextureContainer(const std::string& Filename, TextureContainer& Container)
+{
+    std::vector<uint8_t> File;
+
+    if (!ReadFile(Filename, File)) {
+        printf("Error reading '%s'\n", Filename.c_str());
+        return false;
+    }
+
+    uint32_t Magic = 0;
+
+    if (File.size() >= sizeof(Magic)) {
+        memcpy(&Magic, File.data(), sizeof(Magic));
+    }
+
+    if (Magic == DDS_MAGIC) {
+        return ParseDDS(Filename, File, Container);
+    }
+
+    if ((File.size() >= sizeof(KTX2Identifier)) && (memcmp(File.data(), KTX2Identifier, sizeof(KTX2Identifier)) == 0)) {
+        return ParseKTX2(Filename, File, Container);
+    }
+
+    printf("'%s' is neither a DDS nor a KTX2 file\n", Filename.c_str());
+    return false;
+}
+
+
+static void Decode565(uint16_t c, uint8_t Color[4])
+{
+    uint32_t r = (c >> 11) & 0x1F;
+    uint32_t g = (c >> 5) & 0x3F;
+    uint32_t b = c & 0x1F;
+
+    Color[0] = (uint8_t)((r << 3) | (r >> 2));
+    Color[1] = (uint8_t)((g << 2) | (g >> 4));
+    Color[2] = (uint8_t)((b << 3) | (b >> 2));
+    Color[3] = 255;
+}
+
+
+// Color block of BC1/BC3. BC3 always uses the four color mode.
+static void DecodeColorBlock(const uint8_t* pBlock, bool AllowAlpha, uint8_t Texels[16][4])
+{
+    uint16_t c0 = (uint16_t)(pBlock[0] | (pBlock[1] << 8));
+    uint16_t c1 = (uint16_t)(pBlock[2] | (pBlock[3] << 8));
+
+    uint8_t Palette[4][4];
+    Decode565(c0, Palette[0]);
+    Decode565(c1, Palette[1]);
+
+    if ((c0 > c1) || !AllowAlpha) {
+        for (int c = 0; c < 3; c++) {
+            Palette[2][c] = (uint8_t)((2 * Palette[0][c] + Palette[1][c] + 1) / 3);
+            Palette[3][c] = (uint8_t)((Palette[0][c] + 2 * Palette[1][c] + 1) / 3);
+        }
+
+        Palette[2][3] = 255;
+        Palette[3][3] = 255;
+    }
+    else {
+        for (int c = 0; c < 3; c++) {
+            Palette[2][c] = (uint8_t)((Palette[0][c] + Palette[1][c]) / 2);
+            Palette[3][c] = 0;
+        }
+
+        Palette[2][3] = 255;
+        Palette[3][3] = 0;
+    }
+
+    uint32_t Indices = pBlock[4] | (pBlock[5] << 8) | (pBlock[6] << 16) | ((uint32_t)pBlock[7] << 24);
+
+    for (int i = 0; i < 16; i++) {
+        memcpy(Texels[i], Palette[(Indices >> (2 * i)) & 3], 4);
+    }
+}
+
+
+// Single channel block of BC3 (alpha), BC4 and BC5
+static void DecodeChannelBlock(const uint8_t* pBlock, uint8_t Values[16])
+{
+    uint32_t a0 = pBlock[0];
+    uint32_t a1 = pBlock[1];
+
+    uint8_t Palette[8];
+    Palette[0] = (uint8_t)a0;
+    Palette[1] = (uint8_t)a1;
+
+    if (a0 > a1) {
+        for (int i = 1; i < 7; i++) {
+            Palette[i + 1] = (uint8_t)(((7 - i) * a0 + i * a1 + 3) / 7);
+        }
+    }
+    else {
+        for (int i = 1; i < 5; i++) {
+            Palette[i + 1] = (uint8_t)(((5 - i) * a0 + i * a1 + 2) / 5);
+        }
+
+        Palette[6] = 0;
+        Palette[7] = 255;
+    }
+
+    uint64_t Indices = 0;
+
+    for (int i = 0; i < 6; i++) {
+        Indices |= (uint64_t)pBlock[2 + i] << (8 * i);
+    }
+
+    for (int i = 0; i < 16; i++) {
+        Values[i] = Palette[(Indices >> (3 * i)) & 7];
+    }
+}
+
+
+bool DecodeBlockCompressedMip(const TextureContainer& Container, uint32_t Mip, std::vector<uint8_t>& Pixels)
+{
+    VkFormat Format = Container.Format;
+
+    if ((Format == VK_FORMAT_BC7_UNORM_BLOCK) || (Format == VK_FORMAT_BC7_SRGB_BLOCK)) {
+        return false;
+    }
+
+    const TextureContainerMip& m = Container.Mips[Mip];
+    const uint8_t* pSrc = &Container.Data[m.Offset];
+
+    if (!IsBlockCompressedFormat(Format)) {
+        Pixels.assign(pSrc, pSrc + m.Size);
+        return true;
+    }
+
+    uint32_t BlockSize = GetBlockSize(Format);
+    uint32_t BlocksX = (m.Width + 3) / 4;
+    uint32_t BlocksY = (m.Height + 3) / 4;
+
+    Pixels.resize((size_t)m.Width * m.Height * 4);
+
+    for (uint32_t by = 0; by < BlocksY; by++) {
+        for (uint32_t bx = 0; bx < BlocksX; bx++) {
+            const uint8_t* pBlock = pSrc + ((size_t)by * BlocksX + bx) * BlockSize;
+
+            uint8_t Texels[16][4];
+            uint8_t Values[16];
+
+            switch (Format) {
+            case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+                DecodeColorBlock(pBlock, true, Texels);
+                break;
+
+            case VK_FORMAT_BC3_UNORM_BLOCK:
+            case VK_FORMAT_BC3_SRGB_BLOCK:
+                DecodeColorBlock(pBlock + 8, false, Texels);
+                DecodeChannelBlock(pBlock, Values);
+
+                for (int i = 0; i < 16; i++) {
+                    Texels[i][3] = Values[i];
+                }
+                break;
+
+            case VK_FORMAT_BC4_UNORM_BLOCK:
+            case VK_FORMAT_BC5_UNORM_BLOCK:
+                DecodeChannelBlock(pBlock, Values);
+
+                for (int i = 0; i < 16; i++) {
+                    Texels[i][0] = Values[i];
+                    Texels[i][1] = 0;
+                    Texels[i][2] = 0;
+                    Texels[i][3] = 255;
+                }
+
+                if (Format == VK_FORMAT_BC5_UNORM_BLOCK) {
+                    DecodeChannelBlock(pBlock + 8, Values);
+
+                    for (int i = 0; i < 16; i++) {
+                        Texels[i][1] = Values[i];
+                    }
+                }
+                break;
+
+            default:
+                return false;
+            }
+
+            // The blocks on the right and bottom edges may be partially outside
+            for (uint32_t y = 0; (y < 4) && (by * 4 + y < m.Height); y++) {
+                for (uint32_t x = 0; (x < 4) && (bx * 4 + x < m.Width); x++) {
+                    size_t Dst = ((size_t)(by * 4 + y) * m.Width + bx * 4 + x) * 4;
+                    memcpy(&Pixels[Dst], Texels[y * 4 + x], 4);
+                }
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,135 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "thread_pool.h"
+#include "texture_loader.h"
+#include "cpu_profiler.h"
+#include "stb/stb_image.h"
+
+
+TextureLoader::~TextureLoader()
+{
+    // The decoding jobs reference the requests so we can't leave before they are done
+    WaitForDecodes();
+
+    for (LoadRequest* pRequest : m_decoded) {
+        stbi_image_free(pRequest->pPixels);
+    }
+}
+
+
+Texture* TextureLoader::Find(const std::string& Filename) const
+{
+    std::map<std::string, Texture*>::const_iterator it = m_textures.find(Filename);
+
+    if (it == m_textures.end()) {
+        return NULL;
+    }
+
+    return it->second;
+}
+
+
+void TextureLoader::Request(const std::string& Filename, Texture* pTexture)
+{
+    assert(pTexture);
+    assert(!Find(Filename));
+
+    m_textures[Filename] = pTexture;
+
+    m_requests.push_back(std::make_unique<LoadRequest>());
+    LoadRequest* pRequest = m_requests.back().get();
+    pRequest->Filename = Filename;
+    pRequest->pTexture = pTexture;
+
+    {
+        std::lock_guard<std::mutex> Lock(m_mutex);
+        m_numPending++;
+    }
+
+    ThreadPool::Get().Submit([this, pRequest]() { Decode(pRequest); });
+}
+
+
+void TextureLoader::Decode(LoadRequest* pRequest)
+{
+    PROFILE_ZONE("Decode texture");
+
+    if (IsTextureContainerFile(pRequest->Filename)) {
+        pRequest->IsContainer = true;
+        pRequest->ContainerLoaded = LoadTextureContainer(pRequest->Filename, pRequest->Container);
+    }
+    else {
+        int ImageChannels = 0;
+
+        pRequest->pPixels = stbi_load(pRequest->Filename.c_str(), &pRequest->Width, &pRequest->Height, &ImageChannels, STBI_rgb_alpha);
+    }
+
+    // Notify under the lock - the loader may be destroyed as soon as it is released
+    std::lock_guard<std::mutex> Lock(m_mutex);
+    m_decoded.push_back(pRequest);
+    m_numPending--;
+    m_cond.notify_all();
+}
+
+
+void TextureLoader::WaitForDecodes()
+{
+    std::unique_lock<std::mutex> Lock(m_mutex);
+
+    m_cond.wait(Lock, [this] { return m_numPending == 0; });
+}
+
+
+void TextureLoader::Finish()
+{
+    int NumUploaded = 0;
+
+    while (true) {
+        LoadRequest* pRequest = NULL;
+
+        {
+            std::unique_lock<std::mutex> Lock(m_mutex);
+
+            m_cond.wait(Lock, [this] { return !m_decoded.empty() || (m_numPending == 0); });
+
+            if (m_decoded.empty()) {
+                break;  // nothing decoded and nothing pending
+            }
+
+            pRequest = m_decoded.front();
+            m_decoded.pop_front();
+        }
+
+        if (pRequest->IsContainer) {
+            if (!pRequest->ContainerLoaded) {
+                printf("Error loading texture from '%s'\n", pRequest->Filename.c_str());
+                exit(1);
+            }
+
+            pRequest->pTexture->LoadFromContainer(pRequest->Container);
+            printf("Texture from '%s' created\n", pRequest->Filename.c_str());
+
+            pRequest->Container = TextureContainer();
+        }
+        else {
+            if (!pRequest->pPixels) {
+                printf("Error loading texture from '%s'\n", pRequest->Filename.c_str());
+                exit(1);
+            }
+
+            pRequest->pTexture->LoadFromPixels(pRequest->Width, pRequest->Height, pRequest->pPixels);
+            printf("Texture from '%s' created\n", pRequest->Filename.c_str());
+
+            stbi_image_free(pRequest->pPixels);
+            pRequest->pPixels = NULL;
+        }
+
+        NumUploaded++;
+    }
+
+    printf("Uploaded %d textures\n", NumUploaded);
+
+    m_requests.clear();
+}
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <memory>
+
+#include "thread_pool.h"
+
+
+ThreadPool::ThreadPool(int NumThreads)
+{
+    if (NumThreads <= 0) {
+        NumThreads = (int)std::thread::hardware_concurrency() - 1;
+
+        if (NumThreads < 1) {
+            NumThreads = 1;
+        }
+    }
+
+    for (int i = 0; i < NumThreads; i++) {
+        m_threads.push_back(std::thread(&ThreadPool::WorkerThread, this));
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> Lock(m_mutex);
+        m_quit = true;
+    }
+
+    m_cond.notify_all();
+
+    for (std::thread& t : m_threads) {
+        t.join();
+    }
+}
+
+
+ThreadPool& ThreadPool::Get()
+{
+    static ThreadPool s_threadPool;
+
+    return s_threadPool;
+}
+
+
+void ThreadPool::WorkerThread()
+{
+    while (true) {
+        std::function<void()> Job;
+
+        {
+            std::unique_lock<std::mutex> Lock(m_mutex);
+
+            m_cond.wait(Lock, [this] { return m_quit || !m_jobs.empty(); });
+
+            if (m_jobs.empty()) {
+                return; // quitting
+            }
+
+            Job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+
+        Job();
+    }
+}
+
+
+void ThreadPool::Submit(std::function<void()> Job)
+{
+    {
+        std::lock_guard<std::mutex> Lock(m_mutex);
+        m_jobs.push_back(std::move(Job));
+    }
+
+    m_cond.notify_one();
+}
+
+
+void ThreadPool::ParallelFor(int Count, const std::function<void(int)>& Job)
+{
+    if (Count <= 0) {
+        return;
+    }
+
+    if (Count == 1) {
+        Job(0);
+        return;
+    }
+
+    // The state is shared with the helper jobs. A helper may only get to run
+    // after all the work has been done so it must outlive this function.
+    struct ParallelForState {
+        std::atomic<int> NextIndex = 0;
+        std::atomic<int> NumDone = 0;
+        int Count = 0;
+        const std::function<void(int)>* pJob = NULL;
+        std::mutex Mutex;
+        std::condition_variable Cond;
+    };
+
+    std::shared_ptr<ParallelForState> pState = std::make_shared<ParallelForState>();
+    pState->Count = Count;
+    pState->pJob = &Job;
+
+    auto RunJobs = [](ParallelForState& State) {
+        int Index = State.NextIndex.fetch_add(1);
+
+        while (Index < State.Count) {
+            (*State.pJob)(Index);
+
+            if (State.NumDone.fetch_add(1) + 1 == State.Count) {
+                std::lock_guard<std::mutex> Lock(State.Mutex);
+                State.Cond.notify_all();
+            }
+
+            Index = State.NextIndex.fetch_add(1);
+        }
+    };
+
+    int NumHelpers = std::min(Count - 1, GetNumThreads());
+
+    for (int i = 0; i < NumHelpers; i++) {
+        Submit([pState, RunJobs]() { RunJobs(*pState); });
+    }
+
+    RunJobs(*pState);
+
+    std::unique_lock<std::mutex> Lock(pState->Mutex);
+    pState->Cond.wait(Lock, [&pState] { return pState->NumDone.load() == pState->Count; });
+}
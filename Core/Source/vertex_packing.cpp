@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "vertex_packing.h"
+
+
+static float SignNotZero(float v)
+{
+    return (v >= 0.0f) ? 1.0f : -1.0f;
+}
+
+
+glm::vec2 OctahedralEncode(const glm::vec3& v)
+{
+    float L1Norm = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+
+    if (L1Norm == 0.0f) {
+        return glm::vec2(0.0f);
+    }
+
+    glm::vec2 e = glm::vec2(v.x, v.y) / L1Norm;
+
+    // Fold the lower hemisphere over the diagonals
+    if (v.z < 0.0f) {
+        e = glm::vec2((1.0f - fabsf(e.y)) * SignNotZero(e.x),
+                      (1.0f - fabsf(e.x)) * SignNotZero(e.y));
+    }
+
+    return e;
+}
+
+
+glm::vec3 OctahedralDecode(const glm::vec2& e)
+{
+    glm::vec3 v = glm::vec3(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+
+    float t = std::max(-v.z, 0.0f);
+    v.x += (v.x >= 0.0f) ? -t : t;
+    v.y += (v.y >= 0.0f) ? -t : t;
+
+    return glm::normalize(v);
+}
+
+
+static int16_t FloatToSnorm16(float v)
+{
+    v = std::min(std::max(v, -1.0f), 1.0f);
+
+    return (int16_t)roundf(v * 32767.0f);
+}
+
+
+static float Snorm16ToFloat(int16_t v)
+{
+    return std::max((float)v / 32767.0f, -1.0f);
+}
+
+
+PositionQuantizer::PositionQuantizer(const glm::vec3& MinPos, const glm::vec3& MaxPos)
+{
+    m_minPos = MinPos;
+    m_scale = (MaxPos - MinPos) / 65535.0f;
+}
+
+
+void PositionQuantizer::Quantize(const glm::vec3& Pos, uint16_t Quantized[3]) const
+{
+    for (int i = 0; i < 3; i++) {
+        float q = (m_scale[i] > 0.0f) ? (Pos[i] - m_minPos[i]) / m_scale[i] : 0.0f;
+        Quantized[i] = (uint16_t)std::min(std::max(roundf(q), 0.0f), 65535.0f);
+    }
+}
+
+
+glm::vec3 PositionQuantizer::Dequantize(const uint16_t Quantized[3]) const
+{
+    return m_minPos + glm::vec3(Quantized[0], Quantized[1], Quantized[2]) * m_scale;
+}
+
+
+glm::mat4 PositionQuantizer::GetDequantizeMatrix() const
+{
+    glm::mat4 Translation = glm::translate(glm::mat4(1.0f), m_minPos);
+
+    return glm::scale(Translation, m_scale);
+}
+
+
+PackedVertex PackVertex(const PositionQuantizer& Quantizer, const glm::vec3& Pos, const glm::vec2& TexCoords,
+                        const glm::vec3& Normal, const glm::vec3& Tangent, const glm::vec3& Bitangent)
+{
+    PackedVertex v;
+
+    Quantizer.Quantize(Pos, v.Position);
+
+    v.TexCoords[0] = glm::packHalf1x16(TexCoords.x);
+    v.TexCoords[1] = glm::packHalf1x16(TexCoords.y);
+
+    glm::vec2 n = OctahedralEncode(Normal);
+    v.Normal[0] = FloatToSnorm16(n.x);
+    v.Normal[1] = FloatToSnorm16(n.y);
+
+    glm::vec2 t = OctahedralEncode(Tangent);
+    v.Tangent[0] = FloatToSnorm16(t.x);
+    v.Tangent[1] = FloatToSnorm16(t.y);
+
+    v.BitangentSign = (glm::dot(glm::cross(Normal, Tangent), Bitangent) < 0.0f) ? 1 : 0;
+
+    return v;
+}
+
+
+static float AngleDeg(const glm::vec3& a, const glm::vec3& b)
+{
+    float LenA = glm::length(a);
+    float LenB = glm::length(b);
+
+    // Degenerate vectors (e.g. a mesh without tangents) are not counted
+    if ((LenA == 0.0f) || (LenB == 0.0f)) {
+        return 0.0f;
+    }
+
+    float CosAngle = std::min(std::max(glm::dot(a, b) / (LenA * LenB), -1.0f), 1.0f);
+
+    return glm::degrees(acosf(CosAngle));
+}
+
+
+void VertexQuantizationError::Add(const PositionQuantizer& Quantizer, const PackedVertex& Packed, const glm::vec3& Pos,
+                                  const glm::vec2& TexCoords, const glm::vec3& Normal, const glm::vec3& Tangent)
+{
+    float PosError = glm::length(Quantizer.Dequantize(Packed.Position) - Pos);
+    m_sumPosError += PosError;
+    m_maxPosError = std::max(m_maxPosError, PosError);
+
+    glm::vec2 DecodedTexCoords = glm::vec2(glm::unpackHalf1x16(Packed.TexCoords[0]), glm::unpackHalf1x16(Packed.TexCoords[1]));
+    glm::vec2 TexCoordError = glm::abs(DecodedTexCoords - TexCoords);
+    m_maxTexCoordError = std::max(m_maxTexCoordError, std::max(TexCoordError.x, TexCoordError.y));
+
+    glm::vec3 DecodedNormal = OctahedralDecode(glm::vec2(Snorm16ToFloat(Packed.Normal[0]), Snorm16ToFloat(Packed.Normal[1])));
+    m_maxNormalErrorDeg = std::max(m_maxNormalErrorDeg, AngleDeg(DecodedNormal, Normal));
+
+    glm::vec3 DecodedTangent = OctahedralDecode(glm::vec2(Snorm16ToFloat(Packed.Tangent[0]), Snorm16ToFloat(Packed.Tangent[1])));
+    m_maxTangentErrorDeg = std::max(m_maxTangentErrorDeg, AngleDeg(DecodedTangent, Tangent));
+
+    m_numVertices++;
+}
+
+
+void VertexQuantizationError::Print() const
+{
+    double AvgPosError = m_numVertices ? m_sumPosError / m_numVertices : 0.0;
+
+    printf("Vertex quantization error over %d vertices:\n", m_numVertices);
+    printf("    position: max %f avg %f\n", m_maxPosError, AvgPosError);
+    printf("    texcoords: max %f\n", m_maxTexCoordError);
+    printf("    normal: max %f degrees\n", m_maxNormalErrorDeg);
+    printf("    tangent: max %f degrees\n", m_maxTangentErrorDeg);
+}
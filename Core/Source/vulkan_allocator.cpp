@@ -0,0 +1,285 @@
+#include <assert.h>
+#include <algorithm>
+
+#include "vulkan_util.h"
+#include "vulkan_allocator.h"
+
+namespace Engine {
+
+	static VkDeviceSize AlignUp(VkDeviceSize Value, VkDeviceSize Alignment)
+	{
+		return (Value + Alignment - 1) & ~(Alignment - 1);
+	}
+
+
+	void VulkanAllocator::Init(VkDevice Device, const VkPhysicalDeviceMemoryProperties& MemProps, VkDeviceSize BlockSize)
+	{
+		m_device = Device;
+		m_memProps = MemProps;
+		m_blockSize = BlockSize;
+
+		printf("Memory allocator initialized with a block size of %d bytes\n", (int)BlockSize);
+	}
+
+
+	void VulkanAllocator::Destroy()
+	{
+		PrintStats();
+
+		for (MemoryBlock& Block : m_blocks) {
+			if (Block.m_numAllocations > 0) {
+				printf("Warning! memory block of type %d still has %d allocations\n",
+					Block.m_memoryTypeIndex, Block.m_numAllocations);
+			}
+
+			ReleaseBlock(Block);
+		}
+
+		m_blocks.clear();
+	}
+
+
+	VulkanAllocation VulkanAllocator::Allocate(const VkMemoryRequirements& MemReqs, uint32_t MemoryTypeIndex, bool IsLinear)
+	{
+		std::lock_guard<std::mutex> Lock(m_mutex);
+
+		VulkanAllocation Allocation;
+		Allocation.m_size = MemReqs.size;
+		Allocation.m_pAllocator = this;
+
+		VkDeviceSize Offset = 0;
+		int BlockIndex = -1;
+
+		// Large resources get a block of their own
+		if (MemReqs.size > m_blockSize / 2) {
+			BlockIndex = CreateBlock(MemReqs.size, MemoryTypeIndex, IsLinear, true);
+			AllocateFromBlock(m_blocks[BlockIndex], MemReqs.size, MemReqs.alignment, Offset);
+		}
+		else {
+			for (int i = 0; i < (int)m_blocks.size(); i++) {
+				MemoryBlock& Block = m_blocks[i];
+
+				if (Block.m_mem && !Block.m_isDedicated &&
+					(Block.m_memoryTypeIndex == MemoryTypeIndex) && (Block.m_isLinear == IsLinear) &&
+					AllocateFromBlock(Block, MemReqs.size, MemReqs.alignment, Offset)) {
+					BlockIndex = i;
+					break;
+				}
+			}
+
+			if (BlockIndex == -1) {
+				BlockIndex = CreateBlock(m_blockSize, MemoryTypeIndex, IsLinear, false);
+				bool Success = AllocateFromBlock(m_blocks[BlockIndex], MemReqs.size, MemReqs.alignment, Offset);
+				assert(Success);
+			}
+		}
+
+		MemoryBlock& Block = m_blocks[BlockIndex];
+		Block.m_numAllocations++;
+
+		Allocation.m_mem = Block.m_mem;
+		Allocation.m_offset = Offset;
+		Allocation.m_blockIndex = BlockIndex;
+
+		if (Block.m_pMapped) {
+			Allocation.m_pMapped = (char*)Block.m_pMapped + Offset;
+		}
+
+		m_bytesUsed += MemReqs.size;
+		m_numAllocations++;
+
+		return Allocation;
+	}
+
+
+	void VulkanAllocator::Free(VulkanAllocation& Allocation)
+	{
+		if (Allocation.m_blockIndex == -1) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> Lock(m_mutex);
+
+		MemoryBlock& Block = m_blocks[Allocation.m_blockIndex];
+		assert(Block.m_mem == Allocation.m_mem);
+
+		// Insert the range back in offset order and merge it with its neighbours
+		std::vector<FreeRange>& FreeList = Block.m_freeList;
+
+		size_t i = 0;
+		while ((i < FreeList.size()) && (FreeList[i].Offset < Allocation.m_offset)) {
+			i++;
+		}
+
+		FreeRange Range = { .Offset = Allocation.m_offset, .Size = Allocation.m_size };
+		FreeList.insert(FreeList.begin() + i, Range);
+
+		if ((i + 1 < FreeList.size()) && (FreeList[i].Offset + FreeList[i].Size == FreeList[i + 1].Offset)) {
+			FreeList[i].Size += FreeList[i + 1].Size;
+			FreeList.erase(FreeList.begin() + i + 1);
+		}
+
+		if ((i > 0) && (FreeList[i - 1].Offset + FreeList[i - 1].Size == FreeList[i].Offset)) {
+			FreeList[i - 1].Size += FreeList[i].Size;
+			FreeList.erase(FreeList.begin() + i);
+		}
+
+		Block.m_numAllocations--;
+		m_bytesUsed -= Allocation.m_size;
+		m_numAllocations--;
+
+		// Regular blocks are kept around for future allocations
+		if (Block.m_isDedicated && (Block.m_numAllocations == 0)) {
+			ReleaseBlock(Block);
+		}
+
+		Allocation = VulkanAllocation();
+	}
+
+
+	bool VulkanAllocator::AllocateFromBlock(MemoryBlock& Block, VkDeviceSize Size, VkDeviceSize Alignment, VkDeviceSize& Offset)
+	{
+		std::vector<FreeRange>& FreeList = Block.m_freeList;
+
+		for (size_t i = 0; i < FreeList.size(); i++) {
+			FreeRange& Range = FreeList[i];
+
+			VkDeviceSize AlignedOffset = AlignUp(Range.Offset, Alignment);
+			VkDeviceSize Padding = AlignedOffset - Range.Offset;
+
+			if (Padding + Size > Range.Size) {
+				continue;
+			}
+
+			Offset = AlignedOffset;
+
+			VkDeviceSize RangeEnd = Range.Offset + Range.Size;
+
+			if (Padding > 0) {
+				// Keep the padding as a separate free range in front of the allocation
+				Range.Size = Padding;
+
+				if (AlignedOffset + Size < RangeEnd) {
+					FreeRange Tail = { .Offset = AlignedOffset + Size, .Size = RangeEnd - (AlignedOffset + Size) };
+					FreeList.insert(FreeList.begin() + i + 1, Tail);
+				}
+			}
+			else if (Size < Range.Size) {
+				Range.Offset += Size;
+				Range.Size -= Size;
+			}
+			else {
+				FreeList.erase(FreeList.begin() + i);
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+
+	int VulkanAllocator::CreateBlock(VkDeviceSize Size, uint32_t MemoryTypeIndex, bool IsLinear, bool IsDedicated)
+	{
+		VkMemoryAllocateInfo MemAllocInfo = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.pNext = NULL,
+			.allocationSize = Size,
+			.memoryTypeIndex = MemoryTypeIndex
+		};
+
+		MemoryBlock Block;
+		VkResult res = vkAllocateMemory(m_device, &MemAllocInfo, NULL, &Block.m_mem);
+		CHECK_VK_RESULT(res, "vkAllocateMemory error %d\n");
+
+		Block.m_size = Size;
+		Block.m_memoryTypeIndex = MemoryTypeIndex;
+		Block.m_isLinear = IsLinear;
+		Block.m_isDedicated = IsDedicated;
+		Block.m_freeList.push_back(FreeRange{ .Offset = 0, .Size = Size });
+
+		if (m_memProps.memoryTypes[MemoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+			res = vkMapMemory(m_device, Block.m_mem, 0, VK_WHOLE_SIZE, 0, &Block.m_pMapped);
+			CHECK_VK_RESULT(res, "vkMapMemory\n");
+		}
+
+		printf("Allocated memory block of %d bytes, memory type %d%s\n", (int)Size, MemoryTypeIndex,
+			IsDedicated ? " (dedicated)" : "");
+
+		int BlockIndex = -1;
+
+		for (int i = 0; i < (int)m_blocks.size(); i++) {
+			if (m_blocks[i].m_mem == VK_NULL_HANDLE) {
+				BlockIndex = i;
+				break;
+			}
+		}
+
+		if (BlockIndex == -1) {
+			BlockIndex = (int)m_blocks.size();
+			m_blocks.push_back(Block);
+		}
+		else {
+			m_blocks[BlockIndex] = Block;
+		}
+
+		int NumBlocks = 0;
+
+		for (const MemoryBlock& b : m_blocks) {
+			if (b.m_mem) {
+				NumBlocks++;
+			}
+		}
+
+		m_maxNumBlocks = std::max(m_maxNumBlocks, NumBlocks);
+
+		return BlockIndex;
+	}
+
+
+	void VulkanAllocator::ReleaseBlock(MemoryBlock& Block)
+	{
+		if (!Block.m_mem) {
+			return;
+		}
+
+		if (Block.m_pMapped) {
+			vkUnmapMemory(m_device, Block.m_mem);
+		}
+
+		vkFreeMemory(m_device, Block.m_mem, NULL);
+
+		Block = MemoryBlock();
+	}
+
+
+	VulkanAllocator::Stats VulkanAllocator::GetStats() const
+	{
+		std::lock_guard<std::mutex> Lock(m_mutex);
+
+		Stats s;
+
+		for (const MemoryBlock& Block : m_blocks) {
+			if (Block.m_mem) {
+				s.NumBlocks++;
+				s.BytesReserved += Block.m_size;
+			}
+		}
+
+		s.NumAllocations = m_numAllocations;
+		s.BytesUsed = m_bytesUsed;
+		s.MaxNumBlocks = m_maxNumBlocks;
+
+		return s;
+	}
+
+
+	void VulkanAllocator::PrintStats() const
+	{
+		Stats s = GetStats();
+
+		printf("Memory allocator: %d allocations in %d blocks (max %d), %.2f MB used out of %.2f MB\n",
+			s.NumAllocations, s.NumBlocks, s.MaxNumBlocks,
+			(double)s.BytesUsed / (1024.0 * 1024.0), (double)s.BytesReserved / (1024.0 * 1024.0));
+	}
+}
@@ -0,0 +1,194 @@
+#include <assert.h>
+
+#include "util.h"
+#include "vulkan_util.h"
+#include "vulkan_core.h"
+#include "vulkan_command_recorder.h"
+#include "thread_pool.h"
+
+namespace Engine {
+
+// Slices with fewer draws cost more in vkCmdExecuteCommands/state setup than they save
+#define MIN_ITEMS_PER_SLICE 16
+
+	void VulkanCommandRecorder::Init(VulkanCore* pVulkanCore, int NumImages, int NumSlices)
+	{
+		m_device = pVulkanCore->GetDevice();
+		m_numSlices = (NumSlices > 0) ? NumSlices : ThreadPool::Get().GetNumThreads() + 1;
+
+		uint32_t QueueFamily = pVulkanCore->GetQueueFamily();
+
+		m_slices.resize(NumImages);
+
+		for (std::vector<TransientBuffer>& ImageSlices : m_slices) {
+			ImageSlices.resize(m_numSlices);
+
+			for (TransientBuffer& s : ImageSlices) {
+				CreateTransientBuffer(QueueFamily, VK_COMMAND_BUFFER_LEVEL_SECONDARY, s);
+			}
+		}
+
+		m_primaries.resize(NumImages);
+
+		for (TransientBuffer& p : m_primaries) {
+			CreateTransientBuffer(QueueFamily, VK_COMMAND_BUFFER_LEVEL_PRIMARY, p);
+		}
+
+		m_executeList.reserve(m_numSlices);
+
+		printf("Command recorder created: %d images, %d slices per image\n", NumImages, m_numSlices);
+	}
+
+
+	// Transient - the buffers are re-recorded every frame and reset with the whole pool
+	void VulkanCommandRecorder::CreateTransientBuffer(uint32_t QueueFamily, VkCommandBufferLevel Level, TransientBuffer& Buffer)
+	{
+		VkCommandPoolCreateInfo PoolCreateInfo = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.pNext = NULL,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			.queueFamilyIndex = QueueFamily
+		};
+
+		VkResult res = vkCreateCommandPool(m_device, &PoolCreateInfo, NULL, &Buffer.m_pool);
+		CHECK_VK_RESULT(res, "vkCreateCommandPool\n");
+
+		VkCommandBufferAllocateInfo AllocInfo = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.pNext = NULL,
+			.commandPool = Buffer.m_pool,
+			.level = Level,
+			.commandBufferCount = 1
+		};
+
+		res = vkAllocateCommandBuffers(m_device, &AllocInfo, &Buffer.m_cmdBuf);
+		CHECK_VK_RESULT(res, "vkAllocateCommandBuffers\n");
+	}
+
+
+	void VulkanCommandRecorder::Destroy()
+	{
+		if (m_device == VK_NULL_HANDLE) {
+			return;	// never initialized
+		}
+
+		// The buffers are freed with their pools
+		for (std::vector<TransientBuffer>& ImageSlices : m_slices) {
+			for (TransientBuffer& s : ImageSlices) {
+				vkDestroyCommandPool(m_device, s.m_pool, NULL);
+			}
+		}
+
+		for (TransientBuffer& p : m_primaries) {
+			vkDestroyCommandPool(m_device, p.m_pool, NULL);
+		}
+
+		m_slices.clear();
+		m_primaries.clear();
+	}
+
+
+	VkCommandBuffer VulkanCommandRecorder::BeginPrimary(int ImageIndex)
+	{
+		assert(ImageIndex < (int)m_primaries.size());
+
+		m_recordStartTime = std::chrono::steady_clock::now();
+
+		TransientBuffer& p = m_primaries[ImageIndex];
+
+		// Cheaper than resetting the buffer - the pool keeps its memory for the next recording
+		VkResult res = vkResetCommandPool(m_device, p.m_pool, 0);
+		CHECK_VK_RESULT(res, "vkResetCommandPool\n");
+
+		VkCommandBufferBeginInfo BeginInfo = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.pNext = NULL,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+			.pInheritanceInfo = NULL
+		};
+
+		res = vkBeginCommandBuffer(p.m_cmdBuf, &BeginInfo);
+		CHECK_VK_RESULT(res, "vkBeginCommandBuffer\n");
+
+		return p.m_cmdBuf;
+	}
+
+
+	void VulkanCommandRecorder::EndPrimary(int ImageIndex)
+	{
+		assert(ImageIndex < (int)m_primaries.size());
+
+		VkResult res = vkEndCommandBuffer(m_primaries[ImageIndex].m_cmdBuf);
+		CHECK_VK_RESULT(res, "vkEndCommandBuffer\n");
+
+		std::chrono::duration<float, std::milli> Duration = std::chrono::steady_clock::now() - m_recordStartTime;
+		m_lastRecordTime = Duration.count();
+	}
+
+
+	void VulkanCommandRecorder::Record(VkCommandBuffer PrimaryCmdBuf, int ImageIndex, VkRenderPass RenderPass,
+		VkFramebuffer Framebuffer, int NumItems, const RecordFunc& Func)
+	{
+		assert(ImageIndex < (int)m_slices.size());
+
+		std::vector<TransientBuffer>& ImageSlices = m_slices[ImageIndex];
+
+		int NumUsedSlices = (NumItems + MIN_ITEMS_PER_SLICE - 1) / MIN_ITEMS_PER_SLICE;
+		NumUsedSlices = (NumUsedSlices < m_numSlices) ? NumUsedSlices : m_numSlices;
+
+		int ItemsPerSlice = (NumUsedSlices > 0) ? (NumItems + NumUsedSlices - 1) / NumUsedSlices : 0;
+
+		VkCommandBufferInheritanceInfo InheritanceInfo = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+			.pNext = NULL,
+			.renderPass = RenderPass,
+			.subpass = 0,
+			.framebuffer = Framebuffer,
+			.occlusionQueryEnable = VK_FALSE,
+			.queryFlags = 0,
+			.pipelineStatistics = 0
+		};
+
+		// The image fence was waited on by AcquireNextImage() so the GPU is done with these buffers
+		ThreadPool::Get().ParallelFor(NumUsedSlices, [&](int SliceIndex) {
+			TransientBuffer& s = ImageSlices[SliceIndex];
+
+			VkResult res = vkResetCommandPool(m_device, s.m_pool, 0);
+			CHECK_VK_RESULT(res, "vkResetCommandPool\n");
+
+			VkCommandBufferBeginInfo BeginInfo = {
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+				.pNext = NULL,
+				.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+				.pInheritanceInfo = &InheritanceInfo
+			};
+
+			res = vkBeginCommandBuffer(s.m_cmdBuf, &BeginInfo);
+			CHECK_VK_RESULT(res, "vkBeginCommandBuffer\n");
+
+			int First = SliceIndex * ItemsPerSlice;
+			int Count = (First + ItemsPerSlice <= NumItems) ? ItemsPerSlice : NumItems - First;
+
+			if (Count > 0) {
+				Func(s.m_cmdBuf, First, Count);
+			}
+
+			res = vkEndCommandBuffer(s.m_cmdBuf);
+			CHECK_VK_RESULT(res, "vkEndCommandBuffer\n");
+		});
+
+		// Executed in slice order so the draw order doesn't depend on the threads
+		m_executeList.clear();
+
+		for (int i = 0; i < NumUsedSlices; i++) {
+			m_executeList.push_back(ImageSlices[i].m_cmdBuf);
+		}
+
+		if (!m_executeList.empty()) {
+			vkCmdExecuteCommands(PrimaryCmdBuf, (uint32_t)m_executeList.size(), m_executeList.data());
+		}
+
+		m_numUsedSlices = NumUsedSlices;
+	}
+
+}
@@ -1,5 +1,9 @@
 #include <vector>
+#include <filesystem>
+#include <algorithm>
 #include <assert.h>
+#include <string.h>
+#include <math.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
@@ -8,9 +12,18 @@
 #include "vulkan_core.h"
 #include "vulkan_util.h"
 #include "vulkan_wrapper.h"
+#include "cpu_profiler.h"
 
 namespace Engine {
 
+#define FRAME_ALLOCATOR_SIZE (4 * 1024 * 1024)
+#define UPLOAD_RING_SIZE (64 * 1024 * 1024)
+#define MAX_TEXTURE_ANISOTROPY 16.0f
+#define MIN_BUDGET_TEXTURE_SIZE 64
+#define PIPELINE_CACHE_FILENAME "pipeline_cache.bin"
+#define HEADLESS_NUM_IMAGES (MAX_FRAMES_IN_FLIGHT + 1)
+#define HEADLESS_COLOR_FORMAT VK_FORMAT_R8G8B8A8_SRGB
+
 	static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(
 		VkDebugUtilsMessageSeverityFlagBitsEXT Severity,
 		VkDebugUtilsMessageTypeFlagsEXT Type,
@@ -45,14 +58,32 @@ namespace Engine {
 	{
 		printf("-------------------------------\n");
 
-		vkFreeCommandBuffers(m_device, m_cmdBufPool, 1, &m_copyCmdBuf);
+		// Frames may still be in flight
+		m_queue.WaitIdle();
+
+		m_frameAllocator.Destroy();
+
+		m_commandRecorder.Destroy();
+
+		m_uploader.Destroy();
+
+		// After the uploader which collects its last batches on the way out
+		m_gpuProfiler.Destroy();
 
 		vkDestroyCommandPool(m_device, m_cmdBufPool, NULL);
 
 		m_queue.Destroy();
 
-		for (int i = 0; i < m_imageViews.size(); i++) {
-			vkDestroyImageView(m_device, m_imageViews[i], NULL);
+		if (m_headless) {
+			// The views are destroyed with the images
+			for (int i = 0; i < m_offscreenImages.size(); i++) {
+				m_offscreenImages[i].Destroy(m_device);
+			}
+		}
+		else {
+			for (int i = 0; i < m_imageViews.size(); i++) {
+				vkDestroyImageView(m_device, m_imageViews[i], NULL);
+			}
 		}
 
 		if (m_depthEnabled) {
@@ -61,20 +92,34 @@ namespace Engine {
 			}
 		}
 
-		vkDestroySwapchainKHR(m_device, m_swapChain, NULL);
+		if (m_swapChain) {
+			vkDestroySwapchainKHR(m_device, m_swapChain, NULL);
+		}
 
-		vkDestroyDevice(m_device, NULL);
+		m_textureTable.Destroy();
 
-		PFN_vkDestroySurfaceKHR vkDestroySurface = VK_NULL_HANDLE;
-		vkDestroySurface = (PFN_vkDestroySurfaceKHR)vkGetInstanceProcAddr(m_instance, "vkDestroySurfaceKHR");
-		if (!vkDestroySurface) {
-			MY_ERROR("Cannot find address of vkDestroySurfaceKHR\n");
-			exit(1);
+		m_allocator.Destroy();
+
+		if (m_pipelineCache) {
+			SavePipelineCache();
+			vkDestroyPipelineCache(m_device, m_pipelineCache, NULL);
 		}
 
-		vkDestroySurface(m_instance, m_surface, NULL);
+		vkDestroyDevice(m_device, NULL);
+
+		// The surface extensions are not enabled in headless mode
+		if (m_surface) {
+			PFN_vkDestroySurfaceKHR vkDestroySurface = VK_NULL_HANDLE;
+			vkDestroySurface = (PFN_vkDestroySurfaceKHR)vkGetInstanceProcAddr(m_instance, "vkDestroySurfaceKHR");
+			if (!vkDestroySurface) {
+				MY_ERROR("Cannot find address of vkDestroySurfaceKHR\n");
+				exit(1);
+			}
+
+			vkDestroySurface(m_instance, m_surface, NULL);
 
-		printf("GLFW window surface destroyed\n");
+			printf("GLFW window surface destroyed\n");
+		}
 
 		PFN_vkDestroyDebugUtilsMessengerEXT vkDestroyDebugUtilsMessenger = VK_NULL_HANDLE;
 		vkDestroyDebugUtilsMessenger = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(m_instance, "vkDestroyDebugUtilsMessengerEXT");
@@ -105,14 +150,50 @@ namespace Engine {
 		CreateSurface();
 		m_physDevices.Init(m_instance, m_surface);
 		m_queueFamily = m_physDevices.SelectDevice(VK_QUEUE_GRAPHICS_BIT, true);
+		InitDevice();
+	}
+
+
+	void VulkanCore::InitHeadless(const char* pAppName, int Width, int Height, bool DepthEnabled)
+	{
+		m_headless = true;
+		m_depthEnabled = DepthEnabled;
+		m_windowWidth = Width;
+		m_windowHeight = Height;
+		CreateInstance(pAppName);
+		CreateDebugCallback();
+		m_physDevices.Init(m_instance, VK_NULL_HANDLE);
+		// Compute too so that the same device can run the benchmarks that need it
+		m_queueFamily = m_physDevices.SelectDevice(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, false);
+		InitDevice();
+	}
+
+
+	// Everything that follows the selection of the physical device. The images
+	// come either from the swapchain or from CreateOffscreenImages().
+	void VulkanCore::InitDevice()
+	{
 		CreateDevice();
-		CreateSwapChain();
+		CreatePipelineCache();
+		m_allocator.Init(m_device, m_physDevices.Selected().m_memProps);
+		m_textureTable.Init(m_device);
+		if (m_headless) {
+			CreateOffscreenImages();
+		}
+		else {
+			CreateSwapChain();
+		}
 		CreateCommandBufferPool();
-		m_queue.Init(m_device, m_swapChain, m_queueFamily, 0);
-		CreateCommandBuffers(1, &m_copyCmdBuf);
-		if (DepthEnabled) {
+		// m_swapChain is VK_NULL_HANDLE in headless mode
+		m_queue.Init(m_device, m_swapChain, m_queueFamily, 0, (int)m_images.size());
+		m_gpuProfiler.Init(this, (int)m_images.size() + NUM_UPLOAD_BATCHES);
+		m_uploader.Init(this, UPLOAD_RING_SIZE);
+		m_frameAllocator.Init(this, (int)m_images.size(), FRAME_ALLOCATOR_SIZE);
+		m_commandRecorder.Init(this, (int)m_images.size());
+		if (m_depthEnabled) {
 			CreateDepthResources();
 		}
+		FlushUploads();
 	}
 
 
@@ -126,25 +207,143 @@ namespace Engine {
 		return m_images[Index];
 	}
 
-	void VulkanCore::CreateInstance(const char* pAppName)
+
+	void VulkanCore::ReadImage(int Index, std::vector<uint8_t>& Pixels)
 	{
-		std::vector<const char*> Layers = {
-			"VK_LAYER_KHRONOS_validation"
+		// Swapchain images are not created with TRANSFER_SRC
+		if (!m_headless) {
+			MY_ERROR("Images can be read only in headless mode\n");
+			exit(1);
+		}
+
+		VkImage Image = GetImage(Index);
+
+		VkDeviceSize Size = (VkDeviceSize)m_windowWidth * m_windowHeight * 4;
+
+		BufferAndMemory Buffer = CreateBuffer(Size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		VkCommandBuffer CmdBuf = VK_NULL_HANDLE;
+		CreateCommandBuffers(1, &CmdBuf);
+
+		BeginCommandBuffer(CmdBuf, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+		// The render pass has already moved the image to TRANSFER_SRC - only the writes must be made visible
+		VkImageMemoryBarrier ImageBarrier = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.pNext = NULL,
+			.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = Image,
+			.subresourceRange = VkImageSubresourceRange {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = 0,
+				.levelCount = 1,
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			}
 		};
 
+		vkCmdPipelineBarrier(CmdBuf, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, NULL, 0, NULL, 1, &ImageBarrier);
+
+		VkBufferImageCopy Region = {
+			.bufferOffset = 0,
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource = VkImageSubresourceLayers {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.mipLevel = 0,
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			},
+			.imageOffset = VkOffset3D {.x = 0, .y = 0, .z = 0 },
+			.imageExtent = VkExtent3D {.width = (uint32_t)m_windowWidth, .height = (uint32_t)m_windowHeight, .depth = 1 }
+		};
+
+		vkCmdCopyImageToBuffer(CmdBuf, Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, Buffer.m_buffer, 1, &Region);
+
+		VkBufferMemoryBarrier BufferBarrier = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.pNext = NULL,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = Buffer.m_buffer,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE
+		};
+
+		vkCmdPipelineBarrier(CmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+			0, 0, NULL, 1, &BufferBarrier, 0, NULL);
+
+		VkResult res = vkEndCommandBuffer(CmdBuf);
+		CHECK_VK_RESULT(res, "vkEndCommandBuffer\n");
+
+		m_queue.SubmitSync(CmdBuf);
+		m_queue.WaitIdle();
+
+		Pixels.resize(Size);
+		memcpy(Pixels.data(), Buffer.m_mem.m_pMapped, Size);
+
+		FreeCommandBuffers(1, &CmdBuf);
+		Buffer.Destroy(m_device);
+	}
+
+	static bool IsInstanceLayerSupported(const char* pLayerName)
+	{
+		uint32_t NumLayers = 0;
+		VkResult res = vkEnumerateInstanceLayerProperties(&NumLayers, NULL);
+		CHECK_VK_RESULT(res, "vkEnumerateInstanceLayerProperties\n");
+
+		std::vector<VkLayerProperties> LayerProps(NumLayers);
+		res = vkEnumerateInstanceLayerProperties(&NumLayers, LayerProps.data());
+		CHECK_VK_RESULT(res, "vkEnumerateInstanceLayerProperties\n");
+
+		for (const VkLayerProperties& Props : LayerProps) {
+			if (strcmp(Props.layerName, pLayerName) == 0) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+
+	void VulkanCore::CreateInstance(const char* pAppName)
+	{
+		std::vector<const char*> Layers;
+
+		// Servers and CI machines often have a driver but not the SDK
+		if (IsInstanceLayerSupported("VK_LAYER_KHRONOS_validation")) {
+			Layers.push_back("VK_LAYER_KHRONOS_validation");
+		}
+		else {
+			printf("The validation layer is not installed - running without it\n");
+		}
+
 		std::vector<const char*> Extensions = {
-			VK_KHR_SURFACE_EXTENSION_NAME,
+			VK_EXT_DEBUG_UTILS_EXTENSION_NAME
+		};
+
+		// A headless instance doesn't depend on the window system
+		if (!m_headless) {
+			Extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
 	#if defined (_WIN32)
-			"VK_KHR_win32_surface",
+			Extensions.push_back("VK_KHR_win32_surface");
 	#endif
 	#if defined (__APPLE__)
-			"VK_MVK_macos_surface",
+			Extensions.push_back("VK_MVK_macos_surface");
 	#endif
 	#if defined (__linux__)
-			"VK_KHR_xcb_surface",
+			Extensions.push_back("VK_KHR_xcb_surface");
 	#endif
-			VK_EXT_DEBUG_UTILS_EXTENSION_NAME,
-		};
+		}
 
 		VkDebugUtilsMessengerCreateInfoEXT MessengerCreateInfo = {
 			.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
@@ -167,7 +366,7 @@ namespace Engine {
 			.applicationVersion = VK_MAKE_API_VERSION(0, 1, 0, 0),
 			.pEngineName = "Ogldev Vulkan Tutorials",
 			.engineVersion = VK_MAKE_API_VERSION(0, 1, 0, 0),
-			.apiVersion = VK_API_VERSION_1_0
+			.apiVersion = VK_API_VERSION_1_2
 		};
 
 		VkInstanceCreateInfo CreateInfo = {
@@ -240,10 +439,13 @@ namespace Engine {
 		};
 
 		std::vector<const char*> DevExts = {
-			VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 			VK_KHR_SHADER_DRAW_PARAMETERS_EXTENSION_NAME
 		};
 
+		if (!m_headless) {
+			DevExts.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+		}
+
 		if (m_physDevices.Selected().m_features.geometryShader == VK_FALSE) {
 			MY_ERROR("The Geometry Shader is not supported!\n");
 		}
@@ -252,13 +454,64 @@ namespace Engine {
 			MY_ERROR("The Tessellation Shader is not supported!\n");
 		}
 
+		if (m_physDevices.Selected().m_features.multiDrawIndirect == VK_FALSE) {
+			MY_ERROR("Multi draw indirect is not supported!\n");
+		}
+
+		if (m_physDevices.Selected().m_features.drawIndirectFirstInstance == VK_FALSE) {
+			MY_ERROR("Draw indirect with a first instance is not supported!\n");
+		}
+
+		if (m_physDevices.Selected().m_features.shaderSampledImageArrayDynamicIndexing == VK_FALSE) {
+			MY_ERROR("Dynamic indexing of sampler arrays is not supported!\n");
+		}
+
+		const VkPhysicalDeviceVulkan12Features& SupportedFeatures12 = m_physDevices.Selected().m_features12;
+
+		if (!SupportedFeatures12.descriptorIndexing ||
+			!SupportedFeatures12.runtimeDescriptorArray ||
+			!SupportedFeatures12.descriptorBindingPartiallyBound ||
+			!SupportedFeatures12.descriptorBindingSampledImageUpdateAfterBind ||
+			!SupportedFeatures12.descriptorBindingUpdateUnusedWhilePending ||
+			!SupportedFeatures12.shaderSampledImageArrayNonUniformIndexing) {
+			MY_ERROR("Descriptor indexing is not supported!\n");
+		}
+
+		if (!SupportedFeatures12.drawIndirectCount) {
+			MY_ERROR("Draw indirect count is not supported!\n");
+		}
+
+		// Required by the bindless texture table
+		VkPhysicalDeviceVulkan12Features DeviceFeatures12 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+		DeviceFeatures12.descriptorIndexing = VK_TRUE;
+		DeviceFeatures12.runtimeDescriptorArray = VK_TRUE;
+		DeviceFeatures12.descriptorBindingPartiallyBound = VK_TRUE;
+		DeviceFeatures12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		DeviceFeatures12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+		DeviceFeatures12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+		// Required by the culled indirect draws
+		DeviceFeatures12.drawIndirectCount = VK_TRUE;
+
 		VkPhysicalDeviceFeatures DeviceFeatures = { 0 };
 		DeviceFeatures.geometryShader = VK_TRUE;
 		DeviceFeatures.tessellationShader = VK_TRUE;
+		DeviceFeatures.multiDrawIndirect = VK_TRUE;
+		DeviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+		// Optional - only used for benchmarking
+		DeviceFeatures.pipelineStatisticsQuery = m_physDevices.Selected().m_features.pipelineStatisticsQuery;
+		DeviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+		// Optional - BC textures are decoded on the CPU without it
+		DeviceFeatures.textureCompressionBC = m_physDevices.Selected().m_features.textureCompressionBC;
+		// Optional - the texture samplers fall back to isotropic filtering
+		DeviceFeatures.samplerAnisotropy = m_physDevices.Selected().m_features.samplerAnisotropy;
+
+		if (DeviceFeatures.samplerAnisotropy) {
+			m_maxAnisotropy = std::min(MAX_TEXTURE_ANISOTROPY, m_physDevices.Selected().m_devProps.limits.maxSamplerAnisotropy);
+		}
 
 		VkDeviceCreateInfo DeviceCreateInfo = {
 			.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-			.pNext = NULL,
+			.pNext = &DeviceFeatures12,
 			.flags = 0,
 			.queueCreateInfoCount = 1,
 			.pQueueCreateInfos = &qInfo,
@@ -305,6 +558,25 @@ namespace Engine {
 	}
 
 
+	// Some platforms let the swapchain decide the size (currentExtent is 0xFFFFFFFF)
+	static VkExtent2D ChooseSwapChainExtent(const VkSurfaceCapabilitiesKHR& Capabilities, GLFWwindow* pWindow)
+	{
+		if (Capabilities.currentExtent.width != 0xFFFFFFFF) {
+			return Capabilities.currentExtent;
+		}
+
+		int Width = 0, Height = 0;
+		glfwGetFramebufferSize(pWindow, &Width, &Height);
+
+		VkExtent2D Extent = {
+			.width = std::clamp((uint32_t)Width, Capabilities.minImageExtent.width, Capabilities.maxImageExtent.width),
+			.height = std::clamp((uint32_t)Height, Capabilities.minImageExtent.height, Capabilities.maxImageExtent.height)
+		};
+
+		return Extent;
+	}
+
+
 	static VkSurfaceFormatKHR ChooseSurfaceFormatAndColorSpace(const std::vector<VkSurfaceFormatKHR>& SurfaceFormats)
 	{
 		for (int i = 0; i < SurfaceFormats.size(); i++) {
@@ -319,9 +591,129 @@ namespace Engine {
 
 
 
-	void VulkanCore::CreateSwapChain()
+	// The driver validates the data too but some drivers don't do it very well so
+	// data from another device or driver version is dropped here
+	static bool IsPipelineCacheCompatible(const std::vector<char>& Data, const VkPhysicalDeviceProperties& Props)
+	{
+		if (Data.size() < sizeof(VkPipelineCacheHeaderVersionOne)) {
+			return false;
+		}
+
+		VkPipelineCacheHeaderVersionOne Header;
+		memcpy(&Header, Data.data(), sizeof(Header));
+
+		return (Header.headerSize >= sizeof(Header)) &&
+			(Header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE) &&
+			(Header.vendorID == Props.vendorID) &&
+			(Header.deviceID == Props.deviceID) &&
+			(memcmp(Header.pipelineCacheUUID, Props.pipelineCacheUUID, VK_UUID_SIZE) == 0);
+	}
+
+
+	void VulkanCore::CreatePipelineCache()
+	{
+		std::vector<char> Data;
+
+		FILE* f = fopen(PIPELINE_CACHE_FILENAME, "rb");
+
+		if (f) {
+			fseek(f, 0, SEEK_END);
+			long Size = ftell(f);
+			fseek(f, 0, SEEK_SET);
+
+			if (Size > 0) {
+				Data.resize(Size);
+
+				if (fread(Data.data(), Size, 1, f) != 1) {
+					Data.clear();
+				}
+			}
+
+			fclose(f);
+		}
+
+		if (!Data.empty() && !IsPipelineCacheCompatible(Data, m_physDevices.Selected().m_devProps)) {
+			printf("Pipeline cache '%s' was created by another device or driver - ignored\n", PIPELINE_CACHE_FILENAME);
+			Data.clear();
+		}
+
+		VkPipelineCacheCreateInfo CacheCreateInfo = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+			.initialDataSize = Data.size(),
+			.pInitialData = Data.empty() ? NULL : Data.data()
+		};
+
+		VkResult res = vkCreatePipelineCache(m_device, &CacheCreateInfo, NULL, &m_pipelineCache);
+		CHECK_VK_RESULT(res, "vkCreatePipelineCache\n");
+
+		m_pipelineCacheWarm = !Data.empty();
+
+		if (m_pipelineCacheWarm) {
+			printf("Pipeline cache loaded from '%s' (%d bytes)\n", PIPELINE_CACHE_FILENAME, (int)Data.size());
+		} else {
+			printf("Starting with an empty pipeline cache\n");
+		}
+	}
+
+
+	void VulkanCore::SavePipelineCache()
 	{
-		const VkSurfaceCapabilitiesKHR& SurfaceCaps = m_physDevices.Selected().m_surfaceCaps;
+		size_t Size = 0;
+		VkResult res = vkGetPipelineCacheData(m_device, m_pipelineCache, &Size, NULL);
+		CHECK_VK_RESULT(res, "vkGetPipelineCacheData\n");
+
+		if (Size == 0) {
+			return;
+		}
+
+		std::vector<char> Data(Size);
+		res = vkGetPipelineCacheData(m_device, m_pipelineCache, &Size, Data.data());
+		CHECK_VK_RESULT(res, "vkGetPipelineCacheData\n");
+
+		// Write to a temporary file and rename it so that a crash in the middle
+		// never leaves behind a truncated cache
+		std::string TempFilename = std::string(PIPELINE_CACHE_FILENAME) + ".tmp";
+
+		FILE* f = fopen(TempFilename.c_str(), "wb");
+
+		if (!f) {
+			printf("Error opening '%s' for writing\n", TempFilename.c_str());
+			return;
+		}
+
+		bool Success = (fwrite(Data.data(), Size, 1, f) == 1);
+
+		fclose(f);
+
+		if (!Success) {
+			printf("Error writing pipeline cache '%s'\n", TempFilename.c_str());
+			remove(TempFilename.c_str());
+			return;
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(TempFilename, PIPELINE_CACHE_FILENAME, ec);
+
+		if (ec) {
+			printf("Error renaming '%s' to '%s': %s\n", TempFilename.c_str(), PIPELINE_CACHE_FILENAME, ec.message().c_str());
+			remove(TempFilename.c_str());
+			return;
+		}
+
+		printf("Pipeline cache '%s' written (%d bytes)\n", PIPELINE_CACHE_FILENAME, (int)Size);
+	}
+
+
+	void VulkanCore::CreateSwapChain(VkSwapchainKHR OldSwapChain)
+	{
+		// The capabilities that were queried at startup don't reflect the current size of the window
+		VkSurfaceCapabilitiesKHR SurfaceCaps;
+		VkResult res = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physDevices.Selected().m_physDevice, m_surface, &SurfaceCaps);
+		CHECK_VK_RESULT(res, "vkGetPhysicalDeviceSurfaceCapabilitiesKHR\n");
+
+		VkExtent2D Extent = ChooseSwapChainExtent(SurfaceCaps, m_pWindow);
+		m_windowWidth = (int)Extent.width;
+		m_windowHeight = (int)Extent.height;
 
 		uint32_t NumImages = ChooseNumImages(SurfaceCaps);
 
@@ -338,7 +730,7 @@ namespace Engine {
 			.minImageCount = NumImages,
 			.imageFormat = m_swapChainSurfaceFormat.format,
 			.imageColorSpace = m_swapChainSurfaceFormat.colorSpace,
-			.imageExtent = SurfaceCaps.currentExtent,
+			.imageExtent = Extent,
 			.imageArrayLayers = 1,
 			.imageUsage = (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT),
 			.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
@@ -347,10 +739,11 @@ namespace Engine {
 			.preTransform = SurfaceCaps.currentTransform,
 			.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
 			.presentMode = PresentMode,
-			.clipped = VK_TRUE
+			.clipped = VK_TRUE,
+			.oldSwapchain = OldSwapChain
 		};
 
-		VkResult res = vkCreateSwapchainKHR(m_device, &SwapChainCreateInfo, NULL, &m_swapChain);
+		res = vkCreateSwapchainKHR(m_device, &SwapChainCreateInfo, NULL, &m_swapChain);
 		CHECK_VK_RESULT(res, "vkCreateSwapchainKHR\n");
 
 		printf("Swap chain created\n");
@@ -374,6 +767,113 @@ namespace Engine {
 	}
 
 
+	// Headless - the images stay with the queue for the whole run. TRANSFER_SRC is for ReadImage().
+	void VulkanCore::CreateOffscreenImages()
+	{
+		m_swapChainSurfaceFormat = { HEADLESS_COLOR_FORMAT, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+
+		m_offscreenImages.resize(HEADLESS_NUM_IMAGES);
+		m_images.resize(HEADLESS_NUM_IMAGES);
+		m_imageViews.resize(HEADLESS_NUM_IMAGES);
+
+		for (int i = 0; i < HEADLESS_NUM_IMAGES; i++) {
+			VulkanTexture& Tex = m_offscreenImages[i];
+
+			VkImageUsageFlags Usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			CreateImage(Tex, m_windowWidth, m_windowHeight, HEADLESS_COLOR_FORMAT, Usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+			Tex.m_view = CreateImageView(m_device, Tex.m_image, HEADLESS_COLOR_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+			m_images[i] = Tex.m_image;
+			m_imageViews[i] = Tex.m_view;
+		}
+
+		printf("Created %d offscreen images (%dx%d)\n", HEADLESS_NUM_IMAGES, m_windowWidth, m_windowHeight);
+	}
+
+
+	bool VulkanCore::RecreateSwapChain(VkRenderPass RenderPass, std::vector<VkFramebuffer>& Framebuffers)
+	{
+		if (m_headless) {
+			MY_ERROR("There is no swapchain in headless mode\n");
+			exit(1);
+		}
+
+		// A minimized window has no size - wait until it is restored
+		int Width = 0, Height = 0;
+		glfwGetFramebufferSize(m_pWindow, &Width, &Height);
+
+		while ((Width == 0) || (Height == 0)) {
+			glfwWaitEvents();
+			glfwGetFramebufferSize(m_pWindow, &Width, &Height);
+		}
+
+		// The old images are still referenced by the frames in flight
+		m_queue.WaitIdle();
+
+		// The upload batches find their profiler sets after the ones of the images, so they
+		// must complete while the number of images is still the one they began with
+		FlushUploads();
+
+		DestroyFramebuffers(Framebuffers);
+
+		for (int i = 0; i < m_imageViews.size(); i++) {
+			vkDestroyImageView(m_device, m_imageViews[i], NULL);
+		}
+
+		if (m_depthEnabled) {
+			for (int i = 0; i < m_depthImages.size(); i++) {
+				m_depthImages[i].Destroy(m_device);
+			}
+
+			m_depthImages.clear();
+		}
+
+		int NumImages = (int)m_images.size();
+
+		// The old swapchain is retired by the new one and can be destroyed right after
+		VkSwapchainKHR OldSwapChain = m_swapChain;
+		CreateSwapChain(OldSwapChain);
+		vkDestroySwapchainKHR(m_device, OldSwapChain, NULL);
+
+		bool NumImagesChanged = ((int)m_images.size() != NumImages);
+
+		m_queue.SetSwapChain(m_swapChain, (int)m_images.size());
+
+		// Otherwise the per-image resources are kept
+		if (NumImagesChanged) {
+			printf("The number of swapchain images changed from %d to %d\n", NumImages, (int)m_images.size());
+			RecreatePerImageResources();
+		}
+
+		if (m_depthEnabled) {
+			CreateDepthResources();
+			FlushUploads();
+		}
+
+		Framebuffers = CreateFramebuffers(RenderPass);
+
+		printf("Swap chain recreated (%dx%d)\n", m_windowWidth, m_windowHeight);
+
+		return NumImagesChanged;
+	}
+
+
+	// The queue is idle and there are no pending uploads
+	void VulkanCore::RecreatePerImageResources()
+	{
+		int NumImages = (int)m_images.size();
+
+		m_gpuProfiler.Destroy();
+		m_gpuProfiler.Init(this, NumImages + NUM_UPLOAD_BATCHES);
+
+		m_frameAllocator.SetNumFrames(this, NumImages);
+
+		m_commandRecorder.Destroy();
+		m_commandRecorder.Init(this, NumImages);
+	}
+
+
 	void VulkanCore::CreateCommandBufferPool()
 	{
 		VkCommandPoolCreateInfo cmdPoolCreateInfo = {
@@ -425,7 +925,8 @@ namespace Engine {
 			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-			.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+			// Headless - ready to be copied by ReadImage()
+			.finalLayout = m_headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
 		};
 
 		VkAttachmentReference ColorAttachRef = {
@@ -538,38 +1039,21 @@ namespace Engine {
 
 	BufferAndMemory VulkanCore::CreateVertexBuffer(const void* pVertices, size_t Size)
 	{
-		// Step 1: create the staging buffer
-		VkBufferUsageFlags Usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		VkMemoryPropertyFlags MemProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-		BufferAndMemory StagingVB = CreateBuffer(Size, Usage, MemProps);
-
-		// Step 2: map the memory of the stage buffer
-		void* pMem = NULL;
-		VkDeviceSize Offset = 0;
-		VkMemoryMapFlags Flags = 0;
-		VkResult res = vkMapMemory(m_device, StagingVB.m_mem, Offset,
-			StagingVB.m_allocationSize, Flags, &pMem);
-		CHECK_VK_RESULT(res, "vkMapMemory\n");
-
-		// Step 3: copy the vertices to the stating buffer
-		memcpy(pMem, pVertices, Size);
-
-		// Step 4: unmap/release the mapped memory
-		vkUnmapMemory(m_device, StagingVB.m_mem);
+		return CreateDeviceLocalBuffer(pVertices, Size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	}
 
-		// Step 5: create the final buffer
-		Usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-		MemProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-		BufferAndMemory VB = CreateBuffer(Size, Usage, MemProps);
 
-		// Step 6: copy the staging buffer to the final buffer
-		CopyBufferToBuffer(VB.m_buffer, StagingVB.m_buffer, Size);
+	BufferAndMemory VulkanCore::CreateDeviceLocalBuffer(const void* pData, size_t Size, VkBufferUsageFlags Usage)
+	{
+		// Step 1: create the final buffer
+		Usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		VkMemoryPropertyFlags MemProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		BufferAndMemory Buf = CreateBuffer(Size, Usage, MemProps);
 
-		// Step 7: release the resources of the staging buffer
-		StagingVB.Destroy(m_device);
+		// Step 2: queue the copy of the data through the staging ring
+		m_uploader.UploadToBuffer(Buf.m_buffer, 0, pData, Size);
 
-		return VB;
+		return Buf;
 	}
 
 
@@ -609,25 +1093,16 @@ namespace Engine {
 		vkGetBufferMemoryRequirements(m_device, Buf.m_buffer, &MemReqs);
 		printf("Buffer requires %d bytes\n", (int)MemReqs.size);
 
-		Buf.m_allocationSize = MemReqs.size;
-
 		// Step 3: get the memory type index
 		uint32_t MemoryTypeIndex = GetMemoryTypeIndex(MemReqs.memoryTypeBits, Properties);
 		printf("Memory type index %d\n", MemoryTypeIndex);
 
-		// Step 4: allocate memory
-		VkMemoryAllocateInfo MemAllocInfo = {
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-			.pNext = NULL,
-			.allocationSize = MemReqs.size,
-			.memoryTypeIndex = MemoryTypeIndex
-		};
-
-		res = vkAllocateMemory(m_device, &MemAllocInfo, NULL, &Buf.m_mem);
-		CHECK_VK_RESULT(res, "vkAllocateMemory error %d\n");
+		// Step 4: sub-allocate memory from one of the blocks
+		bool IsLinear = true;
+		Buf.m_mem = m_allocator.Allocate(MemReqs, MemoryTypeIndex, IsLinear);
 
 		// Step 5: bind memory
-		res = vkBindBufferMemory(m_device, Buf.m_buffer, Buf.m_mem, 0);
+		res = vkBindBufferMemory(m_device, Buf.m_buffer, Buf.m_mem.m_mem, Buf.m_mem.m_offset);
 		CHECK_VK_RESULT(res, "vkBindBufferMemory error %d\n");
 
 		return Buf;
@@ -657,14 +1132,17 @@ namespace Engine {
 
 		// Step #4: create the image view
 		VkImageAspectFlags AspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
-		Tex.m_view = CreateImageView(m_device, Tex.m_image, Format, AspectFlags);
+		Tex.m_view = CreateImageView(m_device, Tex.m_image, Format, AspectFlags, Tex.m_mipLevels);
 
 		VkFilter MinFilter = VK_FILTER_LINEAR;
 		VkFilter MaxFilter = VK_FILTER_LINEAR;
 		VkSamplerAddressMode AddressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 
 		// Step #5: create the texture sampler
-		Tex.m_sampler = CreateTextureSampler(m_device, MinFilter, MaxFilter, AddressMode);
+		Tex.m_sampler = CreateTextureSampler(m_device, MinFilter, MaxFilter, AddressMode, Tex.m_mipLevels, m_maxAnisotropy);
+
+		// Step #6: make it available to the shaders through the bindless table
+		m_textureTable.Add(Tex);
 
 		printf("Texture from '%s' created\n", pFilename);
 	}
@@ -672,48 +1150,332 @@ namespace Engine {
 
 	void VulkanCore::CreateTextureFromData(const void* pPixels, int ImageWidth, int ImageHeight, VulkanTexture& Tex)
 	{
+		PROFILE_ZONE("Upload texture");
+
 		// Step #1: create the image object and populate it with pixels
 		VkFormat Format = VK_FORMAT_R8G8B8A8_SRGB;
 		CreateTextureImageFromData(Tex, pPixels, ImageWidth, ImageHeight, Format);
 
 		// Step #2: create the image view
 		VkImageAspectFlags AspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
-		Tex.m_view = CreateImageView(m_device, Tex.m_image, Format, AspectFlags);
+		Tex.m_view = CreateImageView(m_device, Tex.m_image, Format, AspectFlags, Tex.m_mipLevels);
 
 		VkFilter MinFilter = VK_FILTER_LINEAR;
 		VkFilter MaxFilter = VK_FILTER_LINEAR;
 		VkSamplerAddressMode AddressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 
 		// Step #3: create the texture sampler
-		Tex.m_sampler = CreateTextureSampler(m_device, MinFilter, MaxFilter, AddressMode);
+		Tex.m_sampler = CreateTextureSampler(m_device, MinFilter, MaxFilter, AddressMode, Tex.m_mipLevels, m_maxAnisotropy);
+
+		// Step #4: make it available to the shaders through the bindless table
+		m_textureTable.Add(Tex);
 
 		printf("Texture from data created\n");
 	}
 
 
+	void VulkanCore::CreateTextureFromContainer(const TextureContainer& Container, VulkanTexture& Tex)
+	{
+		PROFILE_ZONE("Upload texture");
+
+		VkFormat Format = Container.Format;
+
+		// Step #1: create the image object and populate it with the levels of the container
+		if ((Container.NumMips == 1) && !IsBlockCompressedFormat(Format)) {
+			// Plain RGBA8 without mips - same as a decoded image
+			CreateTextureImageFromData(Tex, Container.Data.data(), Container.Mips[0].Width, Container.Mips[0].Height, Format);
+		}
+		else {
+			bool Decode = !CanSample(Format);
+
+			if (Decode) {
+				Format = GetDecodedFormat(Container.Format);
+				printf("Texture format %d is not supported by the device - decoding on the CPU\n", Container.Format);
+			}
+
+			auto GetMipSize = [&](uint32_t Mip) {
+				const TextureContainerMip& m = Container.Mips[Mip];
+				return Decode ? (VkDeviceSize)m.Width * m.Height * 4 : (VkDeviceSize)m.Size;
+			};
+
+			// Over the budget - skip the top levels since the container already has the rest
+			uint32_t FirstMip = 0;
+
+			if (m_textureMemoryBudget > 0) {
+				VkDeviceSize ChainSize = 0;
+
+				for (uint32_t Mip = 0; Mip < Container.NumMips; Mip++) {
+					ChainSize += GetMipSize(Mip);
+				}
+
+				while ((FirstMip + 1 < Container.NumMips) &&
+					(std::min(Container.Mips[FirstMip + 1].Width, Container.Mips[FirstMip + 1].Height) >= MIN_BUDGET_TEXTURE_SIZE) &&
+					(m_textureMemory + ChainSize > m_textureMemoryBudget)) {
+					ChainSize -= GetMipSize(FirstMip);
+					FirstMip++;
+				}
+
+				if (FirstMip > 0) {
+					printf("Texture memory budget exceeded - dropped %d mip levels\n", FirstMip);
+				}
+			}
+
+			uint32_t MipLevels = Container.NumMips - FirstMip;
+			std::vector<VkBufferImageCopy> Regions(MipLevels);
+			std::vector<uint8_t> Decoded;
+
+			for (uint32_t Level = 0; Level < MipLevels; Level++) {
+				const TextureContainerMip& m = Container.Mips[FirstMip + Level];
+
+				VkDeviceSize Offset = m.Offset - Container.Mips[FirstMip].Offset;
+
+				if (Decode) {
+					std::vector<uint8_t> Pixels;
+
+					if (!DecodeBlockCompressedMip(Container, FirstMip + Level, Pixels)) {
+						MY_ERROR("No CPU decoder for texture format %d\n", Container.Format);
+						exit(1);
+					}
+
+					Offset = Decoded.size();
+					Decoded.insert(Decoded.end(), Pixels.begin(), Pixels.end());
+				}
+
+				Regions[Level] = {
+					.bufferOffset = Offset,
+					.bufferRowLength = 0,
+					.bufferImageHeight = 0,
+					.imageSubresource = VkImageSubresourceLayers {
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.mipLevel = Level,
+						.baseArrayLayer = 0,
+						.layerCount = 1
+					},
+					.imageOffset = VkOffset3D {.x = 0, .y = 0, .z = 0 },
+					.imageExtent = VkExtent3D {.width = m.Width, .height = m.Height, .depth = 1 }
+				};
+			}
+
+			const void* pData = Decode ? (const void*)Decoded.data() : (const void*)&Container.Data[Container.Mips[FirstMip].Offset];
+			VkDeviceSize DataSize = Decode ? Decoded.size() : Container.Data.size() - Container.Mips[FirstMip].Offset;
+
+			Tex.m_mipLevels = MipLevels;
+
+			VkImageUsageFlagBits Usage = (VkImageUsageFlagBits)(VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+			VkMemoryPropertyFlagBits PropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			CreateImage(Tex, Container.Mips[FirstMip].Width, Container.Mips[FirstMip].Height, Format, Usage, PropertyFlags, MipLevels);
+
+			AddTextureMemory(Tex);
+
+			m_uploader.UploadMipsToImage(Tex.m_image, MipLevels, Regions.data(), pData, DataSize);
+		}
+
+		// Step #2: create the image view
+		VkImageAspectFlags AspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
+		Tex.m_view = CreateImageView(m_device, Tex.m_image, Format, AspectFlags, Tex.m_mipLevels);
+
+		VkFilter MinFilter = VK_FILTER_LINEAR;
+		VkFilter MaxFilter = VK_FILTER_LINEAR;
+		VkSamplerAddressMode AddressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+
+		// Step #3: create the texture sampler
+		Tex.m_sampler = CreateTextureSampler(m_device, MinFilter, MaxFilter, AddressMode, Tex.m_mipLevels, m_maxAnisotropy);
+
+		// Step #4: make it available to the shaders through the bindless table
+		m_textureTable.Add(Tex);
+
+		printf("Texture from container created (format %d, %d mips)\n", Format, Tex.m_mipLevels);
+	}
+
+
+	// The texture releases its size (and its table slot) on Destroy() so the budget sees only the live textures
+	void VulkanCore::AddTextureMemory(VulkanTexture& Tex)
+	{
+		Tex.m_pVulkanCore = this;
+		Tex.m_budgetSize = Tex.m_mem.m_size;
+		m_textureMemory += Tex.m_budgetSize;
+	}
+
+
+	void VulkanCore::ReleaseTexture(VulkanTexture& Tex)
+	{
+		if (Tex.m_bindlessIndex != INVALID_TEXTURE_INDEX) {
+			m_textureTable.Remove(Tex.m_bindlessIndex);
+			Tex.m_bindlessIndex = INVALID_TEXTURE_INDEX;
+		}
+
+		assert(Tex.m_budgetSize <= m_textureMemory);
+
+		m_textureMemory -= Tex.m_budgetSize;
+		Tex.m_budgetSize = 0;
+	}
+
+
 	void VulkanTexture::Destroy(VkDevice Device)
 	{
+		if (m_pVulkanCore) {
+			m_pVulkanCore->ReleaseTexture(*this);
+		}
+
 		vkDestroySampler(Device, m_sampler, NULL);
 		vkDestroyImageView(Device, m_view, NULL);
 		vkDestroyImage(Device, m_image, NULL);
-		vkFreeMemory(Device, m_mem, NULL);
+
+		if (m_mem.m_pAllocator) {
+			m_mem.m_pAllocator->Free(m_mem);
+		}
+	}
+
+
+	static uint32_t GetNumMipLevels(uint32_t Width, uint32_t Height)
+	{
+		uint32_t MipLevels = 1;
+
+		while ((Width > 1) || (Height > 1)) {
+			Width = std::max(Width / 2, 1u);
+			Height = std::max(Height / 2, 1u);
+			MipLevels++;
+		}
+
+		return MipLevels;
+	}
+
+
+	// Size of the full chain starting at Width x Height (it converges to 4/3 of the top level)
+	static VkDeviceSize GetMipChainSize(uint32_t Width, uint32_t Height, uint32_t MipLevels, int BytesPerPixel)
+	{
+		VkDeviceSize Size = 0;
+
+		for (uint32_t Level = 0; Level < MipLevels; Level++) {
+			Size += (VkDeviceSize)Width * Height * BytesPerPixel;
+			Width = std::max(Width / 2, 1u);
+			Height = std::max(Height / 2, 1u);
+		}
+
+		return Size;
+	}
+
+
+	// 2x2 box filter of 8 bit sRGB pixels. The color is averaged in linear space
+	// (like the blits of the GPU do for sRGB formats) and the alpha as is.
+	static void DownsampleSRGBA8(const uint8_t* pSrc, uint32_t Width, uint32_t Height, std::vector<uint8_t>& Dst)
+	{
+		static struct SRGBTable {
+			float ToLinear[256];
+
+			SRGBTable()
+			{
+				for (int i = 0; i < 256; i++) {
+					float c = i / 255.0f;
+					ToLinear[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+				}
+			}
+		} Table;
+
+		uint32_t DstWidth = std::max(Width / 2, 1u);
+		uint32_t DstHeight = std::max(Height / 2, 1u);
+
+		Dst.resize((size_t)DstWidth * DstHeight * 4);
+
+		for (uint32_t y = 0; y < DstHeight; y++) {
+			// Clamp for the odd/1 pixel sized sides
+			uint32_t y0 = std::min(y * 2, Height - 1);
+			uint32_t y1 = std::min(y * 2 + 1, Height - 1);
+
+			for (uint32_t x = 0; x < DstWidth; x++) {
+				uint32_t x0 = std::min(x * 2, Width - 1);
+				uint32_t x1 = std::min(x * 2 + 1, Width - 1);
+
+				const uint8_t* p[4] = { &pSrc[(y0 * Width + x0) * 4], &pSrc[(y0 * Width + x1) * 4],
+										&pSrc[(y1 * Width + x0) * 4], &pSrc[(y1 * Width + x1) * 4] };
+
+				uint8_t* pDst = &Dst[((size_t)y * DstWidth + x) * 4];
+
+				for (int c = 0; c < 3; c++) {
+					float Linear = (Table.ToLinear[p[0][c]] + Table.ToLinear[p[1][c]] +
+									Table.ToLinear[p[2][c]] + Table.ToLinear[p[3][c]]) * 0.25f;
+					float s = (Linear <= 0.0031308f) ? Linear * 12.92f : 1.055f * powf(Linear, 1.0f / 2.4f) - 0.055f;
+					pDst[c] = (uint8_t)std::min(std::max(s * 255.0f + 0.5f, 0.0f), 255.0f);
+				}
+
+				pDst[3] = (uint8_t)((p[0][3] + p[1][3] + p[2][3] + p[3][3] + 2) / 4);
+			}
+		}
+	}
+
+
+	bool VulkanCore::CanGenerateMips(VkFormat Format) const
+	{
+		VkFormatProperties Props;
+		vkGetPhysicalDeviceFormatProperties(m_physDevices.Selected().m_physDevice, Format, &Props);
+
+		VkFormatFeatureFlags Required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+			VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+		return (Props.optimalTilingFeatures & Required) == Required;
+	}
+
+
+	bool VulkanCore::CanSample(VkFormat Format) const
+	{
+		if (IsBlockCompressedFormat(Format) && !m_physDevices.Selected().m_features.textureCompressionBC) {
+			return false;
+		}
+
+		VkFormatProperties Props;
+		vkGetPhysicalDeviceFormatProperties(m_physDevices.Selected().m_physDevice, Format, &Props);
+
+		VkFormatFeatureFlags Required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+		return (Props.optimalTilingFeatures & Required) == Required;
 	}
 
 
 	void VulkanCore::CreateTextureImageFromData(VulkanTexture& Tex, const void* pPixels,
 		uint32_t ImageWidth, uint32_t ImageHeight, VkFormat TexFormat)
 	{
+		uint32_t MipLevels = CanGenerateMips(TexFormat) ? GetNumMipLevels(ImageWidth, ImageHeight) : 1;
+
+		// Over the budget - drop the top levels on the CPU so that only the rest is uploaded
+		std::vector<uint8_t> Downsampled[2];
+		int BytesPerPixel = GetBytesPerTexFormat(TexFormat);
+		int NumDropped = 0;
+
+		if ((m_textureMemoryBudget > 0) && (TexFormat == VK_FORMAT_R8G8B8A8_SRGB)) {
+			while ((MipLevels > 1) &&
+				(std::min(ImageWidth, ImageHeight) / 2 >= MIN_BUDGET_TEXTURE_SIZE) &&
+				(m_textureMemory + GetMipChainSize(ImageWidth, ImageHeight, MipLevels, BytesPerPixel) > m_textureMemoryBudget)) {
+				std::vector<uint8_t>& Dst = Downsampled[NumDropped % 2];
+				DownsampleSRGBA8((const uint8_t*)pPixels, ImageWidth, ImageHeight, Dst);
+
+				pPixels = Dst.data();
+				ImageWidth = std::max(ImageWidth / 2, 1u);
+				ImageHeight = std::max(ImageHeight / 2, 1u);
+				MipLevels--;
+				NumDropped++;
+			}
+
+			if (NumDropped > 0) {
+				printf("Texture memory budget exceeded - dropped %d mip levels, %dx%d left\n", NumDropped, ImageWidth, ImageHeight);
+			}
+		}
+
+		Tex.m_mipLevels = MipLevels;
+
+		// The blits read the upper levels
 		VkImageUsageFlagBits Usage = (VkImageUsageFlagBits)(VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-			VK_IMAGE_USAGE_SAMPLED_BIT);
+			VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
 		VkMemoryPropertyFlagBits PropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-		CreateImage(Tex, ImageWidth, ImageHeight, TexFormat, Usage, PropertyFlags);
+		CreateImage(Tex, ImageWidth, ImageHeight, TexFormat, Usage, PropertyFlags, MipLevels);
+
+		AddTextureMemory(Tex);
 
 		UpdateTextureImage(Tex, ImageWidth, ImageHeight, TexFormat, pPixels);
 	}
 
 
 	void VulkanCore::CreateImage(VulkanTexture& Tex, uint32_t ImageWidth, uint32_t ImageHeight, VkFormat TexFormat,
-		VkImageUsageFlags UsageFlags, VkMemoryPropertyFlagBits PropertyFlags)
+		VkImageUsageFlags UsageFlags, VkMemoryPropertyFlagBits PropertyFlags, uint32_t MipLevels)
 	{
 		VkImageCreateInfo ImageInfo = {
 			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
@@ -722,7 +1484,7 @@ namespace Engine {
 			.imageType = VK_IMAGE_TYPE_2D,
 			.format = TexFormat,
 			.extent = VkExtent3D {.width = ImageWidth, .height = ImageHeight, .depth = 1 },
-			.mipLevels = 1,
+			.mipLevels = MipLevels,
 			.arrayLayers = 1,
 			.samples = VK_SAMPLE_COUNT_1_BIT,
 			.tiling = VK_IMAGE_TILING_OPTIMAL,
@@ -746,19 +1508,12 @@ namespace Engine {
 		uint32_t MemoryTypeIndex = GetMemoryTypeIndex(MemReqs.memoryTypeBits, PropertyFlags);
 		printf("Memory type index %d\n", MemoryTypeIndex);
 
-		// Step 4: allocate memory
-		VkMemoryAllocateInfo MemAllocInfo = {
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-			.pNext = NULL,
-			.allocationSize = MemReqs.size,
-			.memoryTypeIndex = MemoryTypeIndex
-		};
-
-		res = vkAllocateMemory(m_device, &MemAllocInfo, NULL, &Tex.m_mem);
-		CHECK_VK_RESULT(res, "vkAllocateMemory error");
+		// Step 4: sub-allocate memory from one of the blocks (optimal tiling)
+		bool IsLinear = false;
+		Tex.m_mem = m_allocator.Allocate(MemReqs, MemoryTypeIndex, IsLinear);
 
 		// Step 5: bind memory
-		res = vkBindImageMemory(m_device, Tex.m_image, Tex.m_mem, 0);
+		res = vkBindImageMemory(m_device, Tex.m_image, Tex.m_mem.m_mem, Tex.m_mem.m_offset);
 		CHECK_VK_RESULT(res, "vkBindBufferMemory error %d\n");
 	}
 
@@ -772,80 +1527,14 @@ namespace Engine {
 		int LayerCount = 1;
 		VkDeviceSize ImageSize = LayerCount * LayerSize;
 
-		VkBufferUsageFlags Usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		VkMemoryPropertyFlags Properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-
-		BufferAndMemory StagingTex = CreateBuffer(ImageSize, Usage, Properties);
-
-		StagingTex.Update(m_device, pPixels, ImageSize);
-
-		TransitionImageLayout(Tex.m_image, TexFormat,
-			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-		CopyBufferToImage(Tex.m_image, StagingTex.m_buffer, ImageWidth, ImageHeight);
-
-		TransitionImageLayout(Tex.m_image, TexFormat,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-		StagingTex.Destroy(m_device);
+		// Only level 0 is uploaded - the rest is generated by the uploader.
+		// The layout transitions are recorded around the copy.
+		m_uploader.UploadToImage(Tex.m_image, TexFormat, ImageWidth, ImageHeight, Tex.m_mipLevels, pPixels, ImageSize);
 	}
 
 
 
 
-	void VulkanCore::TransitionImageLayout(VkImage& Image, VkFormat Format,
-		VkImageLayout OldLayout, VkImageLayout NewLayout)
-	{
-		BeginCommandBuffer(m_copyCmdBuf, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-
-		ImageMemBarrier(m_copyCmdBuf, Image, Format, OldLayout, NewLayout);
-
-		SubmitCopyCommand();
-	}
-
-
-	void VulkanCore::CopyBufferToBuffer(VkBuffer Dst, VkBuffer Src, VkDeviceSize Size)
-	{
-		BeginCommandBuffer(m_copyCmdBuf, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-
-		VkBufferCopy BufferCopy = {
-			.srcOffset = 0,
-			.dstOffset = 0,
-			.size = Size
-		};
-
-		vkCmdCopyBuffer(m_copyCmdBuf, Src, Dst, 1, &BufferCopy);
-
-		SubmitCopyCommand();
-	}
-
-
-	void VulkanCore::CopyBufferToImage(VkImage Dst, VkBuffer Src, uint32_t ImageWidth, uint32_t ImageHeight)
-	{
-		BeginCommandBuffer(m_copyCmdBuf, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-
-		VkBufferImageCopy BufferImageCopy = {
-			.bufferOffset = 0,
-			.bufferRowLength = 0,
-			.bufferImageHeight = 0,
-			.imageSubresource = VkImageSubresourceLayers {
-				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-				.mipLevel = 0,
-				.baseArrayLayer = 0,
-				.layerCount = 1
-			},
-			.imageOffset = VkOffset3D {.x = 0, .y = 0, .z = 0 },
-			.imageExtent = VkExtent3D {.width = ImageWidth, .height = ImageHeight, .depth = 1 }
-		};
-
-		vkCmdCopyBufferToImage(m_copyCmdBuf, Src, Dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1, &BufferImageCopy);
-		SubmitCopyCommand();
-	}
-
-
-
 	uint32_t VulkanCore::GetMemoryTypeIndex(uint32_t MemTypeBitsMask, VkMemoryPropertyFlags ReqMemPropFlags)
 	{
 		const VkPhysicalDeviceMemoryProperties& MemProps = m_physDevices.Selected().m_memProps;
@@ -869,12 +1558,12 @@ namespace Engine {
 
 	void BufferAndMemory::Destroy(VkDevice Device)
 	{
-		if (m_mem) {
-			vkFreeMemory(Device, m_mem, NULL);
-		}
 		if (m_buffer) {
 			vkDestroyBuffer(Device, m_buffer, NULL);
 		}
+		if (m_mem.m_pAllocator) {
+			m_mem.m_pAllocator->Free(m_mem);
+		}
 	}
 
 
@@ -898,13 +1587,18 @@ namespace Engine {
 	}
 
 
-	void VulkanCore::SubmitCopyCommand()
+	void VulkanCore::FlushUploads()
 	{
-		vkEndCommandBuffer(m_copyCmdBuf);
+		m_uploader.Flush();
+	}
 
-		m_queue.SubmitSync(m_copyCmdBuf);
 
-		m_queue.WaitIdle();
+	void VulkanCore::BeginFrame(int ImageIndex)
+	{
+		m_frameAllocator.BeginFrame(ImageIndex);
+
+		// AcquireNextImage() waited for the fence of the image so this doesn't block
+		m_gpuProfiler.CollectSet(ImageIndex);
 	}
 
 
@@ -924,7 +1618,7 @@ namespace Engine {
 
 			VkImageLayout OldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 			VkImageLayout NewLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-			TransitionImageLayout(m_depthImages[i].m_image, DepthFormat, OldLayout, NewLayout);
+			m_uploader.TransitionImageLayout(m_depthImages[i].m_image, DepthFormat, OldLayout, NewLayout);
 
 			m_depthImages[i].m_view = CreateImageView(m_device, m_depthImages[i].m_image,
 				DepthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
@@ -934,11 +1628,13 @@ namespace Engine {
 
 	void BufferAndMemory::Update(VkDevice Device, const void* pData, size_t Size)
 	{
-		void* pMem = NULL;
-		VkResult res = vkMapMemory(Device, m_mem, 0, Size, 0, &pMem);
-		CHECK_VK_RESULT(res, "vkMapMemory");
-		memcpy(pMem, pData, Size);
-		vkUnmapMemory(Device, m_mem);
+		// Host visible blocks are persistently mapped by the allocator
+		if (!m_mem.m_pMapped) {
+			MY_ERROR("Buffer memory is not host visible\n");
+			exit(1);
+		}
+
+		memcpy(m_mem.m_pMapped, pData, Size);
 	}
 
 }
\ No newline at end of file
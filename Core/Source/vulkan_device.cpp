@@ -79,6 +79,44 @@ namespace Engine {
     }
 
 
+    static void QuerySurfaceProps(PhysicalDevice& Device, const VkSurfaceKHR& Surface)
+    {
+        uint32_t NumFormats = 0;
+        VkResult res = vkGetPhysicalDeviceSurfaceFormatsKHR(Device.m_physDevice, Surface, &NumFormats, NULL);
+        CHECK_VK_RESULT(res, "vkGetPhysicalDeviceSurfaceFormatsKHR (1)\n");
+        assert(NumFormats > 0);
+
+        Device.m_surfaceFormats.resize(NumFormats);
+
+        res = vkGetPhysicalDeviceSurfaceFormatsKHR(Device.m_physDevice, Surface, &NumFormats, Device.m_surfaceFormats.data());
+        CHECK_VK_RESULT(res, "vkGetPhysicalDeviceSurfaceFormatsKHR (2)\n");
+
+        for (uint32_t j = 0; j < NumFormats; j++) {
+            const VkSurfaceFormatKHR& SurfaceFormat = Device.m_surfaceFormats[j];
+            printf("    Format %x color space %x\n", SurfaceFormat.format, SurfaceFormat.colorSpace);
+        }
+
+        res = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(Device.m_physDevice, Surface, &(Device.m_surfaceCaps));
+        CHECK_VK_RESULT(res, "vkGetPhysicalDeviceSurfaceCapabilitiesKHR\n");
+
+        PrintImageUsageFlags(Device.m_surfaceCaps.supportedUsageFlags);
+
+        uint32_t NumPresentModes = 0;
+
+        res = vkGetPhysicalDeviceSurfacePresentModesKHR(Device.m_physDevice, Surface, &NumPresentModes, NULL);
+        CHECK_VK_RESULT(res, "vkGetPhysicalDeviceSurfacePresentModesKHR (1) error\n");
+
+        assert(NumPresentModes != 0);
+
+        Device.m_presentModes.resize(NumPresentModes);
+
+        res = vkGetPhysicalDeviceSurfacePresentModesKHR(Device.m_physDevice, Surface, &NumPresentModes, Device.m_presentModes.data());
+        CHECK_VK_RESULT(res, "vkGetPhysicalDeviceSurfacePresentModesKHR (2) error\n");
+
+        printf("Number of presentation modes %d\n", NumPresentModes);
+    }
+
+
     void VulkanPhysicalDevices::Init(const VkInstance& Instance, const VkSurfaceKHR& Surface)
     {
         uint32_t NumDevices = 0;
@@ -130,44 +168,20 @@ namespace Engine {
                     (Flags & VK_QUEUE_TRANSFER_BIT) ? "Yes" : "No",
                     (Flags & VK_QUEUE_SPARSE_BINDING_BIT) ? "Yes" : "No");
 
+                // Headless - no queue can present
+                if (Surface == VK_NULL_HANDLE) {
+                    m_devices[i].m_qSupportsPresent[q] = VK_FALSE;
+                    continue;
+                }
+
                 res = vkGetPhysicalDeviceSurfaceSupportKHR(PhysDev, q, Surface, &(m_devices[i].m_qSupportsPresent[q]));
                 CHECK_VK_RESULT(res, "vkGetPhysicalDeviceSurfaceSupportKHR error\n");
             }
 
-            uint32_t NumFormats = 0;
-            res = vkGetPhysicalDeviceSurfaceFormatsKHR(PhysDev, Surface, &NumFormats, NULL);
-            CHECK_VK_RESULT(res, "vkGetPhysicalDeviceSurfaceFormatsKHR (1)\n");
-            assert(NumFormats > 0);
-
-            m_devices[i].m_surfaceFormats.resize(NumFormats);
-
-            res = vkGetPhysicalDeviceSurfaceFormatsKHR(PhysDev, Surface, &NumFormats, m_devices[i].m_surfaceFormats.data());
-            CHECK_VK_RESULT(res, "vkGetPhysicalDeviceSurfaceFormatsKHR (2)\n");
-
-            for (uint32_t j = 0; j < NumFormats; j++) {
-                const VkSurfaceFormatKHR& SurfaceFormat = m_devices[i].m_surfaceFormats[j];
-                printf("    Format %x color space %x\n", SurfaceFormat.format, SurfaceFormat.colorSpace);
+            if (Surface != VK_NULL_HANDLE) {
+                QuerySurfaceProps(m_devices[i], Surface);
             }
 
-            res = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(PhysDev, Surface, &(m_devices[i].m_surfaceCaps));
-            CHECK_VK_RESULT(res, "vkGetPhysicalDeviceSurfaceCapabilitiesKHR\n");
-
-            PrintImageUsageFlags(m_devices[i].m_surfaceCaps.supportedUsageFlags);
-
-            uint32_t NumPresentModes = 0;
-
-            res = vkGetPhysicalDeviceSurfacePresentModesKHR(PhysDev, Surface, &NumPresentModes, NULL);
-            CHECK_VK_RESULT(res, "vkGetPhysicalDeviceSurfacePresentModesKHR (1) error\n");
-
-            assert(NumPresentModes != 0);
-
-            m_devices[i].m_presentModes.resize(NumPresentModes);
-
-            res = vkGetPhysicalDeviceSurfacePresentModesKHR(PhysDev, Surface, &NumPresentModes, m_devices[i].m_presentModes.data());
-            CHECK_VK_RESULT(res, "vkGetPhysicalDeviceSurfacePresentModesKHR (2) error\n");
-
-            printf("Number of presentation modes %d\n", NumPresentModes);
-
             vkGetPhysicalDeviceMemoryProperties(PhysDev, &(m_devices[i].m_memProps));
 
             printf("Num memory types %d\n", m_devices[i].m_memProps.memoryTypeCount);
@@ -185,6 +199,19 @@ namespace Engine {
 
             vkGetPhysicalDeviceFeatures(PhysDev, &m_devices[i].m_features);
 
+            m_devices[i].m_features12 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+
+            if (apiVer >= VK_API_VERSION_1_2) {
+                VkPhysicalDeviceFeatures2 Features2 = {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                    .pNext = &m_devices[i].m_features12
+                };
+
+                vkGetPhysicalDeviceFeatures2(PhysDev, &Features2);
+
+                m_devices[i].m_features12.pNext = NULL;
+            }
+
             m_devices[i].m_depthFormat = FindDepthFormat(PhysDev);
         }
     }
@@ -192,16 +219,26 @@ namespace Engine {
 
     uint32_t VulkanPhysicalDevices::SelectDevice(VkQueueFlags RequiredQueueType, bool SupportsPresent)
     {
-        for (uint32_t i = 0; i < m_devices.size(); i++) {
+        // Software implementations (e.g. lavapipe) are used only if there is nothing else
+        for (int Pass = 0; Pass < 2; Pass++) {
+            bool AllowCPU = (Pass == 1);
 
-            for (uint32_t j = 0; j < m_devices[i].m_qFamilyProps.size(); j++) {
-                const VkQueueFamilyProperties& QFamilyProp = m_devices[i].m_qFamilyProps[j];
+            for (uint32_t i = 0; i < m_devices.size(); i++) {
+                if (!AllowCPU && (m_devices[i].m_devProps.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU)) {
+                    continue;
+                }
 
-                if ((QFamilyProp.queueFlags & RequiredQueueType) && ((bool)m_devices[i].m_qSupportsPresent[j] == SupportsPresent)) {
-                    m_devIndex = i;
-                    int QueueFamily = j;
-                    printf("Using GFX device %d and queue family %d\n", m_devIndex, QueueFamily);
-                    return QueueFamily;
+                for (uint32_t j = 0; j < m_devices[i].m_qFamilyProps.size(); j++) {
+                    const VkQueueFamilyProperties& QFamilyProp = m_devices[i].m_qFamilyProps[j];
+
+                    if (((QFamilyProp.queueFlags & RequiredQueueType) == RequiredQueueType) &&
+                        (!SupportsPresent || m_devices[i].m_qSupportsPresent[j])) {
+                        m_devIndex = i;
+                        int QueueFamily = j;
+                        printf("Using GFX device %d (%s) and queue family %d\n", m_devIndex,
+                            m_devices[i].m_devProps.deviceName, QueueFamily);
+                        return QueueFamily;
+                    }
                 }
             }
         }
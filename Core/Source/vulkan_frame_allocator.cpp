@@ -0,0 +1,122 @@
+#include <assert.h>
+#include <algorithm>
+
+#include "util.h"
+#include "vulkan_util.h"
+#include "vulkan_core.h"
+#include "vulkan_frame_allocator.h"
+
+namespace Engine {
+
+	void VulkanFrameAllocator::Init(VulkanCore* pVulkanCore, int NumFrames, VkDeviceSize FrameSize)
+	{
+		m_device = pVulkanCore->GetDevice();
+		m_numFrames = NumFrames;
+
+		const VkPhysicalDeviceLimits& Limits = pVulkanCore->GetPhysicalDevice().m_devProps.limits;
+		m_alignment = std::max(Limits.minUniformBufferOffsetAlignment, Limits.minStorageBufferOffsetAlignment);
+
+		// The segments must start on an aligned offset as well
+		m_frameSize = AlignSize(FrameSize);
+
+		CreateBuffer(pVulkanCore);
+	}
+
+
+	void VulkanFrameAllocator::CreateBuffer(VulkanCore* pVulkanCore)
+	{
+		// Indirect draws are generated by the CPU every frame as well
+		VkBufferUsageFlags Usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+		VkMemoryPropertyFlags MemProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		m_buffer = pVulkanCore->CreateBuffer(m_frameSize * m_numFrames, Usage, MemProps);
+
+		m_pMem = (char*)m_buffer.m_mem.m_pMapped;
+		assert(m_pMem);
+
+		printf("Frame allocator created: %d frames of %d bytes\n", m_numFrames, (int)m_frameSize);
+	}
+
+
+	void VulkanFrameAllocator::SetNumFrames(VulkanCore* pVulkanCore, int NumFrames)
+	{
+		m_buffer.Destroy(m_device);
+
+		m_numFrames = NumFrames;
+
+		CreateBuffer(pVulkanCore);
+	}
+
+
+	void VulkanFrameAllocator::Destroy()
+	{
+		if (m_device == VK_NULL_HANDLE) {
+			return;	// never initialized
+		}
+
+		m_buffer.Destroy(m_device);
+		m_pMem = NULL;
+	}
+
+
+	VkDeviceSize VulkanFrameAllocator::AlignSize(VkDeviceSize Size) const
+	{
+		return (Size + m_alignment - 1) & ~(m_alignment - 1);
+	}
+
+
+	VkDeviceSize VulkanFrameAllocator::Reserve(VkDeviceSize Size)
+	{
+		assert(m_curFrame == -1);
+
+		VkDeviceSize Offset = m_reservedSize;
+		m_reservedSize += AlignSize(Size);
+
+		if (m_reservedSize > m_frameSize) {
+			MY_ERROR("Frame allocator: reserved %d bytes out of %d\n", (int)m_reservedSize, (int)m_frameSize);
+			exit(1);
+		}
+
+		return Offset;
+	}
+
+
+	void VulkanFrameAllocator::BeginFrame(int FrameIndex)
+	{
+		assert(FrameIndex < m_numFrames);
+
+		m_curFrame = FrameIndex;
+		m_head = m_reservedSize;
+	}
+
+
+	FrameAllocation VulkanFrameAllocator::Allocate(VkDeviceSize Size)
+	{
+		assert(m_curFrame >= 0);
+
+		VkDeviceSize AlignedSize = AlignSize(Size);
+
+		if (m_head + AlignedSize > m_frameSize) {
+			MY_ERROR("Frame allocator is out of space: requested %d bytes, %d available\n",
+				(int)Size, (int)(m_frameSize - m_head));
+			exit(1);
+		}
+
+		FrameAllocation Allocation;
+		Allocation.m_offset = GetFrameOffset(m_curFrame) + m_head;
+		Allocation.m_pMem = m_pMem + Allocation.m_offset;
+
+		m_head += AlignedSize;
+
+		return Allocation;
+	}
+
+
+	void* VulkanFrameAllocator::GetReservedPtr(int FrameIndex, VkDeviceSize ReservedOffset) const
+	{
+		assert(ReservedOffset < m_reservedSize);
+
+		return m_pMem + GetFrameOffset(FrameIndex) + ReservedOffset;
+	}
+}
@@ -28,6 +28,14 @@ namespace Engine {
 	}
 
 
+	static void GLFW_FramebufferSizeCallback(GLFWwindow* pWindow, int Width, int Height)
+	{
+		GLFWCallbacks* pGLFWCallbacks = (GLFWCallbacks*)glfwGetWindowUserPointer(pWindow);
+
+		pGLFWCallbacks->FramebufferResize(pWindow, Width, Height);
+	}
+
+
 	GLFWwindow* glfw_vulkan_init(int Width, int Height, const char* pTitle)
 	{
 		if (!glfwInit()) {
@@ -39,7 +47,7 @@ namespace Engine {
 		}
 
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-		glfwWindowHint(GLFW_RESIZABLE, 0);
+		glfwWindowHint(GLFW_RESIZABLE, 1);
 
 		GLFWwindow* pWindow = glfwCreateWindow(Width, Height, pTitle, NULL, NULL);
 
@@ -59,6 +67,7 @@ namespace Engine {
 		glfwSetKeyCallback(pWindow, GLFW_KeyCallback);
 		glfwSetCursorPosCallback(pWindow, GLFW_MouseCallback);
 		glfwSetMouseButtonCallback(pWindow, GLFW_MouseButtonCallback);
+		glfwSetFramebufferSizeCallback(pWindow, GLFW_FramebufferSizeCallback);
 	}
 
 }
\ No newline at end of file
@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <string.h>
+
+#include "util.h"
+#include "vulkan_util.h"
+#include "vulkan_wrapper.h"
+#include "vulkan_core.h"
+#include "vulkan_gpu_profiler.h"
+
+namespace Engine {
+
+	void VulkanGpuProfiler::Init(VulkanCore* pVulkanCore, int NumSets)
+	{
+		const PhysicalDevice& PhysDevice = pVulkanCore->GetPhysicalDevice();
+
+		uint32_t ValidBits = PhysDevice.m_qFamilyProps[pVulkanCore->GetQueueFamily()].timestampValidBits;
+
+		if (ValidBits == 0) {
+			printf("Timestamps are not supported by the queue family - GPU profiler disabled\n");
+			return;
+		}
+
+		m_device = pVulkanCore->GetDevice();
+		m_numSets = NumSets;
+		m_timestampPeriod = PhysDevice.m_devProps.limits.timestampPeriod;
+		m_timestampMask = (ValidBits >= 64) ? ~0ull : ((1ull << ValidBits) - 1);
+
+		uint32_t NumQueries = (uint32_t)(NumSets * MAX_GPU_SCOPES * 2);
+
+		VkQueryPoolCreateInfo QueryPoolInfo = {
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.pNext = NULL,
+			.flags = 0,
+			.queryType = VK_QUERY_TYPE_TIMESTAMP,
+			.queryCount = NumQueries,
+			.pipelineStatistics = 0
+		};
+
+		VkResult res = vkCreateQueryPool(m_device, &QueryPoolInfo, NULL, &m_queryPool);
+		CHECK_VK_RESULT(res, "vkCreateQueryPool\n");
+
+		// The queries must be reset before their results can be read even if they are
+		// not available, and CollectSet() can see a set before its first submission
+		VkCommandBuffer CmdBuf = VK_NULL_HANDLE;
+		pVulkanCore->CreateCommandBuffers(1, &CmdBuf);
+
+		BeginCommandBuffer(CmdBuf, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+		vkCmdResetQueryPool(CmdBuf, m_queryPool, 0, NumQueries);
+
+		res = vkEndCommandBuffer(CmdBuf);
+		CHECK_VK_RESULT(res, "vkEndCommandBuffer\n");
+
+		pVulkanCore->GetQueue()->SubmitSync(CmdBuf);
+		pVulkanCore->FreeCommandBuffers(1, &CmdBuf);		// waits for the queue
+
+		m_scopes.reserve(MAX_GPU_SCOPES);
+		m_results.resize(MAX_GPU_SCOPES * 2 * 2);
+
+		printf("GPU profiler created: %d sets, %d valid timestamp bits, %.3f ns per tick\n",
+			NumSets, ValidBits, m_timestampPeriod);
+	}
+
+
+	void VulkanGpuProfiler::Destroy()
+	{
+		if (m_device == VK_NULL_HANDLE) {
+			return;	// never initialized
+		}
+
+		vkDestroyQueryPool(m_device, m_queryPool, NULL);
+		m_queryPool = VK_NULL_HANDLE;
+	}
+
+
+	int VulkanGpuProfiler::GetScopeIndex(const char* pName)
+	{
+		// Only a handful of scopes - a linear search doesn't allocate
+		for (int i = 0; i < (int)m_scopes.size(); i++) {
+			if (strcmp(m_scopes[i].m_name.c_str(), pName) == 0) {
+				return i;
+			}
+		}
+
+		if (m_scopes.size() == MAX_GPU_SCOPES) {
+			MY_ERROR("Too many GPU profiler scopes (%d) - can't add '%s'\n", MAX_GPU_SCOPES, pName);
+			exit(1);
+		}
+
+		m_scopes.emplace_back();
+		m_scopes.back().m_name = pName;
+
+		return (int)m_scopes.size() - 1;
+	}
+
+
+	void VulkanGpuProfiler::BeginSet(VkCommandBuffer CmdBuf, int Set)
+	{
+		if (!IsEnabled()) {
+			return;
+		}
+
+		vkCmdResetQueryPool(CmdBuf, m_queryPool, GetQuery(Set, 0), MAX_GPU_SCOPES * 2);
+	}
+
+
+	void VulkanGpuProfiler::BeginScope(VkCommandBuffer CmdBuf, int Set, const char* pName)
+	{
+		if (!IsEnabled()) {
+			return;
+		}
+
+		vkCmdWriteTimestamp(CmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, GetQuery(Set, GetScopeIndex(pName)));
+	}
+
+
+	void VulkanGpuProfiler::EndScope(VkCommandBuffer CmdBuf, int Set, const char* pName)
+	{
+		if (!IsEnabled()) {
+			return;
+		}
+
+		vkCmdWriteTimestamp(CmdBuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, GetQuery(Set, GetScopeIndex(pName)) + 1);
+	}
+
+
+	void VulkanGpuProfiler::CollectSet(int Set)
+	{
+		if (!IsEnabled() || m_scopes.empty()) {
+			return;
+		}
+
+		uint32_t NumQueries = (uint32_t)m_scopes.size() * 2;
+
+		// No WAIT_BIT - a query that was not written by the last submission is reported as unavailable
+		VkResult res = vkGetQueryPoolResults(m_device, m_queryPool, GetQuery(Set, 0), NumQueries,
+			NumQueries * 2 * sizeof(uint64_t), m_results.data(), 2 * sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+		if (res != VK_NOT_READY) {
+			CHECK_VK_RESULT(res, "vkGetQueryPoolResults\n");
+		}
+
+		for (int i = 0; i < (int)m_scopes.size(); i++) {
+			const uint64_t* pBegin = &m_results[i * 4];
+			const uint64_t* pEnd = pBegin + 2;
+
+			// [0] is the value and [1] is the availability
+			if (!pBegin[1] || !pEnd[1]) {
+				continue;
+			}
+
+			// The counter can wrap around within the valid bits
+			uint64_t Ticks = (pEnd[0] - pBegin[0]) & m_timestampMask;
+			float Time = (float)((double)Ticks * m_timestampPeriod / 1000000.0);
+
+			Scope& s = m_scopes[i];
+
+			if (s.m_numSamples == GPU_PROFILER_HISTORY) {
+				s.m_sum -= s.m_samples[s.m_nextSample];
+			}
+			else {
+				s.m_numSamples++;
+			}
+
+			s.m_samples[s.m_nextSample] = Time;
+			s.m_sum += Time;
+			s.m_nextSample = (s.m_nextSample + 1) % GPU_PROFILER_HISTORY;
+		}
+	}
+
+
+	static float GetPercentile(const std::vector<float>& SortedSamples, int Percentile)
+	{
+		int Index = ((int)SortedSamples.size() - 1) * Percentile / 100;
+		return SortedSamples[Index];
+	}
+
+
+	void VulkanGpuProfiler::GetStats(std::vector<GpuScopeStats>& Stats) const
+	{
+		Stats.clear();
+
+		std::vector<float> Sorted;
+
+		for (const Scope& s : m_scopes) {
+			if (s.m_numSamples == 0) {
+				continue;
+			}
+
+			Sorted.assign(s.m_samples, s.m_samples + s.m_numSamples);
+			std::sort(Sorted.begin(), Sorted.end());
+
+			GpuScopeStats ScopeStats;
+			ScopeStats.m_name = s.m_name;
+			ScopeStats.m_numSamples = s.m_numSamples;
+			ScopeStats.m_last = s.m_samples[(s.m_nextSample + GPU_PROFILER_HISTORY - 1) % GPU_PROFILER_HISTORY];
+			ScopeStats.m_average = (float)(s.m_sum / s.m_numSamples);
+			ScopeStats.m_min = Sorted.front();
+			ScopeStats.m_max = Sorted.back();
+			ScopeStats.m_p50 = GetPercentile(Sorted, 50);
+			ScopeStats.m_p95 = GetPercentile(Sorted, 95);
+			ScopeStats.m_p99 = GetPercentile(Sorted, 99);
+
+			Stats.push_back(ScopeStats);
+		}
+	}
+
+
+	bool VulkanGpuProfiler::DumpToFile(const char* pFilename) const
+	{
+		FILE* f = fopen(pFilename, "w");
+
+		if (!f) {
+			printf("Error opening '%s' for writing\n", pFilename);
+			return false;
+		}
+
+		std::vector<GpuScopeStats> Stats;
+		GetStats(Stats);
+
+		fprintf(f, "GPU scopes - times in ms over the last %d samples, %.3f ns per timestamp tick\n\n",
+			GPU_PROFILER_HISTORY, m_timestampPeriod);
+		fprintf(f, "%-24s %8s %9s %9s %9s %9s %9s %9s %9s\n",
+			"Scope", "Samples", "Last", "Average", "Min", "Max", "P50", "P95", "P99");
+
+		for (const GpuScopeStats& s : Stats) {
+			fprintf(f, "%-24s %8d %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+				s.m_name.c_str(), s.m_numSamples, s.m_last, s.m_average, s.m_min, s.m_max, s.m_p50, s.m_p95, s.m_p99);
+		}
+
+		fclose(f);
+
+		printf("GPU profile written to '%s'\n", pFilename);
+
+		return true;
+	}
+
+}
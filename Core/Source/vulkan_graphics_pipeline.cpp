@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stddef.h>
+#include <chrono>
 
 #include "util.h"
 #include "vulkan_util.h"
@@ -8,31 +10,49 @@
 enum Binding {
 	BindingVB = 0,
 	BindingIB = 1,
-	BindingUniform = 2,
-	BindingTexture = 3,
-	BindingCount = 4
+	BindingUniform = 2,		// the WVP matrices of all the instances - per image
+	BindingMaterials = 3,
+	BindingDrawData = 4,
+	BindingTransforms = 5,	// the transformations of all the submeshes
+	BindingCount = 6
 };
 
+// The specialization constants of the vertex shader
+struct VertexShaderSpecData {
+	VkBool32 IndexedDraws;		// constant_id 0 - how the indices are fetched
+	VkBool32 PackedVertices;	// constant_id 1 - the layout of the vertex buffer
+};
+
+// Set 0 is per model and set 1 is the bindless texture table of VulkanCore
+#define NUM_DESCRIPTOR_SETS 2
+
 
 namespace Engine {
 
 	GraphicsPipeline::GraphicsPipeline(VkDevice Device,
-		GLFWwindow* pWindow,
 		VkRenderPass RenderPass,
 		VkShaderModule vs,
 		VkShaderModule fs,
-		int NumImages)
+		int NumImages,
+		VkDescriptorSetLayout TextureTableLayout,
+		VkPipelineCache PipelineCache,
+		bool IndexedDraws,
+		bool PackedVertices)
 	{
 		m_device = Device;
 		m_numImages = NumImages;
+		m_indexedDraws = IndexedDraws;
+		m_packedVertices = PackedVertices;
 
 		bool IsVB = true;
 		bool IsIB = true;
 		bool IsUniform = true;
-		bool IsTex = true;
-		CreateDescriptorSetLayout(IsVB, IsIB, IsUniform, IsTex);
+		bool IsMaterials = true;
+		bool IsDrawData = true;
+		bool IsTransforms = true;
+		CreateDescriptorSetLayout(IsVB, IsIB, IsMaterials, IsUniform, IsDrawData, IsTransforms);
 
-		InitCommon(pWindow, RenderPass, vs, fs);
+		InitCommon(RenderPass, vs, fs, TextureTableLayout, PipelineCache);
 	}
 
 
@@ -51,14 +71,41 @@ namespace Engine {
 	}
 
 
-	void GraphicsPipeline::InitCommon(GLFWwindow* pWindow, VkRenderPass RenderPass, VkShaderModule vs, VkShaderModule fs)
+	void GraphicsPipeline::InitCommon(VkRenderPass RenderPass, VkShaderModule vs, VkShaderModule fs,
+		VkDescriptorSetLayout TextureTableLayout, VkPipelineCache PipelineCache)
 	{
+		VertexShaderSpecData SpecData = {
+			.IndexedDraws = m_indexedDraws ? VK_TRUE : VK_FALSE,
+			.PackedVertices = m_packedVertices ? VK_TRUE : VK_FALSE
+		};
+
+		VkSpecializationMapEntry SpecMapEntries[] = {
+			{
+				.constantID = 0,
+				.offset = offsetof(VertexShaderSpecData, IndexedDraws),
+				.size = sizeof(VkBool32)
+			},
+			{
+				.constantID = 1,
+				.offset = offsetof(VertexShaderSpecData, PackedVertices),
+				.size = sizeof(VkBool32)
+			}
+		};
+
+		VkSpecializationInfo SpecInfo = {
+			.mapEntryCount = ARRAY_SIZE_IN_ELEMENTS(SpecMapEntries),
+			.pMapEntries = SpecMapEntries,
+			.dataSize = sizeof(SpecData),
+			.pData = &SpecData
+		};
+
 		VkPipelineShaderStageCreateInfo ShaderStageCreateInfo[2] = {
 			{
 				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
 				.stage = VK_SHADER_STAGE_VERTEX_BIT,
 				.module = vs,
 				.pName = "main",
+				.pSpecializationInfo = &SpecInfo
 			},
 			{
 				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -78,35 +125,22 @@ namespace Engine {
 			.primitiveRestartEnable = VK_FALSE
 		};
 
-		int WindowWidth, WindowHeight;
-		glfwGetWindowSize(pWindow, &WindowWidth, &WindowHeight);
-
-		VkViewport VP = {
-			.x = 0.0f,
-			.y = 0.0f,
-			.width = (float)WindowWidth,
-			.height = (float)WindowHeight,
-			.minDepth = 0.0f,
-			.maxDepth = 1.0f
-		};
-
-		VkRect2D Scissor{
-			.offset = {
-				.x = 0,
-				.y = 0,
-			},
-			.extent = {
-				.width = (uint32_t)WindowWidth,
-				.height = (uint32_t)WindowHeight
-			}
-		};
-
+		// The viewport and the scissor are set when the command buffer is recorded
+		// so that a resize doesn't require a new pipeline
 		VkPipelineViewportStateCreateInfo VPCreateInfo = {
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
 			.viewportCount = 1,
-			.pViewports = &VP,
+			.pViewports = NULL,
 			.scissorCount = 1,
-			.pScissors = &Scissor
+			.pScissors = NULL
+		};
+
+		VkDynamicState DynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+		VkPipelineDynamicStateCreateInfo DynamicStateInfo = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+			.dynamicStateCount = ARRAY_SIZE_IN_ELEMENTS(DynamicStates),
+			.pDynamicStates = DynamicStates
 		};
 
 		VkPipelineRasterizationStateCreateInfo RastCreateInfo = {
@@ -154,8 +188,10 @@ namespace Engine {
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO
 		};
 
-		LayoutInfo.setLayoutCount = 1;
-		LayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+		VkDescriptorSetLayout SetLayouts[NUM_DESCRIPTOR_SETS] = { m_descriptorSetLayout, TextureTableLayout };
+
+		LayoutInfo.setLayoutCount = NUM_DESCRIPTOR_SETS;
+		LayoutInfo.pSetLayouts = SetLayouts;
 
 		VkResult res = vkCreatePipelineLayout(m_device, &LayoutInfo, NULL, &m_pipelineLayout);
 		CHECK_VK_RESULT(res, "vkCreatePipelineLayout\n");
@@ -171,6 +207,7 @@ namespace Engine {
 			.pMultisampleState = &PipelineMSCreateInfo,
 			.pDepthStencilState = &DepthStencilState,
 			.pColorBlendState = &BlendCreateInfo,
+			.pDynamicState = &DynamicStateInfo,
 			.layout = m_pipelineLayout,
 			.renderPass = RenderPass,
 			.subpass = 0,
@@ -178,21 +215,33 @@ namespace Engine {
 			.basePipelineIndex = -1
 		};
 
-		res = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &PipelineInfo, NULL, &m_pipeline);
+		// The creation time shows whether the driver found the pipeline in the cache
+		auto StartTime = std::chrono::steady_clock::now();
+
+		res = vkCreateGraphicsPipelines(m_device, PipelineCache, 1, &PipelineInfo, NULL, &m_pipeline);
 		CHECK_VK_RESULT(res, "vkCreateGraphicsPipelineV2s\n");
 
-		printf("Graphics pipeline created\n");
+		std::chrono::duration<double, std::milli> Duration = std::chrono::steady_clock::now() - StartTime;
+
+		printf("Graphics pipeline created in %.2f ms\n", Duration.count());
 	}
 
 
 	void GraphicsPipeline::CreateDescriptorPool(int MaxSets)
 	{
+		VkDescriptorPoolSize PoolSizes[] = {
+			{
+				.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = (uint32_t)(BindingCount * MaxSets)	// all the bindings are storage buffers
+			}
+		};
+
 		VkDescriptorPoolCreateInfo PoolInfo = {
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
 			.flags = 0,
 			.maxSets = (uint32_t)MaxSets,
-			.poolSizeCount = 0,
-			.pPoolSizes = NULL
+			.poolSizeCount = ARRAY_SIZE_IN_ELEMENTS(PoolSizes),
+			.pPoolSizes = PoolSizes
 		};
 
 		VkResult res = vkCreateDescriptorPool(m_device, &PoolInfo, NULL, &m_descriptorPool);
@@ -201,7 +250,8 @@ namespace Engine {
 	}
 
 
-	void GraphicsPipeline::CreateDescriptorSetLayout(bool IsVB, bool IsIB, bool IsTex, bool IsUniform)
+	void GraphicsPipeline::CreateDescriptorSetLayout(bool IsVB, bool IsIB, bool IsMaterials, bool IsUniform, bool IsDrawData,
+		bool IsTransforms)
 	{
 		std::vector<VkDescriptorSetLayoutBinding> LayoutBindings;
 
@@ -230,7 +280,7 @@ namespace Engine {
 		if (IsUniform) {
 			VkDescriptorSetLayoutBinding VertexShaderLayoutBinding_Uniform = {
 				.binding = BindingUniform,
-				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 				.descriptorCount = 1,
 				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
 			};
@@ -238,15 +288,37 @@ namespace Engine {
 			LayoutBindings.push_back(VertexShaderLayoutBinding_Uniform);
 		}
 
-		if (IsTex) {
-			VkDescriptorSetLayoutBinding FragmentShaderLayoutBinding_Tex = {
-				.binding = BindingTexture,
-				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		if (IsMaterials) {
+			VkDescriptorSetLayoutBinding FragmentShaderLayoutBinding_Materials = {
+				.binding = BindingMaterials,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 				.descriptorCount = 1,
 				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
 			};
 
-			LayoutBindings.push_back(FragmentShaderLayoutBinding_Tex);
+			LayoutBindings.push_back(FragmentShaderLayoutBinding_Materials);
+		}
+
+		if (IsDrawData) {
+			VkDescriptorSetLayoutBinding VertexShaderLayoutBinding_DrawData = {
+				.binding = BindingDrawData,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+			};
+
+			LayoutBindings.push_back(VertexShaderLayoutBinding_DrawData);
+		}
+
+		if (IsTransforms) {
+			VkDescriptorSetLayoutBinding VertexShaderLayoutBinding_Transforms = {
+				.binding = BindingTransforms,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+			};
+
+			LayoutBindings.push_back(VertexShaderLayoutBinding_Transforms);
 		}
 
 		VkDescriptorSetLayoutCreateInfo LayoutInfo = {
@@ -262,16 +334,16 @@ namespace Engine {
 	}
 
 
-	void GraphicsPipeline::AllocateDescriptorSets(int NumSubmeshes, std::vector<std::vector<VkDescriptorSet>>& DescriptorSets)
+	void GraphicsPipeline::AllocateDescriptorSets(std::vector<VkDescriptorSet>& DescriptorSets)
 	{
-		CreateDescriptorPool(NumSubmeshes * m_numImages);
-		AllocateDescriptorSetsInternal(NumSubmeshes, DescriptorSets);
+		CreateDescriptorPool(m_numImages);
+		AllocateDescriptorSetsInternal(DescriptorSets);
 	}
 
 
-	void GraphicsPipeline::AllocateDescriptorSetsInternal(int NumSubmeshes, std::vector<std::vector<VkDescriptorSet>>& DescriptorSets)
+	void GraphicsPipeline::AllocateDescriptorSetsInternal(std::vector<VkDescriptorSet>& DescriptorSets)
 	{
-		std::vector<VkDescriptorSetLayout> Layouts(NumSubmeshes, m_descriptorSetLayout);
+		std::vector<VkDescriptorSetLayout> Layouts(m_numImages, m_descriptorSetLayout);
 
 		VkDescriptorSetAllocateInfo AllocInfo = {
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
@@ -283,110 +355,135 @@ namespace Engine {
 
 		DescriptorSets.resize(m_numImages);
 
-		for (int ImageIndex = 0; ImageIndex < DescriptorSets.size(); ImageIndex++) {
-			DescriptorSets[ImageIndex].resize(NumSubmeshes);
-
-			VkResult res = vkAllocateDescriptorSets(m_device, &AllocInfo, DescriptorSets[ImageIndex].data());
-			CHECK_VK_RESULT(res, "vkAllocateDescriptorSets");
-		}
+		VkResult res = vkAllocateDescriptorSets(m_device, &AllocInfo, DescriptorSets.data());
+		CHECK_VK_RESULT(res, "vkAllocateDescriptorSets");
 	}
 
 
-	void GraphicsPipeline::UpdateDescriptorSets(const ModelDesc& ModelDesc,
-		std::vector<std::vector<VkDescriptorSet>>& DescriptorSets)
+	void GraphicsPipeline::UpdateDescriptorSets(const ModelDesc& ModelDesc, std::vector<VkDescriptorSet>& DescriptorSets)
 	{
-		uint32_t NumSubmeshes = (uint32_t)DescriptorSets[0].size();
+		std::vector<VkWriteDescriptorSet> WriteDescriptorSet(m_numImages * BindingCount);
 
-		std::vector<VkWriteDescriptorSet> WriteDescriptorSet(m_numImages * NumSubmeshes * BindingCount);
+		VkDescriptorBufferInfo BufferInfo_VB = {
+			.buffer = ModelDesc.m_vb,
+			.offset = 0,
+			.range = VK_WHOLE_SIZE
+		};
 
-		std::vector<VkDescriptorBufferInfo> BufferInfo_VBs(NumSubmeshes);
-		std::vector<VkDescriptorBufferInfo> BufferInfo_IBs(NumSubmeshes);
-		std::vector<std::vector<VkDescriptorBufferInfo>> BufferInfo_Uniforms(m_numImages);
-		std::vector<VkDescriptorImageInfo> ImageInfo(NumSubmeshes);
+		VkDescriptorBufferInfo BufferInfo_IB = {
+			.buffer = ModelDesc.m_ib,
+			.offset = 0,
+			.range = VK_WHOLE_SIZE
+		};
 
-		for (uint32_t SubmeshIndex = 0; SubmeshIndex < NumSubmeshes; SubmeshIndex++) {
-			BufferInfo_VBs[SubmeshIndex].buffer = ModelDesc.m_vb;
-			BufferInfo_VBs[SubmeshIndex].offset = ModelDesc.m_ranges[SubmeshIndex].m_vbRange.m_offset;
-			BufferInfo_VBs[SubmeshIndex].range = ModelDesc.m_ranges[SubmeshIndex].m_vbRange.m_range;
+		VkDescriptorBufferInfo BufferInfo_DrawData = {
+			.buffer = ModelDesc.m_drawData,
+			.offset = 0,
+			.range = VK_WHOLE_SIZE
+		};
+
+		VkDescriptorBufferInfo BufferInfo_Materials = {
+			.buffer = ModelDesc.m_materials,
+			.offset = 0,
+			.range = VK_WHOLE_SIZE
+		};
+
+		VkDescriptorBufferInfo BufferInfo_Transforms = {
+			.buffer = ModelDesc.m_transforms,
+			.offset = 0,
+			.range = VK_WHOLE_SIZE
+		};
 
-			BufferInfo_IBs[SubmeshIndex].buffer = ModelDesc.m_ib;
-			BufferInfo_IBs[SubmeshIndex].offset = ModelDesc.m_ranges[SubmeshIndex].m_ibRange.m_offset;
-			BufferInfo_IBs[SubmeshIndex].range = ModelDesc.m_ranges[SubmeshIndex].m_ibRange.m_range;
+		std::vector<VkDescriptorBufferInfo> BufferInfo_Uniforms(m_numImages);
 
-			ImageInfo[SubmeshIndex].sampler = ModelDesc.m_materials[SubmeshIndex].m_sampler;
-			ImageInfo[SubmeshIndex].imageView = ModelDesc.m_materials[SubmeshIndex].m_imageView;
-			ImageInfo[SubmeshIndex].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		for (int ImageIndex = 0; ImageIndex < m_numImages; ImageIndex++) {
+			BufferInfo_Uniforms[ImageIndex].buffer = ModelDesc.m_uniforms[ImageIndex];
+			BufferInfo_Uniforms[ImageIndex].offset = ModelDesc.m_uniformRanges[ImageIndex].m_offset;
+			BufferInfo_Uniforms[ImageIndex].range = ModelDesc.m_uniformRanges[ImageIndex].m_range;
 		}
 
 		int WdsIndex = 0;
 
 		for (int ImageIndex = 0; ImageIndex < m_numImages; ImageIndex++) {
+			VkDescriptorSet DstSet = DescriptorSets[ImageIndex];
 
-			BufferInfo_Uniforms[ImageIndex].resize(NumSubmeshes);
+			VkWriteDescriptorSet wds = {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = DstSet,
+				.dstBinding = BindingVB,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &BufferInfo_VB
+			};
 
-			for (uint32_t SubmeshIndex = 0; SubmeshIndex < NumSubmeshes; SubmeshIndex++) {
-				BufferInfo_Uniforms[ImageIndex][SubmeshIndex].buffer = ModelDesc.m_uniforms[ImageIndex];
-				BufferInfo_Uniforms[ImageIndex][SubmeshIndex].offset = ModelDesc.m_ranges[SubmeshIndex].m_uniformRange.m_offset;
-				BufferInfo_Uniforms[ImageIndex][SubmeshIndex].range = ModelDesc.m_ranges[SubmeshIndex].m_uniformRange.m_range;
-			}
-		}
+			assert(WdsIndex < WriteDescriptorSet.size());
+			WriteDescriptorSet[WdsIndex++] = wds;
 
-		for (int ImageIndex = 0; ImageIndex < m_numImages; ImageIndex++) {
-			for (uint32_t SubmeshIndex = 0; SubmeshIndex < NumSubmeshes; SubmeshIndex++) {
-				VkDescriptorSet DstSet = DescriptorSets[ImageIndex][SubmeshIndex];
-
-				VkWriteDescriptorSet wds = {
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.dstSet = DstSet,
-					.dstBinding = BindingVB,
-					.dstArrayElement = 0,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-					.pBufferInfo = &BufferInfo_VBs[SubmeshIndex]
-				};
-
-				assert(WdsIndex < WriteDescriptorSet.size());
-				WriteDescriptorSet[WdsIndex++] = wds;
-
-				wds = {
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.dstSet = DstSet,
-					.dstBinding = BindingIB,
-					.dstArrayElement = 0,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-					.pBufferInfo = &BufferInfo_IBs[SubmeshIndex]
-				};
-
-				assert(WdsIndex < WriteDescriptorSet.size());
-				WriteDescriptorSet[WdsIndex++] = wds;
-
-				wds = {
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.dstSet = DstSet,
-					.dstBinding = BindingUniform,
-					.dstArrayElement = 0,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-					.pBufferInfo = &BufferInfo_Uniforms[ImageIndex][SubmeshIndex]
-				};
-
-				assert(WdsIndex < WriteDescriptorSet.size());
-				WriteDescriptorSet[WdsIndex++] = wds;
-
-				wds = {
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.dstSet = DstSet,
-					.dstBinding = BindingTexture,
-					.dstArrayElement = 0,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-					.pImageInfo = &ImageInfo[SubmeshIndex]
-				};
-
-				assert(WdsIndex < WriteDescriptorSet.size());
-				WriteDescriptorSet[WdsIndex++] = wds;
-			}
+			wds = {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = DstSet,
+				.dstBinding = BindingIB,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &BufferInfo_IB
+			};
+
+			assert(WdsIndex < WriteDescriptorSet.size());
+			WriteDescriptorSet[WdsIndex++] = wds;
+
+			wds = {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = DstSet,
+				.dstBinding = BindingUniform,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &BufferInfo_Uniforms[ImageIndex]
+			};
+
+			assert(WdsIndex < WriteDescriptorSet.size());
+			WriteDescriptorSet[WdsIndex++] = wds;
+
+			wds = {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = DstSet,
+				.dstBinding = BindingMaterials,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &BufferInfo_Materials
+			};
+
+			assert(WdsIndex < WriteDescriptorSet.size());
+			WriteDescriptorSet[WdsIndex++] = wds;
+
+			wds = {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = DstSet,
+				.dstBinding = BindingDrawData,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &BufferInfo_DrawData
+			};
+
+			assert(WdsIndex < WriteDescriptorSet.size());
+			WriteDescriptorSet[WdsIndex++] = wds;
+
+			wds = {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = DstSet,
+				.dstBinding = BindingTransforms,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &BufferInfo_Transforms
+			};
+
+			assert(WdsIndex < WriteDescriptorSet.size());
+			WriteDescriptorSet[WdsIndex++] = wds;
 		}
 
 		vkUpdateDescriptorSets(m_device, (uint32_t)WriteDescriptorSet.size(), WriteDescriptorSet.data(), 0, NULL);
@@ -19,10 +19,16 @@ namespace Engine {
 	{
 		m_vb.Destroy(m_pVulkanCore->GetDevice());
 		m_ib.Destroy(m_pVulkanCore->GetDevice());
+		m_drawData.Destroy(m_pVulkanCore->GetDevice());
+		m_transforms.Destroy(m_pVulkanCore->GetDevice());
+		m_materialBuffer.Destroy(m_pVulkanCore->GetDevice());
 
-		for (int i = 0; i < m_uniformBuffers.size(); i++) {
-			m_uniformBuffers[i].Destroy(m_pVulkanCore->GetDevice());
+		for (Texture* pTexture : m_textures) {
+			pTexture->Destroy(m_pVulkanCore->GetDevice());
+			delete pTexture;
 		}
+
+		m_textures.clear();
 	}
 
 
@@ -36,20 +42,131 @@ namespace Engine {
 
 	void VkModel::PopulateBuffers(std::vector<Vertex>& Vertices)
 	{
-		m_vb = m_pVulkanCore->CreateVertexBuffer(Vertices.data(), ARRAY_SIZE_IN_BYTES(Vertices));
+		if (m_packedVertices) {
+			std::vector<PackedVertex> PackedVertices;
+			PackVertices(Vertices, PackedVertices, m_dequantize);
+
+			m_vb = m_pVulkanCore->CreateVertexBuffer(PackedVertices.data(), ARRAY_SIZE_IN_BYTES(PackedVertices));
+			m_vertexSize = sizeof(PackedVertex);
+		}
+		else {
+			m_vb = m_pVulkanCore->CreateVertexBuffer(Vertices.data(), ARRAY_SIZE_IN_BYTES(Vertices));
+			m_vertexSize = sizeof(Vertex);
+			m_dequantize.assign(m_Meshes.size(), glm::mat4(1.0f));
+		}
+
+		// Bound as a regular index buffer or read by the vertex shader
+		m_ib = m_pVulkanCore->CreateDeviceLocalBuffer(m_Indices.data(), ARRAY_SIZE_IN_BYTES(m_Indices),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
 
-		m_ib = m_pVulkanCore->CreateVertexBuffer(m_Indices.data(), ARRAY_SIZE_IN_BYTES(m_Indices));
+		// The WVP matrices of the instances live in the persistently mapped frame allocator
+		m_uniformOffset = m_pVulkanCore->GetFrameAllocator().Reserve(UNIFORM_BUFFER_SIZE * m_maxInstances);
 
-		m_uniformBuffers = m_pVulkanCore->CreateUniformBuffers(UNIFORM_BUFFER_SIZE * m_Meshes.size());
+		// So are the indirect draws since they depend on the camera. A submesh
+		// takes at most one draw per meshlet.
+		m_maxDraws = 0;
 
-		m_vertexSize = sizeof(Vertex);
+		for (const BasicMeshEntry& Mesh : m_Meshes) {
+			m_maxDraws += (Mesh.NumMeshlets > 0) ? Mesh.NumMeshlets : 1;
+		}
+
+		m_drawCmdOffset = m_pVulkanCore->GetFrameAllocator().Reserve(sizeof(VkDrawIndexedIndirectCommand) * m_maxDraws);
+		m_drawCountOffset = m_pVulkanCore->GetFrameAllocator().Reserve(sizeof(uint32_t));
 	}
 
 
-	void VkModel::CreateDescriptorSets(GraphicsPipeline& Pipeline)
+	void VkModel::CreateDrawDataBuffer()
 	{
 		int NumSubmeshes = (int)m_Meshes.size();
-		Pipeline.AllocateDescriptorSets(NumSubmeshes, m_descriptorSets);
+
+		std::vector<DrawData> Draws(NumSubmeshes);
+
+		for (int SubmeshIndex = 0; SubmeshIndex < NumSubmeshes; SubmeshIndex++) {
+			const BasicMeshEntry& Mesh = m_Meshes[SubmeshIndex];
+
+			int MaterialIndex = Mesh.MaterialIndex;
+
+			if ((MaterialIndex < 0) || (!m_Materials[MaterialIndex].pDiffuse)) {
+				printf("No diffuse texture in material %d\n", MaterialIndex);
+				exit(0);
+			}
+
+			Draws[SubmeshIndex].BaseVertex = Mesh.BaseVertex;
+			Draws[SubmeshIndex].BaseIndex = Mesh.BaseIndex;
+			Draws[SubmeshIndex].TransformIndex = SubmeshIndex;
+			Draws[SubmeshIndex].MaterialIndex = MaterialIndex;
+		}
+
+		m_drawData = m_pVulkanCore->CreateDeviceLocalBuffer(Draws.data(), ARRAY_SIZE_IN_BYTES(Draws),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	}
+
+
+	// The transformations of the submeshes don't depend on the instance so they
+	// are uploaded once. The vertex shader applies the WVP of the instance on top.
+	void VkModel::CreateTransformBuffer()
+	{
+		std::vector<glm::mat4> Transforms(m_Meshes.size());
+
+		for (int SubmeshIndex = 0; SubmeshIndex < (int)m_Meshes.size(); SubmeshIndex++) {
+			Transforms[SubmeshIndex] = m_Meshes[SubmeshIndex].Transformation * m_dequantize[SubmeshIndex];
+		}
+
+		m_transforms = m_pVulkanCore->CreateDeviceLocalBuffer(Transforms.data(), ARRAY_SIZE_IN_BYTES(Transforms),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	}
+
+
+	static uint32_t GetBindlessIndex(const Texture* pTexture)
+	{
+		return pTexture ? pTexture->m_bindlessIndex : INVALID_TEXTURE_INDEX;
+	}
+
+
+	void VkModel::CreateMaterialBuffer()
+	{
+		std::vector<MaterialData> Materials(m_Materials.size());
+
+		for (int i = 0; i < (int)m_Materials.size(); i++) {
+			Materials[i].DiffuseColor = m_Materials[i].DiffuseColor;
+			Materials[i].DiffuseTexture = GetBindlessIndex(m_Materials[i].pDiffuse);
+			Materials[i].NormalTexture = GetBindlessIndex(m_Materials[i].pNormal);
+			Materials[i].SpecularTexture = GetBindlessIndex(m_Materials[i].pSpecularExponent);
+		}
+
+		m_materialBuffer = m_pVulkanCore->CreateDeviceLocalBuffer(Materials.data(), ARRAY_SIZE_IN_BYTES(Materials),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	}
+
+
+	void VkModel::InitGeometryPost()
+	{
+		CreateDrawDataBuffer();
+		CreateTransformBuffer();
+
+		m_frustumCuller.SetBoxes(m_Meshes);
+		m_visibleSubmeshes.resize(m_Meshes.size());
+
+		// The boxes of the submeshes are already in the space of the model
+		m_boundsMin = glm::vec3(FLT_MAX);
+		m_boundsMax = glm::vec3(-FLT_MAX);
+
+		for (const BasicMeshEntry& Mesh : m_Meshes) {
+			m_boundsMin = glm::min(m_boundsMin, Mesh.MinPos);
+			m_boundsMax = glm::max(m_boundsMax, Mesh.MaxPos);
+		}
+
+		// The textures are in the bindless table only after they are loaded
+		CreateMaterialBuffer();
+
+		// Wait for the vertex/index buffers and the textures to reach the GPU
+		m_pVulkanCore->FlushUploads();
+	}
+
+
+	void VkModel::CreateDescriptorSets(GraphicsPipeline& Pipeline)
+	{
+		Pipeline.AllocateDescriptorSets(m_descriptorSets);
 
 		ModelDesc md;
 
@@ -63,77 +180,305 @@ namespace Engine {
 	{
 		md.m_vb = m_vb.m_buffer;
 		md.m_ib = m_ib.m_buffer;
+		md.m_drawData = m_drawData.m_buffer;
+		md.m_materials = m_materialBuffer.m_buffer;
+		md.m_transforms = m_transforms.m_buffer;
+
+		const VulkanFrameAllocator& FrameAllocator = m_pVulkanCore->GetFrameAllocator();
 
 		md.m_uniforms.resize(m_pVulkanCore->GetNumImages());
+		md.m_uniformRanges.resize(m_pVulkanCore->GetNumImages());
 
 		for (int ImageIndex = 0; ImageIndex < m_pVulkanCore->GetNumImages(); ImageIndex++) {
-			md.m_uniforms[ImageIndex] = m_uniformBuffers[ImageIndex].m_buffer;
+			md.m_uniforms[ImageIndex] = FrameAllocator.GetBuffer();
+			md.m_uniformRanges[ImageIndex].m_offset = FrameAllocator.GetFrameOffset(ImageIndex) + m_uniformOffset;
+			md.m_uniformRanges[ImageIndex].m_range = UNIFORM_BUFFER_SIZE * m_maxInstances;
 		}
+	}
 
-		md.m_materials.resize(m_Meshes.size());
-		md.m_ranges.resize(m_Meshes.size());
 
-		int NumSubmeshes = (int)m_Meshes.size();
+	void VkModel::BindDescriptorSets(VkCommandBuffer CmdBuf, GraphicsPipeline& Pipeline, int ImageIndex)
+	{
+		// The model data and the bindless texture table
+		VkDescriptorSet DescriptorSets[] = { m_descriptorSets[ImageIndex], m_pVulkanCore->GetTextureTable().GetDescriptorSet() };
+
+		vkCmdBindDescriptorSets(CmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS,
+			Pipeline.GetPipelineLayout(),
+			0,  // firstSet
+			ARRAY_SIZE_IN_ELEMENTS(DescriptorSets),  // descriptorSetCount
+			DescriptorSets,
+			0,	// dynamicOffsetCount
+			NULL);	// pDynamicOffsets
+	}
 
-		for (int SubmeshIndex = 0; SubmeshIndex < NumSubmeshes; SubmeshIndex++) {
-			int MaterialIndex = m_Meshes[SubmeshIndex].MaterialIndex;
 
-			if ((MaterialIndex >= 0) && (m_Materials[MaterialIndex].pDiffuse)) {
-				Texture* pDiffuse = m_Materials[MaterialIndex].pDiffuse;
-				md.m_materials[SubmeshIndex].m_sampler = pDiffuse->m_sampler;
-				md.m_materials[SubmeshIndex].m_imageView = pDiffuse->m_view;
+	void VkModel::RecordCommandBuffer(VkCommandBuffer CmdBuf, GraphicsPipeline& Pipeline, int ImageIndex)
+	{
+		BindDescriptorSets(CmdBuf, Pipeline, ImageIndex);
+
+		// All the visible submeshes in a single call. The commands and their count are written
+		// by Update() so the command buffer doesn't change when the camera moves.
+		const VulkanFrameAllocator& FrameAllocator = m_pVulkanCore->GetFrameAllocator();
+		VkDeviceSize FrameOffset = FrameAllocator.GetFrameOffset(ImageIndex);
+		uint32_t MaxDraws = m_maxDraws;
+
+		assert(Pipeline.IsIndexedDraws() == m_indexedDraws);
+
+		if (m_indexedDraws) {
+			vkCmdBindIndexBuffer(CmdBuf, m_ib.m_buffer, 0, VK_INDEX_TYPE_UINT32);
+
+			vkCmdDrawIndexedIndirectCount(CmdBuf,
+				FrameAllocator.GetBuffer(), FrameOffset + m_drawCmdOffset,
+				FrameAllocator.GetBuffer(), FrameOffset + m_drawCountOffset,
+				MaxDraws, sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else {
+			vkCmdDrawIndirectCount(CmdBuf,
+				FrameAllocator.GetBuffer(), FrameOffset + m_drawCmdOffset,
+				FrameAllocator.GetBuffer(), FrameOffset + m_drawCountOffset,
+				MaxDraws, sizeof(VkDrawIndirectCommand));
+		}
+	}
+
+
+	// The number of draws is known on the CPU at this point so the count buffer is not needed
+	void VkModel::RecordDraws(VkCommandBuffer CmdBuf, GraphicsPipeline& Pipeline, int ImageIndex, int FirstDraw, int NumDraws)
+	{
+		assert(FirstDraw + NumDraws <= GetNumDraws(ImageIndex));
+		assert(Pipeline.IsIndexedDraws() == m_indexedDraws);
+
+		BindDescriptorSets(CmdBuf, Pipeline, ImageIndex);
+
+		const VulkanFrameAllocator& FrameAllocator = m_pVulkanCore->GetFrameAllocator();
+		VkDeviceSize Offset = FrameAllocator.GetFrameOffset(ImageIndex) + m_drawCmdOffset;
+
+		if (m_indexedDraws) {
+			vkCmdBindIndexBuffer(CmdBuf, m_ib.m_buffer, 0, VK_INDEX_TYPE_UINT32);
+
+			vkCmdDrawIndexedIndirect(CmdBuf, FrameAllocator.GetBuffer(),
+				Offset + FirstDraw * sizeof(VkDrawIndexedIndirectCommand),
+				NumDraws, sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else {
+			vkCmdDrawIndirect(CmdBuf, FrameAllocator.GetBuffer(),
+				Offset + FirstDraw * sizeof(VkDrawIndirectCommand),
+				NumDraws, sizeof(VkDrawIndirectCommand));
+		}
+	}
+
+
+	void VkModel::Update(int ImageIndex, const glm::mat4& Transformation)
+	{
+		// Write straight into the mapped memory of the current image - no staging and no map/unmap
+		glm::mat4* pDst = (glm::mat4*)m_pVulkanCore->GetFrameAllocator().GetReservedPtr(ImageIndex, m_uniformOffset);
+
+		// A single instance
+		pDst[0] = Transformation;
+		m_numVisibleInstances = 1;
+
+		UpdateDrawCommands(ImageIndex, Transformation);
+	}
+
+
+	void VkModel::SetMaxInstances(int MaxInstances)
+	{
+		if (m_vb.m_buffer) {
+			MY_ERROR("SetMaxInstances must be called before the model is loaded\n");
+			exit(1);
+		}
+
+		m_maxInstances = (MaxInstances > 0) ? MaxInstances : 1;
+	}
+
+
+	void VkModel::UpdateInstances(int ImageIndex, const glm::mat4& VP, const std::vector<glm::mat4>& WorldMatrices)
+	{
+		if ((int)WorldMatrices.size() > m_maxInstances) {
+			MY_ERROR("%d instances but SetMaxInstances() was called with %d\n", (int)WorldMatrices.size(), m_maxInstances);
+			exit(1);
+		}
+
+		const VulkanFrameAllocator& FrameAllocator = m_pVulkanCore->GetFrameAllocator();
+		glm::mat4* pDst = (glm::mat4*)FrameAllocator.GetReservedPtr(ImageIndex, m_uniformOffset);
+
+		// The culled instances are compacted so that the draws can use a contiguous range
+		int NumVisible = 0;
+
+		for (const glm::mat4& World : WorldMatrices) {
+			glm::mat4 WVP = VP * World;
+
+			if (!m_frustumCulling || IsBoxVisible(WVP, m_boundsMin, m_boundsMax)) {
+				pDst[NumVisible++] = WVP;
 			}
-			else {
-				printf("No diffuse texture in material %d\n", MaterialIndex);
-				exit(0);
+		}
+
+		void* pCommands = FrameAllocator.GetReservedPtr(ImageIndex, m_drawCmdOffset);
+		uint32_t* pCount = (uint32_t*)FrameAllocator.GetReservedPtr(ImageIndex, m_drawCountOffset);
+
+		int NumTriangles = 0;
+		int NumDraws = 0;
+
+		// One draw per submesh for all the visible instances. The submeshes are
+		// not culled per instance and LOD 0 is used since the instances are at
+		// different distances.
+		if (NumVisible > 0) {
+			for (uint32_t SubmeshIndex = 0; SubmeshIndex < m_Meshes.size(); SubmeshIndex++) {
+				const MeshLOD& LOD = m_Meshes[SubmeshIndex].LODs[0];
+				WriteDrawCommand(pCommands, NumDraws++, SubmeshIndex, LOD.BaseIndex, LOD.NumIndices, NumVisible);
+				NumTriangles += LOD.NumIndices / 3 * NumVisible;
 			}
+		}
+
+		*pCount = NumDraws;
 
-			size_t offset = m_Meshes[SubmeshIndex].BaseVertex * m_vertexSize;
-			size_t range = m_Meshes[SubmeshIndex].NumVertices * m_vertexSize;
-			md.m_ranges[SubmeshIndex].m_vbRange = { .m_offset = offset, .m_range = range };
+		m_numVisibleInstances = NumVisible;
+		m_numVisibleSubmeshes = (NumVisible > 0) ? (int)m_Meshes.size() : 0;
+		m_numVisibleTriangles = NumTriangles;
+		SetNumDraws(ImageIndex, NumDraws);
+	}
 
-			offset = m_Meshes[SubmeshIndex].BaseIndex * sizeof(uint32_t);
-			range = m_Meshes[SubmeshIndex].NumIndices * sizeof(uint32_t);
-			md.m_ranges[SubmeshIndex].m_ibRange = { .m_offset = offset, .m_range = range };
 
-			offset = SubmeshIndex * UNIFORM_BUFFER_SIZE;
-			range = UNIFORM_BUFFER_SIZE;
-			md.m_ranges[SubmeshIndex].m_uniformRange = { .m_offset = offset, .m_range = range };
+	void VkModel::SetNumDraws(int ImageIndex, int NumDraws)
+	{
+		// Grows with the number of images - the swapchain can be recreated with more of them
+		if (ImageIndex >= (int)m_numDrawsPerImage.size()) {
+			m_numDrawsPerImage.resize(ImageIndex + 1, 0);
 		}
+
+		m_numDrawsPerImage[ImageIndex] = NumDraws;
+		m_numDraws = NumDraws;
 	}
 
 
-	void VkModel::RecordCommandBuffer(VkCommandBuffer CmdBuf, GraphicsPipeline& Pipeline, int ImageIndex)
+	void VkModel::SetLODSelection(bool Enabled, float ViewportHeight, float MaxErrorPixels)
 	{
-		uint32_t InstanceCount = 1;
-		uint32_t FirstInstance = 0;
-		uint32_t BaseVertex = 0;
+		m_lodSelection = Enabled;
+		m_viewportHeight = ViewportHeight;
+		m_maxLODErrorPixels = MaxErrorPixels;
+	}
+
+
+	// The error of a LOD is a distance in the space of the model. It is projected
+	// at the closest point of the bounding sphere so the selection is conservative.
+	int VkModel::SelectLOD(const BasicMeshEntry& Mesh, const glm::mat4& Transformation) const
+	{
+		if (!m_lodSelection || (Mesh.NumLODs == 1)) {
+			return 0;
+		}
+
+		// GLM is column major so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+		glm::vec4 Row1 = glm::vec4(Transformation[0][1], Transformation[1][1], Transformation[2][1], Transformation[3][1]);
+		glm::vec4 Row3 = glm::vec4(Transformation[0][3], Transformation[1][3], Transformation[2][3], Transformation[3][3]);
+
+		glm::vec3 Center = glm::vec3(Mesh.BoundingSphere);
+		float Radius = Mesh.BoundingSphere.w;
 
-		for (uint32_t SubmeshIndex = 0; SubmeshIndex < m_Meshes.size(); SubmeshIndex++) {
-			vkCmdBindDescriptorSets(CmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS,
-				Pipeline.GetPipelineLayout(),
-				0,  // firstSet
-				1,  // descriptorSetCount
-				&m_descriptorSets[ImageIndex][SubmeshIndex],
-				0,	// dynamicOffsetCount
-				NULL);	// pDynamicOffsets
+		float w = glm::dot(Row3, glm::vec4(Center, 1.0f)) - Radius * glm::length(glm::vec3(Row3));
 
-			vkCmdDraw(CmdBuf, m_Meshes[SubmeshIndex].NumIndices,
-				InstanceCount, BaseVertex, FirstInstance);
+		// The camera is inside the sphere
+		if (w <= 0.0f) {
+			return 0;
 		}
+
+		// Pixels per unit of the model at a distance of w
+		float PixelsPerUnit = glm::length(glm::vec3(Row1)) * m_viewportHeight * 0.5f / w;
+
+		int LOD = 0;
+
+		// The errors grow with the LOD
+		for (unsigned int i = 1; i < Mesh.NumLODs; i++) {
+			if (Mesh.LODs[i].Error * PixelsPerUnit > m_maxLODErrorPixels) {
+				break;
+			}
+
+			LOD = i;
+		}
+
+		return LOD;
 	}
 
 
-	void VkModel::Update(int ImageIndex, const glm::mat4& Transformation)
+	void VkModel::UpdateDrawCommands(int ImageIndex, const glm::mat4& Transformation)
 	{
-		std::vector<glm::mat4> Transformations(m_Meshes.size());
+		int NumVisible = 0;
+
+		if (m_frustumCulling) {
+			// The boxes already include the transformation of the submesh
+			NumVisible = m_frustumCuller.Cull(Transformation, m_visibleSubmeshes.data());
+		}
+		else {
+			NumVisible = (int)m_Meshes.size();
+
+			for (int i = 0; i < NumVisible; i++) {
+				m_visibleSubmeshes[i] = i;
+			}
+		}
+
+		const VulkanFrameAllocator& FrameAllocator = m_pVulkanCore->GetFrameAllocator();
+		void* pCommands = FrameAllocator.GetReservedPtr(ImageIndex, m_drawCmdOffset);
+		uint32_t* pCount = (uint32_t*)FrameAllocator.GetReservedPtr(ImageIndex, m_drawCountOffset);
 
-		for (uint32_t SubmeshIndex = 0; SubmeshIndex < Transformations.size(); SubmeshIndex++) {
-			glm::mat4 MeshTransform = m_Meshes[SubmeshIndex].Transformation;
-			Transformations[SubmeshIndex] = Transformation * MeshTransform;
+		int NumTriangles = 0;
+		int NumDraws = 0;
+
+		if (m_meshletCulling) {
+			m_meshletCuller.SetWVP(Transformation);
+		}
+
+		for (int i = 0; i < NumVisible; i++) {
+			uint32_t SubmeshIndex = m_visibleSubmeshes[i];
+			const BasicMeshEntry& Mesh = m_Meshes[SubmeshIndex];
+			int LODIndex = SelectLOD(Mesh, Transformation);
+
+			// The meshlets only cover LOD 0
+			if (m_meshletCulling && (LODIndex == 0) && (Mesh.NumMeshlets > 0)) {
+				for (unsigned int m = 0; m < Mesh.NumMeshlets; m++) {
+					const Meshlet& meshlet = m_meshlets[Mesh.BaseMeshlet + m];
+
+					if (m_meshletCuller.IsVisible(meshlet)) {
+						WriteDrawCommand(pCommands, NumDraws++, SubmeshIndex, meshlet.BaseIndex, meshlet.NumIndices);
+						NumTriangles += meshlet.NumIndices / 3;
+					}
+				}
+			}
+			else {
+				const MeshLOD& LOD = Mesh.LODs[LODIndex];
+				WriteDrawCommand(pCommands, NumDraws++, SubmeshIndex, LOD.BaseIndex, LOD.NumIndices);
+				NumTriangles += LOD.NumIndices / 3;
+			}
 		}
 
-		m_uniformBuffers[ImageIndex].Update(m_pVulkanCore->GetDevice(), Transformations.data(), ARRAY_SIZE_IN_BYTES(Transformations));
+		*pCount = NumDraws;
+
+		m_numVisibleSubmeshes = NumVisible;
+		m_numVisibleTriangles = NumTriangles;
+		SetNumDraws(ImageIndex, NumDraws);
+	}
+
+
+	// firstInstance carries the submesh index since gl_DrawID is no longer equal to it.
+	// The vertex shader subtracts it from gl_InstanceIndex to get the instance.
+	void VkModel::WriteDrawCommand(void* pCommands, int DrawIndex, uint32_t SubmeshIndex, unsigned int BaseIndex, unsigned int NumIndices,
+		uint32_t NumInstances) const
+	{
+		const BasicMeshEntry& Mesh = m_Meshes[SubmeshIndex];
+
+		if (m_indexedDraws) {
+			VkDrawIndexedIndirectCommand& Cmd = ((VkDrawIndexedIndirectCommand*)pCommands)[DrawIndex];
+			Cmd.indexCount = NumIndices;
+			Cmd.instanceCount = NumInstances;
+			Cmd.firstIndex = BaseIndex;
+			Cmd.vertexOffset = Mesh.BaseVertex;
+			Cmd.firstInstance = SubmeshIndex;
+		}
+		else {
+			// The vertex shader fetches the index itself relative to DrawData::BaseIndex
+			VkDrawIndirectCommand& Cmd = ((VkDrawIndirectCommand*)pCommands)[DrawIndex];
+			Cmd.vertexCount = NumIndices;
+			Cmd.instanceCount = NumInstances;
+			Cmd.firstVertex = BaseIndex - Mesh.BaseIndex;
+			Cmd.firstInstance = SubmeshIndex;
+		}
 	}
 
 }
\ No newline at end of file
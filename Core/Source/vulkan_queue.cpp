@@ -4,11 +4,13 @@
 #include "vulkan_util.h"
 #include "vulkan_queue.h"
 #include "vulkan_wrapper.h"
+#include "cpu_profiler.h"
 
 namespace Engine {
 
 
-	void VulkanQueue::Init(VkDevice Device, VkSwapchainKHR SwapChain, uint32_t QueueFamily, uint32_t QueueIndex)
+	void VulkanQueue::Init(VkDevice Device, VkSwapchainKHR SwapChain, uint32_t QueueFamily, uint32_t QueueIndex,
+		int NumImages, int NumFramesInFlight)
 	{
 		m_device = Device;
 		m_swapChain = SwapChain;
@@ -17,21 +19,73 @@ namespace Engine {
 
 		printf("Queue acquired\n");
 
-		CreateSemaphores();
+		CreateSyncObjects(NumImages, NumFramesInFlight);
 	}
 
 
 	void VulkanQueue::Destroy()
 	{
-		vkDestroySemaphore(m_device, m_presentCompleteSem, NULL);
-		vkDestroySemaphore(m_device, m_renderCompleteSem, NULL);
+		DestroySemaphores();
+
+		for (FrameSync& Frame : m_frames) {
+			vkDestroyFence(m_device, Frame.m_inFlightFence, NULL);
+		}
+	}
+
+
+	void VulkanQueue::DestroySemaphores()
+	{
+		for (FrameSync& Frame : m_frames) {
+			vkDestroySemaphore(m_device, Frame.m_presentCompleteSem, NULL);
+		}
+
+		for (VkSemaphore Sem : m_renderCompleteSems) {
+			vkDestroySemaphore(m_device, Sem, NULL);
+		}
 	}
 
 
-	void VulkanQueue::CreateSemaphores()
+	void VulkanQueue::SetSwapChain(VkSwapchainKHR SwapChain, int NumImages)
 	{
-		m_presentCompleteSem = CreateSemaphore(m_device);
-		m_renderCompleteSem = CreateSemaphore(m_device);
+		m_swapChain = SwapChain;
+
+		// A failed acquire/present can leave the semaphores in an unknown state
+		// so they are replaced. The fences are not touched - the queue is idle.
+		DestroySemaphores();
+
+		for (FrameSync& Frame : m_frames) {
+			Frame.m_presentCompleteSem = CreateSemaphore(m_device);
+		}
+
+		m_renderCompleteSems.resize(NumImages);
+
+		for (VkSemaphore& Sem : m_renderCompleteSems) {
+			Sem = CreateSemaphore(m_device);
+		}
+
+		m_imageFences.assign(NumImages, VK_NULL_HANDLE);
+	}
+
+
+	void VulkanQueue::CreateSyncObjects(int NumImages, int NumFramesInFlight)
+	{
+		m_frames.resize(NumFramesInFlight);
+
+		for (FrameSync& Frame : m_frames) {
+			Frame.m_presentCompleteSem = CreateSemaphore(m_device);
+			// Signaled so that the first wait on each slot doesn't block
+			Frame.m_inFlightFence = CreateFence(m_device, true);
+		}
+
+		m_renderCompleteSems.resize(NumImages);
+
+		for (VkSemaphore& Sem : m_renderCompleteSems) {
+			Sem = CreateSemaphore(m_device);
+		}
+
+		m_imageFences.resize(NumImages, VK_NULL_HANDLE);
+
+		printf("%d frames in flight\n", NumFramesInFlight);
 	}
 
 
@@ -43,14 +97,49 @@ namespace Engine {
 
 	uint32_t VulkanQueue::AcquireNextImage()
 	{
+		PROFILE_ZONE("AcquireNextImage");
+
+		FrameSync& Frame = m_frames[m_frameIndex];
+
+		VkResult res = vkWaitForFences(m_device, 1, &Frame.m_inFlightFence, VK_TRUE, UINT64_MAX);
+		CHECK_VK_RESULT(res, "vkWaitForFences\n");
+
 		uint32_t ImageIndex = 0;
-		VkResult res = vkAcquireNextImageKHR(m_device, m_swapChain, UINT64_MAX, m_presentCompleteSem, NULL, &ImageIndex);
-		CHECK_VK_RESULT(res, "vkAcquireNextImageKHR\n");
+
+		if (m_swapChain == VK_NULL_HANDLE) {
+			ImageIndex = m_nextHeadlessImage;
+			m_nextHeadlessImage = (m_nextHeadlessImage + 1) % (uint32_t)m_imageFences.size();
+		}
+		else {
+			res = vkAcquireNextImageKHR(m_device, m_swapChain, UINT64_MAX, Frame.m_presentCompleteSem, NULL, &ImageIndex);
+
+			// The fence of the slot is still signaled so the slot can be used again after the recreation
+			if (res == VK_ERROR_OUT_OF_DATE_KHR) {
+				return INVALID_IMAGE_INDEX;
+			}
+
+			// Suboptimal still acquires the image - it is reported by Present()
+			if (res != VK_SUBOPTIMAL_KHR) {
+				CHECK_VK_RESULT(res, "vkAcquireNextImageKHR\n");
+			}
+		}
+
+		// The per-image resources (command buffer, uniforms) may still be used by another frame slot
+		VkFence ImageFence = m_imageFences[ImageIndex];
+
+		if ((ImageFence != VK_NULL_HANDLE) && (ImageFence != Frame.m_inFlightFence)) {
+			res = vkWaitForFences(m_device, 1, &ImageFence, VK_TRUE, UINT64_MAX);
+			CHECK_VK_RESULT(res, "vkWaitForFences\n");
+		}
+
+		m_imageFences[ImageIndex] = Frame.m_inFlightFence;
+		m_imageIndex = ImageIndex;
+
 		return ImageIndex;
 	}
 
 
-	void VulkanQueue::SubmitSync(VkCommandBuffer CmbBuf)
+	void VulkanQueue::SubmitSync(VkCommandBuffer CmbBuf, VkFence Fence)
 	{
 		VkSubmitInfo SubmitInfo = {
 			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
@@ -64,46 +153,71 @@ namespace Engine {
 			.pSignalSemaphores = VK_NULL_HANDLE
 		};
 
-		VkResult res = vkQueueSubmit(m_queue, 1, &SubmitInfo, NULL);
+		VkResult res = vkQueueSubmit(m_queue, 1, &SubmitInfo, Fence);
 		CHECK_VK_RESULT(res, "vkQueueSubmit\n");
 	}
 
 
 	void VulkanQueue::SubmitAsync(VkCommandBuffer CmbBuf)
 	{
+		FrameSync& Frame = m_frames[m_frameIndex];
+
 		VkPipelineStageFlags waitFlags = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 
+		// Headless - nothing to wait for and nobody to signal
+		uint32_t NumSemaphores = (m_swapChain == VK_NULL_HANDLE) ? 0 : 1;
+
 		VkSubmitInfo SubmitInfo = {
 			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
 			.pNext = NULL,
-			.waitSemaphoreCount = 1,
-			.pWaitSemaphores = &m_presentCompleteSem,
+			.waitSemaphoreCount = NumSemaphores,
+			.pWaitSemaphores = &Frame.m_presentCompleteSem,
 			.pWaitDstStageMask = &waitFlags,
 			.commandBufferCount = 1,
 			.pCommandBuffers = &CmbBuf,
-			.signalSemaphoreCount = 1,
-			.pSignalSemaphores = &m_renderCompleteSem
+			.signalSemaphoreCount = NumSemaphores,
+			.pSignalSemaphores = &m_renderCompleteSems[m_imageIndex]
 		};
 
-		VkResult res = vkQueueSubmit(m_queue, 1, &SubmitInfo, NULL);
+		// Reset only right before the submit that signals it again
+		VkResult res = vkResetFences(m_device, 1, &Frame.m_inFlightFence);
+		CHECK_VK_RESULT(res, "vkResetFences\n");
+
+		res = vkQueueSubmit(m_queue, 1, &SubmitInfo, Frame.m_inFlightFence);
 		CHECK_VK_RESULT(res, "vkQueueSubmit\n");
 	}
 
 
-	void VulkanQueue::Present(uint32_t ImageIndex)
+	bool VulkanQueue::Present(uint32_t ImageIndex)
 	{
+		PROFILE_ZONE("Present");
+
+		if (m_swapChain == VK_NULL_HANDLE) {
+			m_frameIndex = (m_frameIndex + 1) % (int)m_frames.size();
+			return true;
+		}
+
 		VkPresentInfoKHR PresentInfo = {
 			.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
 			.pNext = NULL,
 			.waitSemaphoreCount = 1,
-			.pWaitSemaphores = &m_renderCompleteSem,
+			.pWaitSemaphores = &m_renderCompleteSems[ImageIndex],
 			.swapchainCount = 1,
 			.pSwapchains = &m_swapChain,
 			.pImageIndices = &ImageIndex
 		};
 
 		VkResult res = vkQueuePresentKHR(m_queue, &PresentInfo);
+
+		m_frameIndex = (m_frameIndex + 1) % (int)m_frames.size();
+
+		if ((res == VK_ERROR_OUT_OF_DATE_KHR) || (res == VK_SUBOPTIMAL_KHR)) {
+			return false;
+		}
+
 		CHECK_VK_RESULT(res, "vkQueuePresentKHR\n");
+
+		return true;
 	}
 
 }
\ No newline at end of file
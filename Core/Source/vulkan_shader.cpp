@@ -12,9 +12,27 @@
 #include "util.h"
 #include "vulkan_util.h"
 #include "vulkan_shader.h"
+#include "cpu_profiler.h"
 
 namespace Engine {
 
+	// The SPIR-V of every shader is cached next to its source in <source>.spvcache.
+	// The cache is used if the key in its header matches a hash of everything that
+	// goes into the compilation. Bump the version when the compiler is upgraded.
+#define SHADER_CACHE_MAGIC		0x43565053	// 'SPVC'
+#define SHADER_CACHE_VERSION	1
+
+#define SHADER_CLIENT_VERSION	GLSLANG_TARGET_VULKAN_1_3
+#define SHADER_TARGET_VERSION	GLSLANG_TARGET_SPV_1_6
+
+	struct ShaderCacheHeader {
+		uint32_t Magic = SHADER_CACHE_MAGIC;
+		uint32_t Version = SHADER_CACHE_VERSION;
+		uint64_t Key = 0;
+		uint32_t CodeSize = 0;	// in bytes
+		uint32_t Padding = 0;
+	};
+
 	struct Shader
 	{
 		std::vector<uint32_t> SPIRV;
@@ -52,15 +70,31 @@ namespace Engine {
 	}
 
 
+	static VkShaderModule CreateShaderModule(VkDevice Device, const uint32_t* pCode, size_t CodeSize)
+	{
+		VkShaderModuleCreateInfo shaderCreateInfo = {
+			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+			.codeSize = CodeSize,
+			.pCode = pCode
+		};
+
+		VkShaderModule shaderModule;
+		VkResult res = vkCreateShaderModule(Device, &shaderCreateInfo, NULL, &shaderModule);
+		CHECK_VK_RESULT(res, "vkCreateShaderModule\n");
+
+		return shaderModule;
+	}
+
+
 	static bool CompileShader(VkDevice Device, glslang_stage_t Stage, const char* pShaderCode, Shader& ShaderModule)
 	{
 		glslang_input_t input = {
 			.language = GLSLANG_SOURCE_GLSL,
 			.stage = Stage,
 			.client = GLSLANG_CLIENT_VULKAN,
-			.client_version = GLSLANG_TARGET_VULKAN_1_3,
+			.client_version = SHADER_CLIENT_VERSION,
 			.target_language = GLSLANG_TARGET_SPV,
-			.target_language_version = GLSLANG_TARGET_SPV_1_6,
+			.target_language_version = SHADER_TARGET_VERSION,
 			.code = pShaderCode,
 			.default_version = 100,
 			.default_profile = GLSLANG_NO_PROFILE,
@@ -108,14 +142,8 @@ namespace Engine {
 			fprintf(stderr, "SPIR-V message: '%s'", spirv_messages);
 		}
 
-		VkShaderModuleCreateInfo shaderCreateInfo = {
-			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-			.codeSize = ShaderModule.SPIRV.size() * sizeof(uint32_t),
-			.pCode = (const uint32_t*)ShaderModule.SPIRV.data()
-		};
-
-		VkResult res = vkCreateShaderModule(Device, &shaderCreateInfo, NULL, &ShaderModule.ShaderModule);
-		CHECK_VK_RESULT(res, "vkCreateShaderModule\n");
+		ShaderModule.ShaderModule = CreateShaderModule(Device, ShaderModule.SPIRV.data(),
+			ShaderModule.SPIRV.size() * sizeof(uint32_t));
 
 		glslang_program_delete(program);
 		glslang_shader_delete(shader);
@@ -161,8 +189,89 @@ namespace Engine {
 	}
 
 
+	// FNV-1a
+	static uint64_t HashBytes(uint64_t Hash, const void* pData, size_t Size)
+	{
+		const uint8_t* p = (const uint8_t*)pData;
+
+		for (size_t i = 0; i < Size; i++) {
+			Hash = (Hash ^ p[i]) * 1099511628211ull;
+		}
+
+		return Hash;
+	}
+
+
+	static uint64_t GetShaderCacheKey(const std::string& Source, glslang_stage_t Stage)
+	{
+		uint32_t Settings[] = { SHADER_CACHE_VERSION, (uint32_t)Stage, (uint32_t)SHADER_CLIENT_VERSION, (uint32_t)SHADER_TARGET_VERSION };
+
+		uint64_t Hash = 14695981039346656037ull;
+		Hash = HashBytes(Hash, Settings, sizeof(Settings));
+		Hash = HashBytes(Hash, Source.data(), Source.size());
+
+		return Hash;
+	}
+
+
+	// Returns false if the cache doesn't exist or was created from a different source
+	static bool LoadFromShaderCache(const std::string& CacheFilename, uint64_t Key, std::vector<uint32_t>& SPIRV)
+	{
+		FILE* f = fopen(CacheFilename.c_str(), "rb");
+
+		if (!f) {
+			return false;
+		}
+
+		ShaderCacheHeader Header;
+
+		bool Success = (fread(&Header, sizeof(Header), 1, f) == 1) &&
+			(Header.Magic == SHADER_CACHE_MAGIC) &&
+			(Header.Version == SHADER_CACHE_VERSION) &&
+			(Header.Key == Key) &&
+			(Header.CodeSize > 0) && (Header.CodeSize % sizeof(uint32_t) == 0);
+
+		if (Success) {
+			SPIRV.resize(Header.CodeSize / sizeof(uint32_t));
+			Success = (fread(SPIRV.data(), Header.CodeSize, 1, f) == 1);
+		}
+
+		fclose(f);
+
+		return Success;
+	}
+
+
+	static void SaveToShaderCache(const std::string& CacheFilename, uint64_t Key, const std::vector<uint32_t>& SPIRV)
+	{
+		FILE* f = fopen(CacheFilename.c_str(), "wb");
+
+		// Not fatal - the shader will be compiled again next time
+		if (!f) {
+			printf("Cannot write the shader cache '%s'\n", CacheFilename.c_str());
+			return;
+		}
+
+		ShaderCacheHeader Header;
+		Header.Key = Key;
+		Header.CodeSize = (uint32_t)(SPIRV.size() * sizeof(uint32_t));
+
+		bool Success = (fwrite(&Header, sizeof(Header), 1, f) == 1) &&
+			(fwrite(SPIRV.data(), Header.CodeSize, 1, f) == 1);
+
+		fclose(f);
+
+		// Don't leave a partial file behind
+		if (!Success) {
+			remove(CacheFilename.c_str());
+		}
+	}
+
+
 	VkShaderModule CreateShaderModuleFromText(VkDevice Device, const char* pFilename)
 	{
+		PROFILE_ZONE("Load shader");
+
 		std::string Source;
 
 		char CurWorkDir[256];
@@ -182,8 +291,19 @@ namespace Engine {
 
 		glslang_stage_t ShaderStage = ShaderStageFromFilename(pFilename);
 
+		std::string CacheFilename = std::string(pFilename) + ".spvcache";
+		uint64_t Key = GetShaderCacheKey(Source, ShaderStage);
+
+		// No need for glslang at all if the source didn't change
+		if (LoadFromShaderCache(CacheFilename, Key, ShaderModule.SPIRV)) {
+			printf("Created shader from the cache of '%s\\%s'\n", CurWorkDir, pFilename);
+			return CreateShaderModule(Device, ShaderModule.SPIRV.data(), ShaderModule.SPIRV.size() * sizeof(uint32_t));
+		}
+
 		VkShaderModule ret = NULL;
 
+		PROFILE_ZONE("Compile shader");
+
 		glslang_initialize_process();
 
 		bool Success = CompileShader(Device, ShaderStage, Source.c_str(), ShaderModule);
@@ -191,9 +311,7 @@ namespace Engine {
 		if (Success) {
 			printf("Created shader from text file '%s\\%s'\n", CurWorkDir, pFilename);
 			ret = ShaderModule.ShaderModule;
-			std::string BinaryFilename = std::string(pFilename) + ".spv";
-			WriteBinaryFile(BinaryFilename.c_str(), ShaderModule.SPIRV.data(),
-				(int)ShaderModule.SPIRV.size() * sizeof(uint32_t));
+			SaveToShaderCache(CacheFilename, Key, ShaderModule.SPIRV);
 		}
 
 		glslang_finalize_process();
@@ -208,15 +326,7 @@ namespace Engine {
 		char* pShaderCode = ReadBinaryFile(pFilename, codeSize);
 		assert(pShaderCode);
 
-		VkShaderModuleCreateInfo shaderCreateInfo = {
-			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-			.codeSize = (size_t)codeSize,
-			.pCode = (const uint32_t*)pShaderCode
-		};
-
-		VkShaderModule shaderModule;
-		VkResult res = vkCreateShaderModule(Device, &shaderCreateInfo, NULL, &shaderModule);
-		CHECK_VK_RESULT(res, "vkCreateShaderModule\n");
+		VkShaderModule shaderModule = CreateShaderModule(Device, (const uint32_t*)pShaderCode, (size_t)codeSize);
 		printf("Created shader from binary %s\n", pFilename);
 
 		free(pShaderCode);
@@ -5,6 +5,7 @@
 
 #include "vulkan_core.h"
 #include "vulkan_texture.h"
+#include "cpu_profiler.h"
 #include "stb/stb_image.h"
 #include "stb/stb_image_write.h"
 
@@ -23,7 +24,44 @@ namespace Engine {
 
 	void VulkanTexture::Load(const std::string& Filename)
 	{
+		PROFILE_ZONE("Load texture");
+
+		if (IsTextureContainerFile(Filename)) {
+			TextureContainer Container;
+
+			if (!LoadTextureContainer(Filename, Container)) {
+				exit(1);
+			}
+
+			LoadFromContainer(Container);
+			return;
+		}
+
 		m_pVulkanCore->CreateTexture(Filename.c_str(), *this);
 	}
 
+
+	void VulkanTexture::LoadFromPixels(int Width, int Height, const void* pPixels)
+	{
+		assert(m_pVulkanCore);
+
+		m_imageWidth = Width;
+		m_imageHeight = Height;
+		m_imageBPP = 4;
+
+		m_pVulkanCore->CreateTextureFromData(pPixels, m_imageWidth, m_imageHeight, *this);
+	}
+
+
+	void VulkanTexture::LoadFromContainer(const TextureContainer& Container)
+	{
+		assert(m_pVulkanCore);
+
+		m_imageWidth = Container.Mips[0].Width;
+		m_imageHeight = Container.Mips[0].Height;
+		m_imageBPP = 0;		// may be block compressed
+
+		m_pVulkanCore->CreateTextureFromContainer(Container, *this);
+	}
+
 }
\ No newline at end of file
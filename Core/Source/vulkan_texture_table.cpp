@@ -0,0 +1,150 @@
+#include "util.h"
+#include "vulkan_util.h"
+#include "vulkan_texture.h"
+#include "vulkan_texture_table.h"
+
+namespace Engine {
+
+	void VulkanTextureTable::Init(VkDevice Device, uint32_t MaxTextures)
+	{
+		m_device = Device;
+		m_maxTextures = MaxTextures;
+
+		CreateLayout();
+		CreateDescriptorSet();
+
+		printf("Bindless texture table created with %d slots\n", MaxTextures);
+	}
+
+
+	void VulkanTextureTable::Destroy()
+	{
+		if (m_device == VK_NULL_HANDLE) {
+			return;	// never initialized
+		}
+
+		vkDestroyDescriptorPool(m_device, m_descriptorPool, NULL);
+		vkDestroyDescriptorSetLayout(m_device, m_layout, NULL);
+	}
+
+
+	void VulkanTextureTable::CreateLayout()
+	{
+		VkDescriptorSetLayoutBinding Binding = {
+			.binding = 0,
+			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			.descriptorCount = m_maxTextures,
+			.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+		};
+
+		// Only the slots that the shaders actually sample must be valid and new
+		// slots can be written while the set is used by pending command buffers
+		VkDescriptorBindingFlags BindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+			VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+			VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfo BindingFlagsInfo = {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+			.pNext = NULL,
+			.bindingCount = 1,
+			.pBindingFlags = &BindingFlags
+		};
+
+		VkDescriptorSetLayoutCreateInfo LayoutInfo = {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = &BindingFlagsInfo,
+			.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+			.bindingCount = 1,
+			.pBindings = &Binding
+		};
+
+		VkResult res = vkCreateDescriptorSetLayout(m_device, &LayoutInfo, NULL, &m_layout);
+		CHECK_VK_RESULT(res, "vkCreateDescriptorSetLayout");
+	}
+
+
+	void VulkanTextureTable::CreateDescriptorSet()
+	{
+		VkDescriptorPoolSize PoolSize = {
+			.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			.descriptorCount = m_maxTextures
+		};
+
+		VkDescriptorPoolCreateInfo PoolInfo = {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+			.maxSets = 1,
+			.poolSizeCount = 1,
+			.pPoolSizes = &PoolSize
+		};
+
+		VkResult res = vkCreateDescriptorPool(m_device, &PoolInfo, NULL, &m_descriptorPool);
+		CHECK_VK_RESULT(res, "vkCreateDescriptorPool");
+
+		VkDescriptorSetAllocateInfo AllocInfo = {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.pNext = NULL,
+			.descriptorPool = m_descriptorPool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &m_layout
+		};
+
+		res = vkAllocateDescriptorSets(m_device, &AllocInfo, &m_descriptorSet);
+		CHECK_VK_RESULT(res, "vkAllocateDescriptorSets");
+	}
+
+
+	uint32_t VulkanTextureTable::Add(VulkanTexture& Tex)
+	{
+		std::lock_guard<std::mutex> Lock(m_mutex);
+
+		uint32_t Index = 0;
+
+		if (!m_freeSlots.empty()) {
+			Index = m_freeSlots.back();
+			m_freeSlots.pop_back();
+		}
+		else {
+			if (m_numTextures == m_maxTextures) {
+				MY_ERROR("Bindless texture table is full (%d textures)\n", m_maxTextures);
+				exit(1);
+			}
+
+			Index = m_numTextures++;
+		}
+
+		VkDescriptorImageInfo ImageInfo = {
+			.sampler = Tex.m_sampler,
+			.imageView = Tex.m_view,
+			.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+		};
+
+		VkWriteDescriptorSet wds = {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = m_descriptorSet,
+			.dstBinding = 0,
+			.dstArrayElement = Index,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			.pImageInfo = &ImageInfo
+		};
+
+		vkUpdateDescriptorSets(m_device, 1, &wds, 0, NULL);
+
+		Tex.m_bindlessIndex = Index;
+
+		return Index;
+	}
+
+
+	// The descriptor keeps pointing to the destroyed texture until the slot is reused.
+	// The layout is partially bound so that is fine as long as the shaders don't index it.
+	void VulkanTextureTable::Remove(uint32_t Index)
+	{
+		std::lock_guard<std::mutex> Lock(m_mutex);
+
+		assert(Index < m_numTextures);
+
+		m_freeSlots.push_back(Index);
+	}
+}
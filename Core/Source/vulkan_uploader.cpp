@@ -0,0 +1,376 @@
+#include <string.h>
+
+#include "vulkan_util.h"
+#include "vulkan_wrapper.h"
+#include "vulkan_core.h"
+#include "vulkan_uploader.h"
+
+namespace Engine {
+
+	// Satisfies the buffer offset alignment of vkCmdCopyBufferToImage for all the formats we use
+#define STAGING_ALIGNMENT 16
+
+#define UPLOAD_PROFILER_SCOPE "Upload batch"
+
+	static VkDeviceSize AlignUp(VkDeviceSize Value, VkDeviceSize Alignment)
+	{
+		return (Value + Alignment - 1) & ~(Alignment - 1);
+	}
+
+
+	void VulkanUploader::Init(VulkanCore* pVulkanCore, VkDeviceSize RingSize)
+	{
+		m_pVulkanCore = pVulkanCore;
+		m_device = pVulkanCore->GetDevice();
+		m_ringSize = RingSize;
+
+		VkBufferUsageFlags Usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		VkMemoryPropertyFlags MemProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		m_ring = pVulkanCore->CreateBuffer(RingSize, Usage, MemProps);
+
+		// The allocator keeps host visible memory mapped
+		m_pRingMem = m_ring.m_mem.m_pMapped;
+
+		for (int i = 0; i < NUM_UPLOAD_BATCHES; i++) {
+			pVulkanCore->CreateCommandBuffers(1, &m_batches[i].m_cmdBuf);
+			m_batches[i].m_fence = CreateFence(m_device, false);
+		}
+
+		printf("Upload ring of %d bytes created\n", (int)RingSize);
+	}
+
+
+	void VulkanUploader::Destroy()
+	{
+		if (!m_pVulkanCore) {
+			return;	// never initialized
+		}
+
+		Flush();
+
+		for (int i = 0; i < NUM_UPLOAD_BATCHES; i++) {
+			m_pVulkanCore->FreeCommandBuffers(1, &m_batches[i].m_cmdBuf);
+			vkDestroyFence(m_device, m_batches[i].m_fence, NULL);
+		}
+
+		m_ring.Destroy(m_device);
+
+		printf("Uploader destroyed after %d submits\n", m_numSubmits);
+	}
+
+
+	void VulkanUploader::UploadToBuffer(VkBuffer Dst, VkDeviceSize DstOffset, const void* pData, VkDeviceSize Size)
+	{
+		VkBuffer SrcBuffer = VK_NULL_HANDLE;
+		VkDeviceSize SrcOffset = 0;
+		Stage(pData, Size, SrcBuffer, SrcOffset);
+
+		VkBufferCopy BufferCopy = {
+			.srcOffset = SrcOffset,
+			.dstOffset = DstOffset,
+			.size = Size
+		};
+
+		vkCmdCopyBuffer(GetCommandBuffer(), SrcBuffer, Dst, 1, &BufferCopy);
+	}
+
+
+	// ImageMemBarrier() only handles the first mip level
+	static void MipLevelsBarrier(VkCommandBuffer CmdBuf, VkImage Image, uint32_t BaseLevel, uint32_t LevelCount,
+		VkImageLayout OldLayout, VkImageLayout NewLayout, VkAccessFlags SrcAccess, VkAccessFlags DstAccess,
+		VkPipelineStageFlags SrcStage, VkPipelineStageFlags DstStage)
+	{
+		VkImageMemoryBarrier Barrier = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.pNext = NULL,
+			.srcAccessMask = SrcAccess,
+			.dstAccessMask = DstAccess,
+			.oldLayout = OldLayout,
+			.newLayout = NewLayout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = Image,
+			.subresourceRange = VkImageSubresourceRange {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = BaseLevel,
+				.levelCount = LevelCount,
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			}
+		};
+
+		vkCmdPipelineBarrier(CmdBuf, SrcStage, DstStage, 0, 0, NULL, 0, NULL, 1, &Barrier);
+	}
+
+
+	void VulkanUploader::UploadToImage(VkImage Dst, VkFormat Format, uint32_t ImageWidth, uint32_t ImageHeight,
+		uint32_t MipLevels, const void* pPixels, VkDeviceSize Size)
+	{
+		VkBuffer SrcBuffer = VK_NULL_HANDLE;
+		VkDeviceSize SrcOffset = 0;
+		Stage(pPixels, Size, SrcBuffer, SrcOffset);
+
+		// Staging may have submitted the previous batch so get the command buffer only now
+		VkCommandBuffer CmdBuf = GetCommandBuffer();
+
+		if (MipLevels == 1) {
+			ImageMemBarrier(CmdBuf, Dst, Format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		}
+		else {
+			MipLevelsBarrier(CmdBuf, Dst, 0, MipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		}
+
+		VkBufferImageCopy BufferImageCopy = {
+			.bufferOffset = SrcOffset,
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource = VkImageSubresourceLayers {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.mipLevel = 0,
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			},
+			.imageOffset = VkOffset3D {.x = 0, .y = 0, .z = 0 },
+			.imageExtent = VkExtent3D {.width = ImageWidth, .height = ImageHeight, .depth = 1 }
+		};
+
+		vkCmdCopyBufferToImage(CmdBuf, SrcBuffer, Dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &BufferImageCopy);
+
+		if (MipLevels == 1) {
+			ImageMemBarrier(CmdBuf, Dst, Format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			return;
+		}
+
+		// Every level is blitted from the one above it which must be finished and in TRANSFER_SRC
+		int32_t Width = (int32_t)ImageWidth;
+		int32_t Height = (int32_t)ImageHeight;
+
+		for (uint32_t Level = 1; Level < MipLevels; Level++) {
+			MipLevelsBarrier(CmdBuf, Dst, Level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+			int32_t NextWidth = (Width > 1) ? Width / 2 : 1;
+			int32_t NextHeight = (Height > 1) ? Height / 2 : 1;
+
+			VkImageBlit Blit = {
+				.srcSubresource = VkImageSubresourceLayers {
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = Level - 1,
+					.baseArrayLayer = 0,
+					.layerCount = 1
+				},
+				.srcOffsets = { VkOffset3D {.x = 0, .y = 0, .z = 0 }, VkOffset3D {.x = Width, .y = Height, .z = 1 } },
+				.dstSubresource = VkImageSubresourceLayers {
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = Level,
+					.baseArrayLayer = 0,
+					.layerCount = 1
+				},
+				.dstOffsets = { VkOffset3D {.x = 0, .y = 0, .z = 0 }, VkOffset3D {.x = NextWidth, .y = NextHeight, .z = 1 } }
+			};
+
+			vkCmdBlitImage(CmdBuf, Dst, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, Dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &Blit, VK_FILTER_LINEAR);
+
+			Width = NextWidth;
+			Height = NextHeight;
+		}
+
+		// All the levels are in TRANSFER_SRC except the last one which was never read
+		MipLevelsBarrier(CmdBuf, Dst, 0, MipLevels - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+		MipLevelsBarrier(CmdBuf, Dst, MipLevels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	}
+
+
+	void VulkanUploader::UploadMipsToImage(VkImage Dst, uint32_t MipLevels, const VkBufferImageCopy* pRegions,
+		const void* pData, VkDeviceSize Size)
+	{
+		VkBuffer SrcBuffer = VK_NULL_HANDLE;
+		VkDeviceSize SrcOffset = 0;
+		Stage(pData, Size, SrcBuffer, SrcOffset);
+
+		VkCommandBuffer CmdBuf = GetCommandBuffer();
+
+		std::vector<VkBufferImageCopy> Regions(pRegions, pRegions + MipLevels);
+
+		for (VkBufferImageCopy& Region : Regions) {
+			Region.bufferOffset += SrcOffset;
+		}
+
+		MipLevelsBarrier(CmdBuf, Dst, 0, MipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+		vkCmdCopyBufferToImage(CmdBuf, SrcBuffer, Dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			MipLevels, Regions.data());
+
+		MipLevelsBarrier(CmdBuf, Dst, 0, MipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	}
+
+
+	void VulkanUploader::TransitionImageLayout(VkImage Image, VkFormat Format, VkImageLayout OldLayout, VkImageLayout NewLayout)
+	{
+		ImageMemBarrier(GetCommandBuffer(), Image, Format, OldLayout, NewLayout);
+	}
+
+
+	void VulkanUploader::Stage(const void* pData, VkDeviceSize Size, VkBuffer& SrcBuffer, VkDeviceSize& SrcOffset)
+	{
+		if (Size > m_ringSize) {
+			VkBufferUsageFlags Usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+			VkMemoryPropertyFlags MemProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+				VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			BufferAndMemory TempBuffer = m_pVulkanCore->CreateBuffer(Size, Usage, MemProps);
+			TempBuffer.Update(m_device, pData, Size);
+
+			// Released when the batch that reads it completes
+			GetCommandBuffer();
+			m_batches[m_curBatch].m_tempBuffers.push_back(TempBuffer);
+
+			SrcBuffer = TempBuffer.m_buffer;
+			SrcOffset = 0;
+			return;
+		}
+
+		VkDeviceSize Offset = AlignUp(m_ringHead, STAGING_ALIGNMENT);
+
+		// Each batch uses a contiguous range of the ring so submit it before wrapping around
+		if (Offset + Size > m_ringSize) {
+			SubmitBatch();
+			Offset = 0;
+		}
+
+		for (int i = 0; i < NUM_UPLOAD_BATCHES; i++) {
+			UploadBatch& Batch = m_batches[i];
+
+			bool Overlaps = (Offset < Batch.m_ringEnd) && (Offset + Size > Batch.m_ringStart);
+
+			if (Batch.m_isInFlight && Overlaps) {
+				WaitForBatch(Batch);
+			}
+		}
+
+		GetCommandBuffer();
+
+		UploadBatch& CurBatch = m_batches[m_curBatch];
+
+		if (CurBatch.m_ringStart == CurBatch.m_ringEnd) {
+			CurBatch.m_ringStart = Offset;
+		}
+
+		CurBatch.m_ringEnd = Offset + Size;
+		m_ringHead = Offset + Size;
+
+		memcpy((char*)m_pRingMem + Offset, pData, Size);
+
+		SrcBuffer = m_ring.m_buffer;
+		SrcOffset = Offset;
+	}
+
+
+	VkCommandBuffer VulkanUploader::GetCommandBuffer()
+	{
+		UploadBatch& Batch = m_batches[m_curBatch];
+
+		if (!Batch.m_isRecording) {
+			if (Batch.m_isInFlight) {
+				WaitForBatch(Batch);
+			}
+
+			BeginCommandBuffer(Batch.m_cmdBuf, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+			VulkanGpuProfiler& Profiler = m_pVulkanCore->GetGpuProfiler();
+			Profiler.BeginSet(Batch.m_cmdBuf, GetProfilerSet(Batch));
+			Profiler.BeginScope(Batch.m_cmdBuf, GetProfilerSet(Batch), UPLOAD_PROFILER_SCOPE);
+
+			Batch.m_isRecording = true;
+			Batch.m_ringStart = 0;
+			Batch.m_ringEnd = 0;
+		}
+
+		return Batch.m_cmdBuf;
+	}
+
+
+	void VulkanUploader::SubmitBatch()
+	{
+		UploadBatch& Batch = m_batches[m_curBatch];
+
+		if (!Batch.m_isRecording) {
+			return;
+		}
+
+		// Make the transfers visible to everything that is submitted after this batch
+		VkMemoryBarrier Barrier = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = NULL,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT
+		};
+
+		vkCmdPipelineBarrier(Batch.m_cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			0, 1, &Barrier, 0, NULL, 0, NULL);
+
+		m_pVulkanCore->GetGpuProfiler().EndScope(Batch.m_cmdBuf, GetProfilerSet(Batch), UPLOAD_PROFILER_SCOPE);
+
+		VkResult res = vkEndCommandBuffer(Batch.m_cmdBuf);
+		CHECK_VK_RESULT(res, "vkEndCommandBuffer\n");
+
+		res = vkResetFences(m_device, 1, &Batch.m_fence);
+		CHECK_VK_RESULT(res, "vkResetFences\n");
+
+		m_pVulkanCore->GetQueue()->SubmitSync(Batch.m_cmdBuf, Batch.m_fence);
+
+		Batch.m_isRecording = false;
+		Batch.m_isInFlight = true;
+		m_numSubmits++;
+
+		m_curBatch = (m_curBatch + 1) % NUM_UPLOAD_BATCHES;
+	}
+
+
+	// The sets of the upload batches follow the sets of the swapchain images
+	int VulkanUploader::GetProfilerSet(const UploadBatch& Batch) const
+	{
+		return m_pVulkanCore->GetNumImages() + (int)(&Batch - m_batches);
+	}
+
+
+	void VulkanUploader::WaitForBatch(UploadBatch& Batch)
+	{
+		VkResult res = vkWaitForFences(m_device, 1, &Batch.m_fence, VK_TRUE, UINT64_MAX);
+		CHECK_VK_RESULT(res, "vkWaitForFences\n");
+
+		m_pVulkanCore->GetGpuProfiler().CollectSet(GetProfilerSet(Batch));
+
+		for (BufferAndMemory& TempBuffer : Batch.m_tempBuffers) {
+			TempBuffer.Destroy(m_device);
+		}
+
+		Batch.m_tempBuffers.clear();
+		Batch.m_ringStart = 0;
+		Batch.m_ringEnd = 0;
+		Batch.m_isInFlight = false;
+	}
+
+
+	void VulkanUploader::Flush()
+	{
+		SubmitBatch();
+
+		for (int i = 0; i < NUM_UPLOAD_BATCHES; i++) {
+			if (m_batches[i].m_isInFlight) {
+				WaitForBatch(m_batches[i]);
+			}
+		}
+
+		// Nothing is in flight so the whole ring is available again
+		m_ringHead = 0;
+	}
+}
@@ -32,6 +32,49 @@ namespace Engine {
 	}
 
 
+	VkFence CreateFence(VkDevice Device, bool Signaled)
+	{
+		VkFenceCreateInfo CreateInfo = {
+			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			.pNext = NULL,
+			.flags = Signaled ? (VkFenceCreateFlags)VK_FENCE_CREATE_SIGNALED_BIT : 0
+		};
+
+		VkFence Fence;
+		VkResult Res = vkCreateFence(Device, &CreateInfo, NULL, &Fence);
+		CHECK_VK_RESULT(Res, "vkCreateFence");
+		return Fence;
+	}
+
+
+	void SetViewportAndScissor(VkCommandBuffer CmdBuf, uint32_t Width, uint32_t Height)
+	{
+		VkViewport VP = {
+			.x = 0.0f,
+			.y = 0.0f,
+			.width = (float)Width,
+			.height = (float)Height,
+			.minDepth = 0.0f,
+			.maxDepth = 1.0f
+		};
+
+		vkCmdSetViewport(CmdBuf, 0, 1, &VP);
+
+		VkRect2D Scissor = {
+			.offset = {
+				.x = 0,
+				.y = 0,
+			},
+			.extent = {
+				.width = Width,
+				.height = Height
+			}
+		};
+
+		vkCmdSetScissor(CmdBuf, 0, 1, &Scissor);
+	}
+
+
 	// Copied from the "3D Graphics Rendering Cookbook"
 	void ImageMemBarrier(VkCommandBuffer CmdBuf, VkImage Image, VkFormat Format,
 		VkImageLayout OldLayout, VkImageLayout NewLayout)
@@ -167,7 +210,7 @@ namespace Engine {
 
 
 	VkImageView CreateImageView(VkDevice Device, VkImage Image, VkFormat Format,
-		VkImageAspectFlags AspectFlags)
+		VkImageAspectFlags AspectFlags, uint32_t MipLevels)
 	{
 		VkImageViewCreateInfo ViewInfo =
 		{
@@ -186,7 +229,7 @@ namespace Engine {
 			.subresourceRange = {
 				.aspectMask = AspectFlags,
 				.baseMipLevel = 0,
-				.levelCount = 1,
+				.levelCount = MipLevels,
 				.baseArrayLayer = 0,
 				.layerCount = 1
 			}
@@ -200,7 +243,7 @@ namespace Engine {
 
 
 	VkSampler CreateTextureSampler(VkDevice Device, VkFilter MinFilter, VkFilter MaxFilter,
-		VkSamplerAddressMode AddressMode)
+		VkSamplerAddressMode AddressMode, uint32_t MipLevels, float MaxAnisotropy)
 	{
 		VkSamplerCreateInfo SamplerInfo = {
 			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
@@ -213,12 +256,12 @@ namespace Engine {
 			.addressModeV = AddressMode,
 			.addressModeW = AddressMode,
 			.mipLodBias = 0.0f,
-			.anisotropyEnable = VK_FALSE,
-			.maxAnisotropy = 1,
+			.anisotropyEnable = (MaxAnisotropy > 1.0f) ? VK_TRUE : VK_FALSE,
+			.maxAnisotropy = MaxAnisotropy,
 			.compareEnable = VK_FALSE,
 			.compareOp = VK_COMPARE_OP_ALWAYS,
 			.minLod = 0.0f,
-			.maxLod = 0.0f,
+			.maxLod = (float)MipLevels,
 			.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
 			.unnormalizedCoordinates = VK_FALSE
 		};